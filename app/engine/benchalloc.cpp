@@ -0,0 +1,161 @@
+/*
+ * benchalloc.cpp
+ *
+ * Heap allocations per event in a steady simulation: frames bounced between
+ * two hosts through a switch, and small messages relayed among modules. Every
+ * call of the global operator new is counted. Packets made and freed as in a
+ * bulk transfer, a data segment and an ACK at a time, are counted as well.
+ *
+ * usage: engine-benchalloc [simulated nsec]
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+#include <E/Networking/E_Host.hpp>
+#include <E/Networking/E_Networking.hpp>
+#include <E/Networking/E_Packet.hpp>
+#include <E/Networking/E_Switch.hpp>
+
+#include "relay.hpp"
+#include <chrono>
+#include <new>
+
+using namespace E;
+
+static Size allocations = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+  void *ptr = malloc(size > 0 ? size : 1);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+static Packet frame(uint8_t self, uint8_t peer, Packet &&packet) {
+  mac_t dst{0xBC, 0, 0, 0, 0, peer};
+  mac_t src{0xBC, 0, 0, 0, 0, self};
+  packet.writeData(0, dst.data(), 6);
+  packet.writeData(6, src.data(), 6);
+  return std::move(packet);
+}
+
+// Sends every frame back where it came from, as the Ethernet of its Host.
+class Reflector : public HostModule {
+public:
+  Reflector(Host &host, uint8_t self, uint8_t peer, Size &frames)
+      : HostModule("Ethernet", host), host(host), self(self), peer(peer),
+        frames(frames) {}
+
+protected:
+  Host &host;
+  uint8_t self;
+  uint8_t peer;
+  Size &frames;
+
+  virtual void packetArrived(std::string fromModule, Packet &&packet) {
+    frames++;
+    host.sendPacket(0, frame(self, peer, std::move(packet)));
+  }
+};
+
+static void measureHosts(Time duration) {
+  NetworkSystem system;
+  auto hub = system.addModule<Switch>("Switch", system);
+  auto a = system.addModule<Host>("A", system);
+  auto b = system.addModule<Host>("B", system);
+  Size frames = 0;
+  a->addHostModule<Reflector>(*a, 1, 2, frames);
+  b->addHostModule<Reflector>(*b, 2, 1, frames);
+  int portA = system.addWire(*a, *hub, 1000).second.second;
+  int portB = system.addWire(*b, *hub, 1000).second.second;
+  hub->addMACEntry(portA, {0xBC, 0, 0, 0, 0, 1});
+  hub->addMACEntry(portB, {0xBC, 0, 0, 0, 0, 2});
+  for (int k = 0; k < 16; k++) {
+    a->sendPacket(0, frame(1, 2, Packet(64)));
+    b->sendPacket(0, frame(2, 1, Packet(64)));
+  }
+
+  // warm up, so that only the steady state is counted
+  system.run(duration / 10);
+  const Time start = system.getCurrentTime();
+  const Size before = allocations;
+  const Size framesBefore = frames;
+  auto clock = std::chrono::steady_clock::now();
+  system.run(start + duration);
+  auto end = std::chrono::steady_clock::now();
+  const Size reflected = frames - framesBefore;
+
+  printf("%-10s %8.2f allocations/frame %10.2f ns/frame (%zu frames)\n",
+         "hosts", (double)(allocations - before) / reflected,
+         std::chrono::duration<double, std::nano>(end - clock).count() /
+             reflected,
+         reflected);
+}
+
+static void measureRelays(Time duration) {
+  System system;
+  std::mt19937_64 rng(1614233283);
+  Size events = 0;
+  const size_t count = 1000;
+  std::vector<std::shared_ptr<Relay>> relays;
+  for (size_t k = 0; k < count; k++)
+    relays.push_back(system.addModule<Relay>(system, count, rng, events));
+  for (size_t k = 0; k < count; k += 10)
+    relays[k]->start();
+
+  system.run(duration / 10);
+  const Time start = system.getCurrentTime();
+  const Size before = allocations;
+  const Size eventsBefore = events;
+  auto clock = std::chrono::steady_clock::now();
+  system.run(start + duration);
+  auto end = std::chrono::steady_clock::now();
+  const Size dispatched = events - eventsBefore;
+
+  printf("%-10s %8.2f allocations/event %10.2f ns/event (%zu events)\n",
+         "relays", (double)(allocations - before) / dispatched,
+         std::chrono::duration<double, std::nano>(end - clock).count() /
+             dispatched,
+         dispatched);
+}
+
+static void measurePackets(Size count) {
+  std::vector<char> segment(1514, 1);
+  // warm up the free lists
+  for (int k = 0; k < 16; k++)
+    Packet(1514), Packet(54);
+
+  const Size before = allocations;
+  auto clock = std::chrono::steady_clock::now();
+  for (Size k = 0; k < count; k++) {
+    Packet data = Packet::uninitialized(segment.size());
+    data.writeData(0, segment.data(), segment.size());
+    Packet ack(54);
+    ack.writeData(0, segment.data(), 14);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  printf("%-10s %8.2f allocations/packet %9.2f ns/packet (%zu packets)\n",
+         "packets", (double)(allocations - before) / (count * 2),
+         std::chrono::duration<double, std::nano>(end - clock).count() /
+             (count * 2),
+         count * 2);
+}
+
+int main(int argc, char **argv) {
+  Time duration = 50000000; // 50 msec
+  if (argc > 1)
+    duration = strtoull(argv[1], nullptr, 10);
+
+  measureHosts(duration);
+  measureRelays(duration);
+  measurePackets(duration / 100);
+  return 0;
+}
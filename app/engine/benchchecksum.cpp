@@ -0,0 +1,70 @@
+/*
+ * benchchecksum.cpp
+ *
+ * Cost of the one's complement sum of NetworkUtil::one_sum for every kernel
+ * this CPU supports, against the byte at a time loop it replaced, from an
+ * IPv4 header to a jumbo frame.
+ *
+ * usage: engine-benchchecksum [bytes summed per measurement]
+ */
+
+#include <E/E_Common.hpp>
+#include <E/Networking/E_NetworkUtil.hpp>
+
+#include <chrono>
+
+using namespace E;
+using Kernel = NetworkUtil::SumKernel;
+
+static uint16_t bytewise(const uint8_t *buffer, size_t size) {
+  uint32_t sum = 0;
+  for (size_t k = 0; k < size; k++) {
+    sum += k % 2 == 0 ? buffer[k] << 8 : buffer[k];
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return (uint16_t)sum;
+}
+
+static volatile uint16_t sink;
+
+template <typename Sum>
+static void measure(const char *name, const std::vector<uint8_t> &bytes,
+                    size_t size, Size total, Sum sum) {
+  const Size count = std::max<Size>(total / size, 1);
+  auto clock = std::chrono::steady_clock::now();
+  for (Size k = 0; k < count; k++)
+    sink = sum(bytes.data(), size);
+  auto end = std::chrono::steady_clock::now();
+
+  const double ns = std::chrono::duration<double, std::nano>(end - clock)
+                        .count();
+  printf("%-8s %5zu bytes %10.2f ns/sum %8.2f GB/s\n", name, size,
+         ns / count, (double)size * count / ns);
+}
+
+int main(int argc, char **argv) {
+  Size total = 1 << 28; // 256 MB
+  if (argc > 1)
+    total = strtoull(argv[1], nullptr, 10);
+
+  std::vector<uint8_t> bytes(9000);
+  for (size_t k = 0; k < bytes.size(); k++)
+    bytes[k] = (uint8_t)(k * 31 + 7);
+
+  const std::pair<const char *, Kernel> kernels[] = {
+      {"scalar", Kernel::SCALAR},
+      {"sse2", Kernel::SSE2},
+      {"avx2", Kernel::AVX2}};
+
+  for (size_t size : {20, 40, 64, 576, 1500, 4096, 9000}) {
+    measure("bytewise", bytes, size, total / 16, bytewise);
+    for (auto &[name, kernel] : kernels) {
+      if (!NetworkUtil::sum_supported(kernel))
+        continue;
+      measure(name, bytes, size, total, [kernel](auto buffer, auto size) {
+        return NetworkUtil::one_sum(buffer, size, kernel);
+      });
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * benchdispatch.cpp
+ *
+ * Cost of classifying messages: typeid comparisons and dynamic_cast against
+ * a switch on Module::MessageTag, and a chain of switches where every hop is
+ * dispatched by a Wire or a Switch, and a large population of modules
+ * relaying messages to random peers.
+ *
+ * usage: engine-benchdispatch [messages] [simulated nsec] [modules]
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+#include <E/Networking/E_Networking.hpp>
+#include <E/Networking/E_Packet.hpp>
+#include <E/Networking/E_Switch.hpp>
+#include <E/Networking/E_Wire.hpp>
+
+#include "relay.hpp"
+#include <chrono>
+
+using namespace E;
+using Tag = Module::MessageTag;
+
+// five message classes, like those handled by a Host
+template <int N> class Kind : public Module::MessageBase {
+public:
+  static constexpr Tag TAG = (Tag)((int)Tag::USER + N);
+  uint64_t value;
+  Kind(uint64_t value) : MessageBase(TAG), value(value) {}
+};
+
+static uint64_t classifyRTTI(Module::MessageBase &message) {
+  if (typeid(message) == typeid(Kind<0> &))
+    return dynamic_cast<Kind<0> &>(message).value;
+  else if (typeid(message) == typeid(Kind<1> &))
+    return dynamic_cast<Kind<1> &>(message).value * 3;
+  else if (typeid(message) == typeid(Kind<2> &))
+    return dynamic_cast<Kind<2> &>(message).value * 5;
+  else if (typeid(message) == typeid(Kind<3> &))
+    return dynamic_cast<Kind<3> &>(message).value * 7;
+  else if (typeid(message) == typeid(Kind<4> &))
+    return dynamic_cast<Kind<4> &>(message).value * 11;
+  assert(0);
+  return 0;
+}
+
+static uint64_t classifyTag(Module::MessageBase &message) {
+  switch (message.getTag()) {
+  case Kind<0>::TAG:
+    return static_cast<Kind<0> &>(message).value;
+  case Kind<1>::TAG:
+    return static_cast<Kind<1> &>(message).value * 3;
+  case Kind<2>::TAG:
+    return static_cast<Kind<2> &>(message).value * 5;
+  case Kind<3>::TAG:
+    return static_cast<Kind<3> &>(message).value * 7;
+  case Kind<4>::TAG:
+    return static_cast<Kind<4> &>(message).value * 11;
+  default:
+    assert(0);
+  }
+  return 0;
+}
+
+static uint64_t classifyVisit(Module::MessageBase &message) {
+  uint64_t result = 0;
+  Module::visitMessage<Kind<0>, Kind<1>, Kind<2>, Kind<3>, Kind<4>>(
+      message, [&](auto &kind) { result = kind.value; });
+  return result;
+}
+
+template <typename Classify>
+static double measure(std::vector<Module::Message> &messages,
+                      Classify classify, uint64_t &sum) {
+  auto start = std::chrono::steady_clock::now();
+  for (auto &message : messages)
+    sum += classify(*message);
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         messages.size();
+}
+
+// Sends frames back and forth through a chain of switches.
+class Bouncer : public NetworkModule {
+public:
+  Size hops = 0; // frames received
+
+  Bouncer(NetworkSystem &system, uint8_t self, uint8_t peer)
+      : NetworkModule(system), self(self), peer(peer) {}
+
+  void start(int frames) {
+    for (int k = 0; k < frames; k++)
+      send();
+  }
+
+protected:
+  uint8_t self;
+  uint8_t peer;
+
+  void send() {
+    Packet packet(64);
+    mac_t dst{0xBC, 0, 0, 0, 0, peer};
+    mac_t src{0xBC, 0, 0, 0, 0, self};
+    packet.writeData(0, dst.data(), 6);
+    packet.writeData(6, src.data(), 6);
+    sendMessage(ports[0],
+                std::make_unique<Wire::Message>(Wire::PACKET_TO_PORT,
+                                                std::move(packet)),
+                0);
+  }
+
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message) {
+    hops++;
+    send();
+    return nullptr;
+  }
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {}
+  virtual void messageCancelled(const ModuleID to, Module::Message message) {}
+};
+
+static double measureFrames(Time duration, Size &frames) {
+  NetworkSystem system;
+  const size_t switches = 4;
+  std::vector<std::shared_ptr<Switch>> chain;
+  for (size_t k = 0; k < switches; k++) {
+    chain.push_back(
+        system.addModule<Switch>("Switch" + std::to_string(k), system));
+    if (k > 0) {
+      auto ports = system.addWire(*chain[k - 1], *chain[k], 1000).second;
+      chain[k - 1]->addMACEntry(ports.first, {0xBC, 0, 0, 0, 0, 2});
+      chain[k]->addMACEntry(ports.second, {0xBC, 0, 0, 0, 0, 1});
+    }
+  }
+  auto a = system.addModule<Bouncer>(system, 1, 2);
+  auto b = system.addModule<Bouncer>(system, 2, 1);
+  int portA = system.addWire(*a, *chain.front(), 1000).second.second;
+  int portB = system.addWire(*b, *chain.back(), 1000).second.second;
+  chain.front()->addMACEntry(portA, {0xBC, 0, 0, 0, 0, 1});
+  chain.back()->addMACEntry(portB, {0xBC, 0, 0, 0, 0, 2});
+  a->start(16);
+  b->start(16);
+
+  auto start = std::chrono::steady_clock::now();
+  system.run(duration);
+  auto end = std::chrono::steady_clock::now();
+  // every frame is dispatched by 5 wires and 4 switches on its way
+  frames = a->hops + b->hops;
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         frames;
+}
+
+static double measureRelays(size_t count, Time duration, Size &events) {
+  System system;
+  std::mt19937_64 rng(1614233283);
+  std::vector<std::shared_ptr<Relay>> relays;
+  events = 0;
+  for (size_t k = 0; k < count; k++)
+    relays.push_back(system.addModule<Relay>(system, count, rng, events));
+  // one message in flight per 100 modules
+  for (size_t k = 0; k < count; k += 100)
+    relays[k]->start();
+
+  auto start = std::chrono::steady_clock::now();
+  system.run(duration);
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         events;
+}
+
+int main(int argc, char **argv) {
+  size_t count = 10000000;
+  Time duration = 50000000; // 50 msec
+  size_t modules = 100000;
+  if (argc > 1)
+    count = strtoul(argv[1], nullptr, 10);
+  if (argc > 2)
+    duration = strtoull(argv[2], nullptr, 10);
+  if (argc > 3)
+    modules = strtoul(argv[3], nullptr, 10);
+
+  std::mt19937_64 rng(1614233283);
+  std::vector<Module::Message> messages;
+  for (size_t k = 0; k < count; k++) {
+    switch (rng() % 5) {
+    case 0:
+      messages.push_back(std::make_unique<Kind<0>>(k));
+      break;
+    case 1:
+      messages.push_back(std::make_unique<Kind<1>>(k));
+      break;
+    case 2:
+      messages.push_back(std::make_unique<Kind<2>>(k));
+      break;
+    case 3:
+      messages.push_back(std::make_unique<Kind<3>>(k));
+      break;
+    default:
+      messages.push_back(std::make_unique<Kind<4>>(k));
+      break;
+    }
+  }
+
+  uint64_t sum = 0;
+  printf("%zu messages of 5 classes\n", count);
+  printf("%-22s %10.2f ns/message\n", "typeid + dynamic_cast",
+         measure(messages, classifyRTTI, sum));
+  printf("%-22s %10.2f ns/message\n", "tag switch",
+         measure(messages, classifyTag, sum));
+  printf("%-22s %10.2f ns/message\n", "visitMessage",
+         measure(messages, classifyVisit, sum));
+
+  Size frames;
+  double perFrame = measureFrames(duration, frames);
+  printf("%-22s %10.2f ns/frame (%zu frames through 4 switches)\n",
+         "switch chain", perFrame, frames);
+  Size events;
+  double perEvent = measureRelays(modules, duration, events);
+  printf("%-22s %10.2f ns/event (%zu events among %zu modules)\n", "relays",
+         perEvent, events, modules);
+  printf("checksum %" PRIu64 "\n", sum);
+  return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * bencheventqueue.cpp
+ *
+ * Classic "hold" benchmark for the pending event queue of E::System.
+ * A fixed population of timers is kept pending; each dispatched timer
+ * re-arms itself with an exponentially distributed delay, just like the
+ * retransmission timers of a long congestion run.
+ * The second table adds a retransmission timeout per timer that is
+ * re-armed (cancelled and sent again) on every dispatch.
+ *
+ * usage: engine-bencheventqueue [events per run]
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+
+#include <chrono>
+
+using namespace E;
+
+class HoldModule : public Module {
+private:
+  std::mt19937_64 rng;
+  std::exponential_distribution<Real> delay;
+  size_t remaining;
+  bool retransmit;
+  UUID timeout;
+
+  class Tick : public Module::MessageBase {};
+
+public:
+  HoldModule(System &system, size_t events, bool retransmit)
+      : Module(system), rng(1614233283), delay(1.0 / 1000000.0),
+        remaining(events), retransmit(retransmit), timeout(0) {}
+
+  void arm() {
+    sendMessageSelf(std::make_unique<Tick>(), (Time)delay(rng));
+    if (retransmit) {
+      cancelMessage(timeout);
+      timeout = sendMessageSelf(std::make_unique<Tick>(), 1000000000000UL);
+    }
+  }
+
+protected:
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message) {
+    if (remaining > 0) {
+      remaining--;
+      arm();
+    }
+    return nullptr;
+  }
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {}
+  virtual void messageCancelled(const ModuleID to, Module::Message message) {}
+};
+
+static Real eventsPerSecond(EventQueueType type, size_t population,
+                            size_t events, bool retransmit) {
+  System system(type);
+  auto module = system.addModule<HoldModule>(system, events, retransmit);
+  for (size_t k = 0; k < population; k++)
+    module->arm();
+
+  auto start = std::chrono::steady_clock::now();
+  system.run(0);
+  auto end = std::chrono::steady_clock::now();
+
+  Real seconds = std::chrono::duration<Real>(end - start).count();
+  return (events + population) / seconds;
+}
+
+int main(int argc, char **argv) {
+  size_t events = 1000000;
+  if (argc > 1)
+    events = strtoull(argv[1], nullptr, 10);
+
+  for (bool retransmit : {false, true}) {
+    printf("%s\n", retransmit ? "hold + cancel" : "hold");
+    printf("%12s %16s %16s %8s\n", "pending", "heap (ev/s)",
+           "calendar (ev/s)", "ratio");
+    for (size_t population : {100UL, 1000UL, 10000UL, 100000UL, 300000UL}) {
+      Real heap =
+          eventsPerSecond(EventQueueType::HEAP, population, events, retransmit);
+      Real calendar = eventsPerSecond(EventQueueType::CALENDAR, population,
+                                      events, retransmit);
+      printf("%12zu %16.0f %16.0f %8.2f\n", population, heap, calendar,
+             calendar / heap);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * benchparallel.cpp
+ *
+ * Speedup of the parallel modes of E::System against the sequential run.
+ * A chain of switches, each with a pair of traffic sources. Most frames go
+ * to the other source of the same switch; the rest cross the chain, which
+ * is what the partitions have to synchronize on.
+ *
+ * usage: engine-benchparallel [simulated msec] [remote traffic ratio]
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+#include <E/E_TimeUtil.hpp>
+#include <E/Networking/E_NetworkUtil.hpp>
+#include <E/Networking/E_Networking.hpp>
+#include <E/Networking/E_Packet.hpp>
+#include <E/Networking/E_Switch.hpp>
+#include <E/Networking/E_Wire.hpp>
+
+#include <chrono>
+
+using namespace E;
+
+static constexpr size_t SWITCHES = 16;
+static constexpr size_t SOURCES = 2 * SWITCHES;
+static constexpr Time WIRE_DELAY = 100000; // 100 usec
+static constexpr Time MEAN_GAP = 20000;    // 20 usec per source
+
+static mac_t macOf(size_t source) {
+  return {0xBC, 0, 0, 0, (uint8_t)(source >> 8), (uint8_t)source};
+}
+
+class Source : public NetworkModule {
+public:
+  uint64_t digest = 0;
+  Size received = 0;
+
+  Source(NetworkSystem &system, size_t index, Real remote)
+      : NetworkModule(system), index(index), remote(remote),
+        rng(1614233283 + index) {}
+
+  void start() { sendMessageSelf(std::make_unique<Tick>(), 0); }
+
+protected:
+  class Tick : public Module::MessageBase {
+  public:
+    std::unique_ptr<Module::MessageBase> cloneMessage() const override {
+      return std::make_unique<Tick>();
+    }
+  };
+
+  class State {
+  public:
+    std::mt19937_64 rng;
+    uint64_t digest;
+    Size received;
+  };
+
+  size_t index;
+  Real remote;
+  std::mt19937_64 rng;
+
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message) {
+    if (typeid(message) == typeid(Tick &)) {
+      std::uniform_real_distribution<Real> coin(0, 1);
+      size_t destination = index ^ 1;
+      if (coin(rng) < remote)
+        destination = rng() % SOURCES;
+
+      Packet packet(64 + rng() % 1400);
+      mac_t dst = macOf(destination);
+      mac_t src = macOf(index);
+      packet.writeData(0, dst.data(), 6);
+      packet.writeData(6, src.data(), 6);
+      sendMessage(ports[0],
+                  std::make_unique<Wire::Message>(Wire::PACKET_TO_PORT,
+                                                  std::move(packet)),
+                  0);
+
+      std::exponential_distribution<Real> gap(1.0 / MEAN_GAP);
+      sendMessageSelf(std::make_unique<Tick>(), (Time)gap(rng));
+      return nullptr;
+    }
+
+    Wire::Message &frame = dynamic_cast<Wire::Message &>(message);
+    digest = digest * 31 + (getCurrentTime() ^ frame.packet.getSize());
+    received++;
+    return nullptr;
+  }
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {}
+  virtual void messageCancelled(const ModuleID to, Module::Message message) {}
+
+  virtual std::any saveState(const ModuleID from) {
+    return State{rng, digest, received};
+  }
+  virtual void restoreState(const ModuleID from, std::any &&state) {
+    State &saved = std::any_cast<State &>(state);
+    rng = saved.rng;
+    digest = saved.digest;
+    received = saved.received;
+  }
+};
+
+class Result {
+public:
+  Real seconds;
+  uint64_t digest;
+  Size received;
+  System::ParallelStatistics statistics;
+};
+
+static Result simulate(Time duration, Real remote, size_t threads,
+                       Time optimism) {
+  NetworkSystem system;
+  system.setParallelism(threads);
+  system.setOptimism(optimism);
+
+  std::vector<std::shared_ptr<Switch>> switches;
+  std::vector<std::shared_ptr<Source>> sources;
+  std::vector<int> uplinks; // port of each switch towards the next one
+  for (size_t k = 0; k < SWITCHES; k++) {
+    switches.push_back(
+        system.addModule<Switch>("Switch" + std::to_string(k), system));
+    for (size_t j = 0; j < 2; j++) {
+      auto source = system.addModule<Source>(system, sources.size(), remote);
+      auto ports = system.addWire(*source, *switches[k], WIRE_DELAY).second;
+      switches[k]->addMACEntry(ports.second, macOf(sources.size()));
+      sources.push_back(source);
+    }
+    if (k > 0) {
+      auto ports =
+          system.addWire(*switches[k - 1], *switches[k], WIRE_DELAY).second;
+      uplinks.push_back(ports.first);
+      // everything behind the previous switch is reached through this port
+      for (size_t s = 0; s < 2 * k; s++)
+        switches[k]->addMACEntry(ports.second, macOf(s));
+    }
+  }
+  for (size_t k = 0; k + 1 < SWITCHES; k++) {
+    for (size_t s = 2 * (k + 1); s < SOURCES; s++)
+      switches[k]->addMACEntry(uplinks[k], macOf(s));
+  }
+  for (auto &source : sources)
+    source->start();
+
+  auto start = std::chrono::steady_clock::now();
+  system.run(duration);
+  auto end = std::chrono::steady_clock::now();
+
+  Result result{std::chrono::duration<Real>(end - start).count(), 0, 0,
+                system.getParallelStatistics()};
+  for (auto &source : sources) {
+    result.digest = result.digest * 31 + source->digest;
+    result.received += source->received;
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  Time duration = TimeUtil::makeTime(50, TimeUtil::MSEC);
+  Real remote = 0.01;
+  if (argc > 1)
+    duration = TimeUtil::makeTime(strtoull(argv[1], nullptr, 10),
+                                  TimeUtil::MSEC);
+  if (argc > 2)
+    remote = strtod(argv[2], nullptr);
+
+  Result sequential = simulate(duration, remote, 1, 0);
+  printf("%zu frames delivered, lookahead %" PRIu64 " ns\n",
+         sequential.received, WIRE_DELAY);
+  printf("%-12s %8s %10s %8s %10s %10s %12s %6s\n", "mode", "threads",
+         "seconds", "speedup", "windows", "committed", "rolled back",
+         "same");
+  printf("%-12s %8d %10.3f %8.2f %10s %10s %12s %6s\n", "sequential", 1,
+         sequential.seconds, 1.0, "-", "-", "-", "-");
+
+  for (size_t threads : {2, 4, 8}) {
+    for (Time optimism : {(Time)0, 4 * WIRE_DELAY}) {
+      Result result = simulate(duration, remote, threads, optimism);
+      printf("%-12s %8zu %10.3f %8.2f %10zu %10zu %12zu %6s\n",
+             optimism ? "time warp" : "conservative", threads, result.seconds,
+             sequential.seconds / result.seconds, result.statistics.windows,
+             result.statistics.committed, result.statistics.rolledBack,
+             result.digest == sequential.digest ? "yes" : "NO");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * benchrunnable.cpp
+ *
+ * Cost of blocking calls made by Runnables: every wait() hands control back
+ * to the System, and every wake hands it over again. Compares OS threads with
+ * fibers.
+ *
+ * usage: engine-benchrunnable [runnables] [blocking calls per runnable]
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+
+#include <chrono>
+
+using namespace E;
+
+class Sleeper;
+
+class Clock : public Module {
+public:
+  Clock(System &system) : Module(system), system(system) {}
+
+  std::vector<std::shared_ptr<Sleeper>> sleepers;
+
+  void sleep(size_t index, Time delay) {
+    sendMessageSelf(std::make_unique<Alarm>(index), delay);
+  }
+
+protected:
+  class Alarm : public Module::MessageBase {
+  public:
+    size_t index;
+    Alarm(size_t index) : index(index) {}
+  };
+
+  System &system;
+
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message);
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {}
+  virtual void messageCancelled(const ModuleID to, Module::Message message) {}
+};
+
+class Sleeper : public Runnable {
+public:
+  Sleeper(RunnableType type, Clock &clock, size_t index, size_t calls)
+      : Runnable(type), clock(clock), index(index), calls(calls) {}
+
+  void wakeUp() { ready(); }
+
+protected:
+  Clock &clock;
+  size_t index;
+  size_t calls;
+
+  virtual void main() {
+    for (size_t k = 0; k < calls; k++) {
+      clock.sleep(index, 1 + (index + k) % 100);
+      wait();
+    }
+  }
+};
+
+Module::Message Clock::messageReceived(const ModuleID from,
+                                       Module::MessageBase &message) {
+  Alarm &alarm = dynamic_cast<Alarm &>(message);
+  sleepers[alarm.index]->wakeUp();
+  system.addRunnable(sleepers[alarm.index]);
+  return nullptr;
+}
+
+static double simulate(RunnableType type, size_t count, size_t calls) {
+  auto start = std::chrono::steady_clock::now();
+  {
+    System system;
+    system.setRunnableType(type);
+    auto clock = system.addModule<Clock>(system);
+    for (size_t k = 0; k < count; k++)
+      clock->sleepers.push_back(
+          std::make_shared<Sleeper>(type, *clock, k, calls));
+    for (auto &sleeper : clock->sleepers) {
+      sleeper->start();
+      system.addRunnable(sleeper);
+    }
+    system.run(0);
+    clock->sleepers.clear();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char **argv) {
+  size_t count = 200;
+  size_t calls = 500;
+  if (argc > 1)
+    count = strtoul(argv[1], nullptr, 10);
+  if (argc > 2)
+    calls = strtoul(argv[2], nullptr, 10);
+
+  printf("%zu runnables, %zu blocking calls each\n", count, calls);
+  printf("%-8s %10s %14s\n", "backend", "seconds", "nsec per call");
+  for (RunnableType type : {RunnableType::THREAD, RunnableType::FIBER}) {
+    double seconds = simulate(type, count, calls);
+    printf("%-8s %10.3f %14.0f\n",
+           type == RunnableType::THREAD ? "thread" : "fiber", seconds,
+           seconds * 1e9 / (count * calls));
+  }
+  return 0;
+}
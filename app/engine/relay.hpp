@@ -0,0 +1,46 @@
+/*
+ * relay.hpp
+ *
+ * Message relay shared by the benchmarks of event dispatch.
+ */
+
+#ifndef APP_ENGINE_RELAY_HPP_
+#define APP_ENGINE_RELAY_HPP_
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+
+#include <random>
+
+namespace E {
+
+// Hands every message it receives over to a random peer. The System holds
+// nothing but relays, so their IDs are 1 to count.
+class Relay : public Module {
+public:
+  Relay(System &system, size_t count, std::mt19937_64 &rng, Size &events)
+      : Module(system), count(count), rng(rng), events(events) {}
+
+  void start() { sendMessageSelf(std::make_unique<EmptyMessage>(), 0); }
+
+protected:
+  size_t count;
+  std::mt19937_64 &rng;
+  Size &events;
+
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message) {
+    events++;
+    sendMessage(1 + rng() % count, std::make_unique<EmptyMessage>(),
+                1 + rng() % 100000);
+    return nullptr;
+  }
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {}
+  virtual void messageCancelled(const ModuleID to, Module::Message message) {}
+};
+
+} // namespace E
+
+#endif /* APP_ENGINE_RELAY_HPP_ */
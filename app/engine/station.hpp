@@ -0,0 +1,80 @@
+/*
+ * station.hpp
+ *
+ * Frame exchange shared by the tests of whole simulations.
+ */
+
+#ifndef APP_ENGINE_STATION_HPP_
+#define APP_ENGINE_STATION_HPP_
+
+#include <E/E_Checkpoint.hpp>
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/Networking/E_Networking.hpp>
+#include <E/Networking/E_Packet.hpp>
+#include <E/Networking/E_Wire.hpp>
+
+namespace E {
+
+// Sends numbered frames to its peer through an unreliable Switch, and hashes
+// what it receives and when (including the corruption made by the Switch).
+class Station : public NetworkModule {
+public:
+  uint64_t digest = 0;
+
+  Station(NetworkSystem &system, uint8_t self, uint8_t peer)
+      : NetworkModule(system), self(self), peer(peer) {}
+
+  void start(int frames, Time interval) {
+    for (int k = 0; k < frames; k++)
+      sendMessageSelf(std::make_unique<Module::EmptyMessage>(), k * interval);
+  }
+
+protected:
+  uint8_t self;
+  uint8_t peer;
+  uint8_t sequence = 0;
+
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message) {
+    if (message.getTag() == Module::EmptyMessage::TAG) {
+      Packet packet(100);
+      mac_t dst{0xBC, 0, 0, 0, 0, peer};
+      mac_t src{0xBC, 0, 0, 0, 0, self};
+      packet.writeData(0, dst.data(), 6);
+      packet.writeData(6, src.data(), 6);
+      packet.writeData(12, &sequence, 1);
+      sequence++;
+      sendMessage(ports[0],
+                  std::make_unique<Wire::Message>(Wire::PACKET_TO_PORT,
+                                                  std::move(packet)),
+                  0);
+      return nullptr;
+    }
+
+    Wire::Message &frame = *messageCast<Wire::Message>(message);
+    std::array<uint8_t, 100> bytes;
+    frame.packet.readData(0, bytes.data(), bytes.size());
+    for (uint8_t byte : bytes)
+      digest = digest * 31 + byte;
+    digest = digest * 31 + getCurrentTime();
+    return nullptr;
+  }
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {}
+  virtual void messageCancelled(const ModuleID to, Module::Message message) {}
+
+  virtual bool writeCheckpoint(std::ostream &out) {
+    Checkpoint::write(out, digest);
+    Checkpoint::write(out, sequence);
+    return true;
+  }
+  virtual void readCheckpoint(std::istream &in) {
+    digest = Checkpoint::read<uint64_t>(in);
+    sequence = Checkpoint::read<uint8_t>(in);
+  }
+};
+
+} // namespace E
+
+#endif /* APP_ENGINE_STATION_HPP_ */
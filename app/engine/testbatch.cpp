@@ -0,0 +1,118 @@
+/*
+ * testbatch.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace E;
+
+class Value : public Module::MessageBase {
+public:
+  int value;
+  Value(int value) : value(value) {}
+};
+
+// Records what it receives, and answers odd values.
+class Sink : public Module {
+public:
+  std::vector<int> received;
+  std::vector<size_t> batches;
+
+  Sink(System &system, bool batched) : Module(system) {
+    setBatchDelivery(batched);
+  }
+
+protected:
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message) {
+    batches.push_back(1);
+    return receive(dynamic_cast<Value &>(message).value);
+  }
+
+  virtual void messagesReceivedBatch(std::vector<Delivery> &batch) {
+    batches.push_back(batch.size());
+    for (Delivery &delivery : batch)
+      delivery.response =
+          receive(dynamic_cast<Value &>(*delivery.message).value);
+  }
+
+  Module::Message receive(int value) {
+    received.push_back(value);
+    if (value % 2 == 1)
+      return std::make_unique<Value>(value * 10);
+    return nullptr;
+  }
+
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {}
+};
+
+// Sends values, and records the responses in the order they were finished.
+class Source : public Module {
+public:
+  std::vector<std::pair<int, int>> finished;
+
+  Source(System &system) : Module(system) {}
+
+  void send(ModuleID to, int value, Time delay) {
+    sendMessage(to, std::make_unique<Value>(value), delay);
+  }
+
+protected:
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {
+    Value *answer = dynamic_cast<Value *>(&response);
+    finished.push_back({dynamic_cast<Value &>(*message).value,
+                        answer != nullptr ? answer->value : 0});
+  }
+};
+
+class Result {
+public:
+  std::vector<int> received;
+  std::vector<size_t> batches;
+  std::vector<std::pair<int, int>> finished;
+};
+
+static Result simulate(bool batched) {
+  System system;
+  auto a = system.addModule<Source>(system);
+  auto b = system.addModule<Source>(system);
+  auto sink = system.addModule<Sink>(system, batched);
+  auto other = system.addModule<Sink>(system, batched);
+  const ModuleID to = 3;
+
+  a->send(to, 1, 10);
+  a->send(to, 2, 10);
+  b->send(to, 3, 10);
+  a->send(4, 6, 10); // to the other sink, between the messages at 10
+  a->send(to, 4, 20);
+  b->send(to, 7, 10);
+  b->send(to, 5, 20);
+  system.run(0);
+
+  std::vector<std::pair<int, int>> finished = a->finished;
+  finished.insert(finished.end(), b->finished.begin(), b->finished.end());
+  EXPECT_EQ(other->received, std::vector<int>({6}));
+  return {sink->received, sink->batches, finished};
+}
+
+TEST(TestBatch, SameTimeAndModule) {
+  Result batched = simulate(true);
+  EXPECT_EQ(batched.batches, std::vector<size_t>({3, 1, 2}));
+
+  Result single = simulate(false);
+  EXPECT_EQ(single.batches, std::vector<size_t>({1, 1, 1, 1, 1, 1}));
+
+  // same order and responses either way
+  EXPECT_EQ(batched.received, std::vector<int>({1, 2, 3, 7, 4, 5}));
+  EXPECT_EQ(batched.received, single.received);
+  std::vector<std::pair<int, int>> finished = {
+      {1, 10}, {2, 0}, {6, 0}, {4, 0}, {3, 30}, {7, 70}, {5, 50}};
+  EXPECT_EQ(batched.finished, finished);
+  EXPECT_EQ(batched.finished, single.finished);
+}
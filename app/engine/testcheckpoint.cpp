@@ -0,0 +1,95 @@
+/*
+ * testcheckpoint.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+#include <E/Networking/E_Networking.hpp>
+#include <E/Networking/E_Switch.hpp>
+
+#include "station.hpp"
+#include <gtest/gtest.h>
+
+using namespace E;
+
+// Keeps its state to itself.
+class Opaque : public Module {
+public:
+  Opaque(System &system) : Module(system) {}
+};
+
+class Network {
+public:
+  NetworkSystem system;
+  std::shared_ptr<Station> a;
+  std::shared_ptr<Station> b;
+
+  Network() {
+    system.setRandomSeed(7);
+    auto hub = system.addModule<Switch>("Switch", system, true);
+    hub->setQueueSize(8);
+    a = system.addModule<Station>(system, 1, 2);
+    b = system.addModule<Station>(system, 2, 1);
+    int portA = system.addWire(*a, *hub, 20000).second.second;
+    int portB = system.addWire(*b, *hub, 20000).second.second;
+    hub->addMACEntry(portA, {0xBC, 0, 0, 0, 0, 1});
+    hub->addMACEntry(portB, {0xBC, 0, 0, 0, 0, 2});
+    a->start(400, 500);
+    b->start(400, 500);
+  }
+
+  uint64_t digest() { return a->digest * 31 + b->digest; }
+};
+
+static const Time WARMUP = 100000;
+static const Time END = 500000;
+
+TEST(TestCheckpoint, ResumesRun) {
+  const std::string path = ::testing::TempDir() + "testcheckpoint.ckpt";
+
+  Network reference;
+  reference.system.run(END);
+
+  Network warm;
+  warm.system.run(WARMUP);
+  ASSERT_TRUE(warm.system.checkpoint(path));
+  EXPECT_NE(warm.digest(), reference.digest());
+
+  // every fork continues the same run, whatever it had pending before
+  for (int k = 0; k < 2; k++) {
+    Network fork;
+    ASSERT_TRUE(fork.system.restore(path));
+    EXPECT_EQ(fork.system.getCurrentTime(), warm.system.getCurrentTime());
+    EXPECT_EQ(fork.digest(), warm.digest());
+    fork.system.run(END);
+    EXPECT_EQ(fork.digest(), reference.digest());
+  }
+  std::remove(path.c_str());
+}
+
+TEST(TestCheckpoint, Rejects) {
+  const std::string path = ::testing::TempDir() + "testcheckpoint.ckpt";
+  std::remove(path.c_str());
+
+  Network opaque;
+  opaque.system.addModule<Opaque>(opaque.system);
+  opaque.system.run(WARMUP);
+  EXPECT_FALSE(opaque.system.checkpoint(path));
+  EXPECT_FALSE(opaque.system.restore(path));
+
+  Network warm;
+  warm.system.run(WARMUP);
+  ASSERT_TRUE(warm.system.checkpoint(path));
+
+  // set up with other modules: left untouched
+  Network other;
+  other.system.addModule<Opaque>(other.system);
+  EXPECT_FALSE(other.system.restore(path));
+  EXPECT_EQ(other.system.getCurrentTime(), 0);
+  other.system.run(END);
+  Network reference;
+  reference.system.run(END);
+  EXPECT_EQ(other.digest(), reference.digest());
+  std::remove(path.c_str());
+}
@@ -0,0 +1,197 @@
+/*
+ * testchecksum.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/Networking/E_HeaderView.hpp>
+#include <E/Networking/E_NetworkUtil.hpp>
+#include <E/Networking/E_Packet.hpp>
+
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <random>
+
+using namespace E;
+using Kernel = NetworkUtil::SumKernel;
+
+// one_sum as it was first written: a byte at a time, folded every time
+static uint16_t reference(const uint8_t *buffer, size_t size) {
+  uint32_t sum = 0;
+  for (size_t k = 0; k < size; k++) {
+    sum += k % 2 == 0 ? buffer[k] << 8 : buffer[k];
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return (uint16_t)sum;
+}
+
+static std::vector<Kernel> supported() {
+  std::vector<Kernel> kernels;
+  for (auto kernel : {Kernel::SCALAR, Kernel::SSE2, Kernel::AVX2})
+    if (NetworkUtil::sum_supported(kernel))
+      kernels.push_back(kernel);
+  return kernels;
+}
+
+TEST(TestChecksum, Kernels) {
+  EXPECT_TRUE(NetworkUtil::sum_supported(Kernel::SCALAR));
+  EXPECT_TRUE(NetworkUtil::sum_supported(NetworkUtil::sum_kernel()));
+
+  std::mt19937 random(341);
+  std::vector<uint8_t> bytes(9000 + 64);
+  for (auto &byte : bytes)
+    byte = (uint8_t)random();
+
+  // every length around the vector widths, at every alignment
+  for (size_t offset = 0; offset < 33; offset++)
+    for (size_t size = 0; size < 300; size++)
+      for (auto kernel : supported())
+        ASSERT_EQ(NetworkUtil::one_sum(&bytes[offset], size, kernel),
+                  reference(&bytes[offset], size))
+            << "kernel " << (int)kernel << " offset " << offset << " size "
+            << size;
+
+  for (size_t size : {576, 1500, 9000})
+    EXPECT_EQ(NetworkUtil::one_sum(&bytes[1], size),
+              reference(&bytes[1], size));
+}
+
+TEST(TestChecksum, Extremes) {
+  // a sum of 0xFFFF is not folded to zero, and nothing but zeros sums to zero
+  std::vector<uint8_t> ones(9000, 0xFF), zeros(9000, 0);
+  for (auto kernel : supported()) {
+    EXPECT_EQ(NetworkUtil::one_sum(ones.data(), ones.size(), kernel), 0xFFFF);
+    EXPECT_EQ(NetworkUtil::one_sum(ones.data(), 1, kernel), 0xFF00);
+    EXPECT_EQ(NetworkUtil::one_sum(zeros.data(), zeros.size(), kernel), 0);
+  }
+
+  // enough to overflow 32-bit lanes if they were never flushed
+  std::vector<uint8_t> large(1 << 22, 0xFF);
+  large[3] = 0x12;
+  for (auto kernel : supported())
+    EXPECT_EQ(NetworkUtil::one_sum(large.data(), large.size(), kernel),
+              reference(large.data(), large.size()));
+}
+
+TEST(TestChecksum, TCP) {
+  // SYN from 10.0.0.1:12345 to 10.0.0.2:80, with its checksum zeroed
+  uint8_t syn[20] = {0x30, 0x39, 0x00, 0x50, 0x01, 0x02, 0x03,
+                     0x04, 0x00, 0x00, 0x00, 0x00, 0x50, 0x02,
+                     0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00};
+  const uint32_t source = htonl(0x0A000001), dest = htonl(0x0A000002);
+  uint16_t checksum = ~NetworkUtil::tcp_sum(source, dest, syn, sizeof(syn));
+
+  const uint8_t pseudo[12] = {10, 0, 0, 1, 10, 0, 0, 2, 0, 6, 0, 20};
+  uint32_t sum = reference(pseudo, sizeof(pseudo));
+  sum += reference(syn, sizeof(syn));
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  EXPECT_EQ(checksum, (uint16_t)~sum);
+
+  syn[16] = checksum >> 8;
+  syn[17] = checksum & 0xFF;
+  EXPECT_EQ(NetworkUtil::tcp_sum(source, dest, syn, sizeof(syn)), 0xFFFF);
+  EXPECT_EQ(NetworkUtil::tcp_sum(source, dest, syn, 19), 0);
+}
+
+TEST(TestChecksum, Adjust) {
+  std::mt19937 random(1624);
+  std::vector<uint8_t> bytes(64);
+  for (int round = 0; round < 10000; round++) {
+    for (auto &byte : bytes)
+      byte = (uint8_t)random();
+    // sparse data reaches the corner cases of 0x0000 and 0xFFFF
+    if (round % 2)
+      for (auto &byte : bytes)
+        byte = random() % 4 == 0 ? byte : (round % 4 == 1 ? 0 : 0xFF);
+    const uint16_t sum = ~NetworkUtil::one_sum(bytes.data(), bytes.size());
+
+    const size_t offset = random() % 15 * 4;
+    if (round % 3) {
+      const uint16_t old_field = bytes[offset] << 8 | bytes[offset + 1];
+      const uint16_t new_field = round % 5 ? (uint16_t)random() : 0;
+      bytes[offset] = new_field >> 8;
+      bytes[offset + 1] = new_field & 0xFF;
+      EXPECT_EQ(NetworkUtil::checksum_adjust(sum, old_field, new_field),
+                (uint16_t)~NetworkUtil::one_sum(bytes.data(), bytes.size()));
+    } else {
+      const ConstTCPHeaderView view(&bytes[offset]);
+      const uint32_t old_field = view.sequence();
+      const uint32_t new_field = random();
+      TCPHeaderView(&bytes[offset]).setSequence(new_field);
+      EXPECT_EQ(NetworkUtil::checksum_adjust(sum, old_field, new_field),
+                (uint16_t)~NetworkUtil::one_sum(bytes.data(), bytes.size()));
+    }
+  }
+}
+
+TEST(TestChecksum, Write) {
+  const size_t ip_start = EthernetHeaderView::SIZE;
+  const size_t tcp_start = ip_start + IPv4HeaderView::SIZE;
+  Packet packet(tcp_start + TCPHeaderView::SIZE + 100);
+  IPv4HeaderView ip(packet, ip_start);
+  ip.setVersion(4);
+  ip.setHeaderLength(IPv4HeaderView::SIZE);
+  ip.setTotalLength(packet.getSize() - ip_start);
+  ip.setTimeToLive(64);
+  ip.setProtocol(IPv4HeaderView::TCP);
+  ip.setSource({10, 0, 0, 1});
+  ip.setDestination({10, 0, 0, 2});
+  ip.setChecksum(~NetworkUtil::one_sum(ip.data(), ip.SIZE));
+
+  uint32_t source, dest;
+  packet.readData(ip_start + 12, &source, 4);
+  packet.readData(ip_start + 16, &dest, 4);
+  auto segment = [&] {
+    return std::as_const(packet).accessData(tcp_start, 120);
+  };
+  TCPHeaderView(packet, tcp_start).setHeaderLength(TCPHeaderView::SIZE);
+  TCPHeaderView(packet, tcp_start)
+      .setChecksum(~NetworkUtil::tcp_sum(source, dest, segment(), 120));
+
+  // a shared copy keeps its bytes and checksums
+  const Packet copy = packet.clone();
+  const size_t tcp_sum = tcp_start + 16;
+  NetworkUtil::checksum_write(packet, tcp_sum, tcp_start + 4,
+                              (uint32_t)0x01020304);
+  NetworkUtil::checksum_write(packet, tcp_sum, tcp_start + 8,
+                              (uint32_t)0xFFFFFFFF);
+  NetworkUtil::checksum_write(packet, tcp_sum, tcp_start + 14,
+                              (uint16_t)0x1000);
+  // TTL is written along with the protocol
+  NetworkUtil::checksum_write(packet, ip_start + 10, ip_start + 8,
+                              (uint16_t)(63 << 8 | IPv4HeaderView::TCP));
+
+  ConstTCPHeaderView tcp(packet, tcp_start);
+  EXPECT_EQ(tcp.sequence(), 0x01020304u);
+  EXPECT_EQ(tcp.acknowledgement(), 0xFFFFFFFFu);
+  EXPECT_EQ(tcp.window(), 0x1000);
+  EXPECT_EQ(NetworkUtil::tcp_sum(source, dest, segment(), 120), 0xFFFF);
+  EXPECT_EQ(ConstIPv4HeaderView(packet, ip_start).timeToLive(), 63);
+  EXPECT_EQ(NetworkUtil::one_sum(
+                std::as_const(packet).accessData(ip_start, ip.SIZE), ip.SIZE),
+            0xFFFF);
+  EXPECT_EQ(ConstTCPHeaderView(copy, tcp_start).sequence(), 0u);
+}
+
+TEST(TestChecksum, WriteSegment) {
+  // a checksum in the buffer, covering a field in a segment
+  auto payload = std::make_shared<std::array<uint8_t, 8>>(
+      std::array<uint8_t, 8>{1, 2, 3, 4, 5, 6, 7, 8});
+  Packet packet(4);
+  packet.appendSegment(payload, payload->data(), payload->size());
+  uint8_t bytes[12];
+  packet.readData(0, bytes, sizeof(bytes));
+  const uint16_t sum = ~NetworkUtil::one_sum(bytes, sizeof(bytes));
+  const uint8_t stored[2] = {(uint8_t)(sum >> 8), (uint8_t)sum};
+  packet.writeData(0, stored, 2);
+
+  NetworkUtil::checksum_write(packet, 0, 8, (uint32_t)0xA0B0C0D0);
+  packet.readData(0, bytes, sizeof(bytes));
+  EXPECT_EQ(bytes[8], 0xA0);
+  EXPECT_EQ(bytes[11], 0xD0);
+  EXPECT_EQ(NetworkUtil::one_sum(bytes, sizeof(bytes)), 0xFFFF);
+  EXPECT_EQ((*payload)[4], 5); // the segment itself is not written
+
+  // a field beyond the packet is refused
+  EXPECT_DEBUG_DEATH(
+      NetworkUtil::checksum_write(packet, 0, 10, (uint32_t)1), "beyond");
+}
@@ -0,0 +1,80 @@
+/*
+ * testensemble.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_Ensemble.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+#include <E/Networking/E_Networking.hpp>
+#include <E/Networking/E_Switch.hpp>
+
+#include "station.hpp"
+#include <gtest/gtest.h>
+
+using namespace E;
+
+// A Station that checks it always runs in its own System.
+class Member : public Station {
+public:
+  bool sameSystem = true;
+
+  Member(NetworkSystem &system, uint8_t self, uint8_t peer)
+      : Station(system, self, peer), system(system) {}
+
+protected:
+  NetworkSystem &system;
+
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message) {
+    sameSystem &= System::getRunningSystem() == &system;
+    return Station::messageReceived(from, message);
+  }
+};
+
+class StationResult {
+public:
+  uint64_t digest;
+  bool sameSystem;
+};
+
+static StationResult simulate(uint64_t seed) {
+  NetworkSystem system;
+  system.setRandomSeed(seed);
+  auto hub = system.addModule<Switch>("Switch", system, true);
+  auto a = system.addModule<Member>(system, 1, 2);
+  auto b = system.addModule<Member>(system, 2, 1);
+  int portA = system.addWire(*a, *hub).second.second;
+  int portB = system.addWire(*b, *hub).second.second;
+  hub->addMACEntry(portA, {0xBC, 0, 0, 0, 0, 1});
+  hub->addMACEntry(portB, {0xBC, 0, 0, 0, 0, 2});
+  a->start(200, 1000);
+  b->start(200, 1000);
+  system.run(0);
+  return {a->digest * 31 + b->digest, a->sameSystem && b->sameSystem};
+}
+
+TEST(TestEnsemble, MatchesSeparateRuns) {
+  const size_t runs = 16;
+  Ensemble ensemble(4);
+  auto results = ensemble.run(runs, [](size_t index) -> std::any {
+    return simulate(1000 + index);
+  });
+
+  ASSERT_EQ(results.size(), runs);
+  std::set<uint64_t> digests;
+  std::set<size_t> workers;
+  for (size_t k = 0; k < runs; k++) {
+    EXPECT_EQ(results[k].index, k);
+    StationResult result = std::any_cast<StationResult>(results[k].value);
+    EXPECT_EQ(result.digest, simulate(1000 + k).digest);
+    EXPECT_TRUE(result.sameSystem);
+    EXPECT_GE(results[k].seconds, 0);
+    digests.insert(result.digest);
+    workers.insert(results[k].worker);
+  }
+  // the seeds matter, and the runs were spread over the pool
+  EXPECT_GT(digests.size(), 1);
+  EXPECT_GT(workers.size(), 1);
+  EXPECT_GT(ensemble.getSeconds(), 0);
+}
@@ -0,0 +1,171 @@
+/*
+ * testeventqueue.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_EventQueue.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace E;
+
+static void compareBackends(std::mt19937_64 &rng, size_t rounds,
+                            Time maxDelay) {
+  auto heap = EventQueue::create(EventQueueType::HEAP);
+  auto calendar = EventQueue::create(EventQueueType::CALENDAR);
+  std::uniform_int_distribution<Time> delay(0, maxDelay);
+  std::uniform_int_distribution<int> burst(0, 8);
+
+  Time now = 0;
+  UUID seq = 0;
+  std::vector<EventQueue::Entry> pending;
+  for (size_t k = 0; k < rounds; k++) {
+    // push a burst (often with identical wakeups), then pop some
+    int pushes = burst(rng);
+    Time shared = now + delay(rng);
+    for (int i = 0; i < pushes; i++) {
+      Time wakeup = (i % 2 == 0) ? shared : now + delay(rng);
+      heap->push({wakeup, seq, (uint32_t)seq});
+      calendar->push({wakeup, seq, (uint32_t)seq});
+      pending.push_back({wakeup, seq, (uint32_t)seq});
+      seq++;
+    }
+    // remove a random pending event now and then
+    if (!pending.empty() && burst(rng) == 0) {
+      std::uniform_int_distribution<size_t> pick(0, pending.size() - 1);
+      size_t k = pick(rng);
+      heap->remove(pending[k]);
+      calendar->remove(pending[k]);
+      pending[k] = pending.back();
+      pending.pop_back();
+    }
+    int pops = burst(rng);
+    for (int i = 0; i < pops && !heap->empty(); i++) {
+      ASSERT_EQ(heap->size(), calendar->size());
+      EventQueue::Entry a = heap->top();
+      EventQueue::Entry b = calendar->top();
+      ASSERT_EQ(a.wakeup, b.wakeup);
+      ASSERT_EQ(a.seq, b.seq);
+      heap->pop();
+      calendar->pop();
+      now = a.wakeup;
+      for (size_t j = 0; j < pending.size(); j++) {
+        if (pending[j].seq == a.seq) {
+          pending[j] = pending.back();
+          pending.pop_back();
+          break;
+        }
+      }
+    }
+  }
+  while (!heap->empty()) {
+    ASSERT_FALSE(calendar->empty());
+    ASSERT_EQ(heap->top().seq, calendar->top().seq);
+    heap->pop();
+    calendar->pop();
+  }
+  ASSERT_TRUE(calendar->empty());
+}
+
+TEST(TestEventQueue, CalendarMatchesHeap) {
+  std::mt19937_64 rng(1614233283);
+  compareBackends(rng, 20000, 1000);
+  compareBackends(rng, 20000, 100000000);
+  compareBackends(rng, 20000, 3);
+}
+
+TEST(TestEventQueue, CalendarSparse) {
+  // a few events years apart from each other force the direct search
+  auto calendar = EventQueue::create(EventQueueType::CALENDAR);
+  calendar->push({1000000000000UL, 2, 2});
+  calendar->push({5, 0, 0});
+  calendar->push({5, 1, 1});
+  calendar->push({70000000000UL, 3, 3});
+
+  std::vector<UUID> order;
+  while (!calendar->empty()) {
+    order.push_back(calendar->top().seq);
+    calendar->pop();
+  }
+  EXPECT_EQ(order, std::vector<UUID>({0, 1, 3, 2}));
+}
+
+class OrderModule : public Module {
+public:
+  std::vector<int> received;
+  std::vector<int> cancelled;
+  OrderModule(System &system) : Module(system) {}
+
+  UUID send(int tag, Time after) {
+    return sendMessageSelf(std::make_unique<Tag>(tag), after);
+  }
+  bool cancel(UUID handle) { return cancelMessage(handle); }
+
+protected:
+  class Tag : public Module::MessageBase {
+  public:
+    int tag;
+    Tag(int tag) : tag(tag) {}
+  };
+
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message) {
+    Tag &tag = dynamic_cast<Tag &>(message);
+    received.push_back(tag.tag);
+    if (tag.tag < 100) {
+      // ties created while dispatching follow the existing ones
+      send(tag.tag + 100, 0);
+    }
+    return nullptr;
+  }
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {}
+  virtual void messageCancelled(const ModuleID to, Module::Message message) {
+    cancelled.push_back(dynamic_cast<Tag &>(*message).tag);
+  }
+};
+
+class TestSystemOrder : public ::testing::TestWithParam<EventQueueType> {};
+
+TEST_P(TestSystemOrder, TotalOrdering) {
+  System system(GetParam());
+  auto module = system.addModule<OrderModule>(system);
+  module->send(1, 10);
+  module->send(2, 5);
+  module->send(3, 10);
+  module->send(4, 0);
+  system.run(0);
+
+  EXPECT_EQ(module->received,
+            std::vector<int>({4, 104, 2, 102, 1, 3, 101, 103}));
+}
+
+TEST_P(TestSystemOrder, Cancellation) {
+  System system(GetParam());
+  auto module = system.addModule<OrderModule>(system);
+  UUID a = module->send(1, 10);
+  UUID b = module->send(2, 20);
+  UUID c = module->send(3, 30);
+
+  // cancelled messages are handed back right away
+  EXPECT_TRUE(module->cancel(b));
+  EXPECT_EQ(module->cancelled, std::vector<int>({2}));
+  EXPECT_FALSE(module->cancel(b));
+
+  // the freed slot is reused, but the stale handle must not match it
+  UUID d = module->send(4, 5);
+  EXPECT_NE(b, d);
+  EXPECT_FALSE(module->cancel(b));
+
+  system.run(0);
+  EXPECT_EQ(module->received, std::vector<int>({4, 104, 1, 101, 3, 103}));
+  EXPECT_FALSE(module->cancel(a));
+  EXPECT_FALSE(module->cancel(c));
+  EXPECT_EQ(module->cancelled, std::vector<int>({2}));
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, TestSystemOrder,
+                         ::testing::Values(EventQueueType::HEAP,
+                                           EventQueueType::CALENDAR));
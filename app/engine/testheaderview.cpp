@@ -0,0 +1,109 @@
+/*
+ * testheaderview.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/Networking/E_HeaderView.hpp>
+#include <E/Networking/E_NetworkUtil.hpp>
+#include <E/Networking/E_Packet.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace E;
+using Bytes = std::vector<uint8_t>;
+
+static constexpr uint8_t SYN[20] = {0x30, 0x39, 0x00, 0x50, 0x01, 0x02, 0x03,
+                                    0x04, 0x00, 0x00, 0x00, 0x00, 0x50, 0x02,
+                                    0xFF, 0xFF, 0x12, 0x34, 0x00, 0x00};
+
+// fields are loaded at compile time when the bytes are constant
+static_assert(ConstTCPHeaderView(SYN).sourcePort() == 12345);
+static_assert(ConstTCPHeaderView(SYN).sequence() == 0x01020304);
+static_assert(ConstTCPHeaderView(SYN).headerLength() == 20);
+static_assert(ConstTCPHeaderView(SYN).flags() == TCPHeaderView::SYN);
+
+TEST(TestHeaderView, Frame) {
+  Packet packet(54);
+  const mac_t dst{0xBC, 0, 0, 0, 0, 2}, src{0xBC, 0, 0, 0, 0, 1};
+  EthernetHeaderView ethernet(packet, 0);
+  ethernet.setDestination(dst);
+  ethernet.setSource(src);
+  ethernet.setEtherType(EthernetHeaderView::IPV4);
+
+  IPv4HeaderView ip(packet, EthernetHeaderView::SIZE);
+  ip.setVersion(4);
+  ip.setHeaderLength(IPv4HeaderView::SIZE);
+  ip.setTotalLength(40);
+  ip.setTimeToLive(64);
+  ip.setProtocol(IPv4HeaderView::TCP);
+  ip.setSource({10, 0, 0, 1});
+  ip.setDestination({10, 0, 0, 2});
+  ip.setChecksum(~NetworkUtil::one_sum(ip.data(), ip.SIZE));
+
+  TCPHeaderView tcp(packet, EthernetHeaderView::SIZE + IPv4HeaderView::SIZE);
+  tcp.setSourcePort(12345);
+  tcp.setDestinationPort(80);
+  tcp.setSequence(0x01020304);
+  tcp.setHeaderLength(TCPHeaderView::SIZE);
+  tcp.setFlags(TCPHeaderView::SYN);
+  tcp.setWindow(0xFFFF);
+  tcp.setChecksum(0x1234);
+
+  // the views write the bytes in network order
+  Bytes bytes(packet.getSize());
+  packet.readData(0, bytes.data(), bytes.size());
+  EXPECT_EQ(Bytes(bytes.begin(), bytes.begin() + 14),
+            Bytes({0xBC, 0, 0, 0, 0, 2, 0xBC, 0, 0, 0, 0, 1, 0x08, 0x00}));
+  EXPECT_EQ(Bytes(bytes.begin() + 14, bytes.begin() + 18),
+            Bytes({0x45, 0x00, 0x00, 40}));
+  EXPECT_EQ(Bytes(bytes.begin() + 34, bytes.end()),
+            Bytes(std::begin(SYN), std::end(SYN)));
+
+  // and read them back, in a copy which shares the buffer
+  const Packet copy(packet);
+  ConstEthernetHeaderView readEthernet(copy, 0);
+  ConstIPv4HeaderView readIP(copy, 14);
+  EXPECT_EQ(readEthernet.destination(), dst);
+  EXPECT_EQ(readEthernet.source(), src);
+  EXPECT_EQ(readIP.version(), 4);
+  EXPECT_EQ(readIP.headerLength(), 20);
+  EXPECT_EQ(readIP.totalLength(), 40);
+  EXPECT_EQ(readIP.destination(), ipv4_t({10, 0, 0, 2}));
+  EXPECT_EQ(NetworkUtil::one_sum(readIP.data(), readIP.SIZE), 0xFFFF);
+  EXPECT_EQ(ConstTCPHeaderView(copy, 34).window(), 0xFFFF);
+  EXPECT_EQ(readIP.data(), ip.data());
+}
+
+TEST(TestHeaderView, UDP) {
+  Packet packet(8);
+  UDPHeaderView udp(packet, 0);
+  udp.setSourcePort(53);
+  udp.setDestinationPort(0xABCD);
+  udp.setLength(8);
+  udp.setChecksum(0xFFFF);
+  EXPECT_EQ(udp.sourcePort(), 53);
+  EXPECT_EQ(udp.destinationPort(), 0xABCD);
+  EXPECT_EQ(udp.length(), 8);
+  EXPECT_EQ(udp.checksum(), 0xFFFF);
+}
+
+TEST(TestHeaderView, Access) {
+  Packet packet(14);
+  const Packet &shared = packet;
+  Packet copy(packet);
+  EXPECT_EQ(shared.accessData(0, 14), std::as_const(copy).accessData(0, 14));
+  EXPECT_EQ(shared.accessData(0, 15), nullptr);
+
+  // a view which can write does not share the buffer any more
+  EthernetHeaderView(packet, 0).setEtherType(EthernetHeaderView::IPV6);
+  EXPECT_NE(shared.accessData(0, 14), std::as_const(copy).accessData(0, 14));
+  EXPECT_EQ(ConstEthernetHeaderView(std::as_const(copy), 0).etherType(), 0);
+
+  // a read-only view may point into a segment, but not across two
+  auto payload = std::make_shared<const Bytes>(Bytes(8, 1));
+  packet.appendSegment(payload, payload->data(), 8);
+  EXPECT_EQ(shared.accessData(14, 8), payload->data());
+  EXPECT_EQ(shared.accessData(12, 4), nullptr);
+  EXPECT_NE(packet.accessData(12, 4), nullptr);
+  EXPECT_EQ(packet.getSegmentCount(), 0);
+}
@@ -0,0 +1,154 @@
+/*
+ * testmessage.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+#include <E/Networking/E_Link.hpp>
+#include <E/Networking/E_Packet.hpp>
+#include <E/Networking/E_Wire.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace E;
+
+class Untagged : public Module::MessageBase {};
+
+TEST(TestMessage, Cast) {
+  Wire::Message wire(Wire::PACKET_TO_PORT, Packet(64));
+  Link::Message link(Link::CHECK_QUEUE, 7);
+  Untagged untagged;
+
+  EXPECT_EQ(wire.getTag(), Module::MessageTag::WIRE);
+  EXPECT_EQ(untagged.getTag(), Module::MessageTag::UNTAGGED);
+  EXPECT_EQ(Module::EmptyMessage::shared().getTag(),
+            Module::MessageTag::EMPTY);
+
+  EXPECT_EQ(Module::messageCast<Wire::Message>(wire), &wire);
+  EXPECT_EQ(Module::messageCast<Link::Message>(wire), nullptr);
+  EXPECT_EQ(Module::messageCast<Link::Message>(link)->wireID, 7);
+  EXPECT_EQ(Module::messageCast<Wire::Message>(untagged), nullptr);
+
+  // copies keep their tag
+  auto clone = wire.cloneMessage();
+  EXPECT_NE(Module::messageCast<Wire::Message>(*clone), nullptr);
+}
+
+TEST(TestMessage, Visit) {
+  std::vector<Module::Message> messages;
+  messages.push_back(
+      std::make_unique<Wire::Message>(Wire::PACKET_TO_PORT, Packet(64)));
+  messages.push_back(std::make_unique<Link::Message>(Link::CHECK_QUEUE, 3));
+  messages.push_back(std::make_unique<Untagged>());
+
+  std::vector<std::string> visited;
+  for (auto &message : messages) {
+    bool known = Module::visitMessage<Wire::Message, Link::Message>(
+        *message, [&](auto &typed) {
+          if constexpr (std::is_same_v<decltype(typed), Wire::Message &>)
+            visited.push_back("wire " +
+                              std::to_string(typed.packet.getSize()));
+          else
+            visited.push_back("link " + std::to_string(typed.wireID));
+        });
+    if (!known)
+      visited.push_back("unknown");
+  }
+  EXPECT_EQ(visited,
+            std::vector<std::string>({"wire 64", "link 3", "unknown"}));
+}
+
+class Large : public Module::MessageBase {
+public:
+  std::array<uint64_t, Module::MessageBase::MAX_POOLED / 8> words;
+};
+
+TEST(TestMessage, Pool) {
+  // a finished message leaves its memory to the next one of its size
+  Module::Message link = std::make_unique<Link::Message>(Link::CHECK_QUEUE, 3);
+  void *memory = link.get();
+  link = nullptr;
+  link = std::make_unique<Link::Message>(Link::CHECK_QUEUE, 4);
+  EXPECT_EQ(link.get(), memory);
+
+  std::vector<Module::Message> messages;
+  std::set<void *> addresses;
+  for (int k = 0; k < 100; k++) {
+    messages.push_back(std::make_unique<Link::Message>(Link::CHECK_QUEUE, k));
+    addresses.insert(messages.back().get());
+  }
+  EXPECT_EQ(addresses.size(), 100);
+  messages.clear();
+  for (int k = 0; k < 100; k++) {
+    messages.push_back(std::make_unique<Link::Message>(Link::CHECK_QUEUE, k));
+    EXPECT_EQ(addresses.count(messages.back().get()), 1);
+  }
+
+  // too large to be pooled, but allocated and freed all the same
+  auto large = std::make_unique<Large>();
+  large->words.fill(7);
+  EXPECT_EQ(large->words.back(), 7);
+}
+
+// Answers every message, one by one or in batches.
+class Responder : public Module {
+public:
+  int received = 0;
+  int responses = 0;
+
+  Responder(System &system, bool batched) : Module(system) {
+    setBatchDelivery(batched);
+  }
+
+protected:
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message) {
+    received++;
+    return std::make_unique<Untagged>();
+  }
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {
+    responses++;
+  }
+};
+
+// Counts what comes back from the sends and posts.
+class Poster : public Module {
+public:
+  int finished = 0;
+  int cancelled = 0;
+
+  Poster(System &system) : Module(system) {}
+
+  void start(ModuleID to) {
+    sendMessage(to, std::make_unique<Untagged>(), 10);
+    for (int k = 0; k < 5; k++)
+      postMessage(to, std::make_unique<Untagged>(), 10);
+    cancelMessage(postMessage(to, std::make_unique<Untagged>(), 10));
+  }
+
+protected:
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {
+    finished++;
+  }
+  virtual void messageCancelled(const ModuleID to, Module::Message message) {
+    cancelled++;
+  }
+};
+
+TEST(TestMessage, OneWay) {
+  for (bool batched : {false, true}) {
+    System system;
+    auto poster = system.addModule<Poster>(system);
+    auto responder = system.addModule<Responder>(system, batched);
+    poster->start(2);
+    system.run(0);
+
+    EXPECT_EQ(responder->received, 6);
+    EXPECT_EQ(responder->responses, 6); // the responses are still finished
+    EXPECT_EQ(poster->finished, 1);     // only the message sent
+    EXPECT_EQ(poster->cancelled, 1);
+  }
+}
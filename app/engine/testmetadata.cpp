@@ -0,0 +1,113 @@
+/*
+ * testmetadata.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_System.hpp>
+#include <E/Networking/E_HeaderView.hpp>
+#include <E/Networking/E_Host.hpp>
+#include <E/Networking/E_NetworkUtil.hpp>
+#include <E/Networking/E_Networking.hpp>
+#include <E/Networking/E_Packet.hpp>
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+using namespace E;
+
+static Packet frame(uint16_t type, uint8_t protocol, bool valid) {
+  Packet packet(64);
+  EthernetHeaderView(packet, 0).setEtherType(type);
+  IPv4HeaderView ip(packet, 14);
+  ip.setVersion(4);
+  ip.setHeaderLength(IPv4HeaderView::SIZE);
+  ip.setProtocol(protocol);
+  ip.setSource({10, 0, 0, 1});
+  ip.setDestination({10, 0, 0, 2});
+  ip.setChecksum(~NetworkUtil::one_sum(ip.data(), ip.SIZE) + !valid);
+  TCPHeaderView tcp(packet, 34);
+  tcp.setSourcePort(1000);
+  tcp.setDestinationPort(80);
+  tcp.setHeaderLength(24); // with options, for TCP
+  return packet;
+}
+
+// Keeps the metadata of every frame, as the Ethernet of its Host.
+class Recorder : public HostModule {
+public:
+  Recorder(Host &host, std::vector<Packet::Metadata> &received)
+      : HostModule("Ethernet", host), received(received) {}
+
+protected:
+  std::vector<Packet::Metadata> &received;
+
+  virtual void packetArrived(std::string fromModule, Packet &&packet) {
+    received.push_back(packet.getMetadata());
+  }
+};
+
+TEST(TestMetadata, Ingress) {
+  NetworkSystem system;
+  auto a = system.addModule<Host>("A", system);
+  auto b = system.addModule<Host>("B", system);
+  auto c = system.addModule<Host>("C", system);
+  std::vector<Packet::Metadata> received;
+  b->addHostModule<Recorder>(*b, received);
+  system.addWire(*b, *c);
+  system.addWire(*a, *b); // port 1 of B
+
+  a->sendPacket(0, frame(EthernetHeaderView::IPV4, IPv4HeaderView::TCP, true));
+  a->sendPacket(0, frame(EthernetHeaderView::IPV4, IPv4HeaderView::UDP, false));
+  a->sendPacket(0, frame(EthernetHeaderView::IPV6, IPv4HeaderView::TCP, true));
+  a->sendPacket(0, frame(EthernetHeaderView::IPV4, IPv4HeaderView::TCP, true));
+  system.run(0);
+  ASSERT_EQ(received.size(), 4);
+
+  const Packet::Metadata &tcp = received[0];
+  EXPECT_EQ(tcp.port, 1);
+  EXPECT_EQ(tcp.networkOffset, 14);
+  EXPECT_EQ(tcp.transportOffset, 34);
+  EXPECT_EQ(tcp.payloadOffset, 58);
+  EXPECT_EQ(tcp.protocol, IPv4HeaderView::TCP);
+  EXPECT_TRUE(tcp.checksumVerified);
+
+  const Packet::Metadata &udp = received[1];
+  EXPECT_EQ(udp.transportOffset, 34);
+  EXPECT_EQ(udp.payloadOffset, 42);
+  EXPECT_FALSE(udp.checksumVerified);
+  EXPECT_NE(udp.flowHash, tcp.flowHash);
+
+  const Packet::Metadata &other = received[2];
+  EXPECT_EQ(other.port, 1);
+  EXPECT_EQ(other.networkOffset, Packet::Metadata::UNPARSED);
+  EXPECT_EQ(other.transportOffset, Packet::Metadata::UNPARSED);
+
+  // a flow always hashes the same
+  EXPECT_EQ(received[3].flowHash, tcp.flowHash);
+}
+
+TEST(TestMetadata, Carried) {
+  Packet packet(64);
+  packet.getMetadata().networkOffset = 14;
+  packet.getMetadata().checksumVerified = true;
+  packet.getMetadata().flowHash = 7;
+
+  Packet copy(packet);
+  Packet clone = packet.clone();
+  EXPECT_EQ(copy.getMetadata().networkOffset, 14);
+  EXPECT_EQ(clone.getMetadata().flowHash, 7);
+
+  std::stringstream stream;
+  packet.writePacket(stream);
+  Packet restored = Packet::readPacket(stream);
+  EXPECT_EQ(restored.getMetadata().networkOffset, 14);
+  EXPECT_TRUE(restored.getMetadata().checksumVerified);
+  EXPECT_EQ(restored.getMetadata().flowHash, 7);
+
+  // the offsets move with the data, so they are forgotten
+  copy.pull(14);
+  EXPECT_EQ(copy.getMetadata().networkOffset, Packet::Metadata::UNPARSED);
+  EXPECT_EQ(copy.getMetadata().flowHash, 7);
+  EXPECT_EQ(packet.getMetadata().networkOffset, 14);
+}
@@ -0,0 +1,189 @@
+/*
+ * testoffload.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_System.hpp>
+#include <E/Networking/E_HeaderView.hpp>
+#include <E/Networking/E_Host.hpp>
+#include <E/Networking/E_NetworkUtil.hpp>
+#include <E/Networking/E_Networking.hpp>
+#include <E/Networking/E_Packet.hpp>
+#include <E/Networking/E_Switch.hpp>
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+
+using namespace E;
+using Offload = Host::ChecksumOffload;
+
+static const size_t IP_START = EthernetHeaderView::SIZE;
+static const size_t TCP_START = IP_START + IPv4HeaderView::SIZE;
+static const size_t FRAME_SIZE = TCP_START + TCPHeaderView::SIZE + 100;
+
+// A TCP segment from A to B, its checksums left to the port.
+static Packet partial() {
+  Packet packet(FRAME_SIZE);
+  EthernetHeaderView ethernet(packet, 0);
+  ethernet.setDestination({0xBC, 0, 0, 0, 0, 2});
+  ethernet.setSource({0xBC, 0, 0, 0, 0, 1});
+  ethernet.setEtherType(EthernetHeaderView::IPV4);
+  IPv4HeaderView ip(packet, IP_START);
+  ip.setVersion(4);
+  ip.setHeaderLength(IPv4HeaderView::SIZE);
+  ip.setTotalLength(FRAME_SIZE - IP_START);
+  ip.setTimeToLive(64);
+  ip.setProtocol(IPv4HeaderView::TCP);
+  ip.setSource({10, 0, 0, 1});
+  ip.setDestination({10, 0, 0, 2});
+  TCPHeaderView tcp(packet, TCP_START);
+  tcp.setSourcePort(1000);
+  tcp.setDestinationPort(80);
+  tcp.setSequence(0x01020304);
+  tcp.setHeaderLength(TCPHeaderView::SIZE);
+  tcp.setFlags(TCPHeaderView::ACK);
+  for (size_t k = TCP_START + TCPHeaderView::SIZE; k < FRAME_SIZE; k++)
+    *packet.accessData(k, 1) = (uint8_t)k;
+  packet.getMetadata().checksumPartial = true;
+  return packet;
+}
+
+// Whether both checksums of a frame as in partial() are valid.
+static bool valid(const uint8_t *frame) {
+  uint32_t source, dest;
+  memcpy(&source, frame + IP_START + 12, sizeof(source));
+  memcpy(&dest, frame + IP_START + 16, sizeof(dest));
+  return NetworkUtil::one_sum(frame + IP_START, IPv4HeaderView::SIZE) ==
+             0xFFFF &&
+         NetworkUtil::tcp_sum(source, dest, frame + TCP_START,
+                              FRAME_SIZE - TCP_START) == 0xFFFF;
+}
+
+static bool valid(const Packet &packet) {
+  return valid(packet.accessData(0, FRAME_SIZE));
+}
+
+// Keeps every frame, as the Ethernet of its Host.
+class Receiver : public HostModule {
+public:
+  Receiver(Host &host, std::vector<Packet> &received)
+      : HostModule("Ethernet", host), received(received) {}
+
+protected:
+  std::vector<Packet> &received;
+
+  virtual void packetArrived(std::string fromModule, Packet &&packet) {
+    received.push_back(std::move(packet));
+  }
+};
+
+// Sends partial() from A to B through a switch, with the given offloads.
+static std::vector<Packet> send(Offload sender, Offload receiver,
+                                bool unreliable = false,
+                                const std::string &pcap = "") {
+  NetworkSystem system;
+  auto hub = system.addModule<Switch>("Switch", system, unreliable);
+  auto a = system.addModule<Host>("A", system);
+  auto b = system.addModule<Host>("B", system);
+  std::vector<Packet> received;
+  b->addHostModule<Receiver>(*b, received);
+  int portA = system.addWire(*a, *hub).second.second;
+  int portB = system.addWire(*b, *hub).second.second;
+  hub->addMACEntry(portA, {0xBC, 0, 0, 0, 0, 1});
+  hub->addMACEntry(portB, {0xBC, 0, 0, 0, 0, 2});
+  if (!pcap.empty())
+    hub->enablePCAPLogging(pcap);
+  a->setChecksumOffload(0, sender);
+  b->setChecksumOffload(0, receiver);
+
+  a->sendPacket(0, partial());
+  system.run(1000000000);
+  return received;
+}
+
+TEST(TestOffload, Ports) {
+  NetworkSystem system;
+  auto a = system.addModule<Host>("A", system);
+  auto b = system.addModule<Host>("B", system);
+  system.addWire(*a, *b);
+  system.addWire(*a, *b);
+  EXPECT_FALSE(a->getChecksumOffload(0).transmit);
+  EXPECT_FALSE(a->getChecksumOffload(1).receive);
+
+  a->setChecksumOffload(1, {true, false});
+  EXPECT_FALSE(a->getChecksumOffload(0).transmit);
+  EXPECT_TRUE(a->getChecksumOffload(1).transmit);
+  EXPECT_FALSE(a->getChecksumOffload(1).receive);
+}
+
+TEST(TestOffload, Both) {
+  auto received = send({true, true}, {true, true});
+  ASSERT_EQ(received.size(), 1);
+  const Packet &packet = received[0];
+
+  // nobody had to compute the checksums
+  EXPECT_TRUE(packet.getMetadata().checksumPartial);
+  EXPECT_TRUE(packet.getMetadata().checksumVerified);
+  EXPECT_TRUE(packet.getMetadata().transportChecksumVerified);
+  EXPECT_EQ(ConstTCPHeaderView(packet, TCP_START).checksum(), 0);
+  EXPECT_FALSE(valid(packet));
+}
+
+TEST(TestOffload, Software) {
+  // without transmit offload, the sending Host computes the checksums
+  auto received = send({false, false}, {true, true});
+  ASSERT_EQ(received.size(), 1);
+  EXPECT_FALSE(received[0].getMetadata().checksumPartial);
+  EXPECT_TRUE(received[0].getMetadata().transportChecksumVerified);
+  EXPECT_TRUE(valid(received[0]));
+
+  // without receive offload, the receiving Host computes them for the stack
+  received = send({true, true}, {false, false});
+  ASSERT_EQ(received.size(), 1);
+  EXPECT_FALSE(received[0].getMetadata().checksumPartial);
+  EXPECT_TRUE(received[0].getMetadata().checksumVerified);
+  EXPECT_FALSE(received[0].getMetadata().transportChecksumVerified);
+  EXPECT_TRUE(valid(received[0]));
+}
+
+TEST(TestOffload, Capture) {
+  const std::string pcap = testing::TempDir() + "testoffload.pcap";
+  auto received = send({true, true}, {true, true}, false, pcap);
+  ASSERT_EQ(received.size(), 1);
+  EXPECT_TRUE(received[0].getMetadata().checksumPartial);
+
+  // the capture has the checksums the port would have sent
+  std::ifstream file(pcap, std::ifstream::binary);
+  std::vector<char> bytes((std::istreambuf_iterator<char>(file)),
+                          std::istreambuf_iterator<char>());
+  const size_t header = 24, record = 16;
+  ASSERT_EQ(bytes.size(), header + record + FRAME_SIZE);
+  EXPECT_TRUE(valid((const uint8_t *)&bytes[header + record]));
+  std::remove(pcap.c_str());
+}
+
+TEST(TestOffload, Corrupted) {
+  // an unreliable switch corrupts the first frame; the flag must tell
+  auto received = send({true, true}, {true, true}, true);
+  ASSERT_EQ(received.size(), 1);
+  EXPECT_FALSE(received[0].getMetadata().checksumPartial);
+  EXPECT_FALSE(received[0].getMetadata().transportChecksumVerified);
+  EXPECT_FALSE(valid(received[0]));
+}
+
+TEST(TestOffload, Checkpoint) {
+  Packet packet = partial();
+  packet.getMetadata().transportChecksumVerified = true;
+  std::stringstream stream;
+  packet.writePacket(stream);
+  Packet restored = Packet::readPacket(stream);
+  EXPECT_TRUE(restored.getMetadata().checksumPartial);
+  EXPECT_TRUE(restored.getMetadata().transportChecksumVerified);
+
+  NetworkUtil::checksum_finalize(restored);
+  EXPECT_FALSE(restored.getMetadata().checksumPartial);
+  EXPECT_TRUE(valid(restored));
+  EXPECT_FALSE(valid(packet));
+}
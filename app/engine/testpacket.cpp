@@ -0,0 +1,231 @@
+/*
+ * testpacket.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/Networking/E_Packet.hpp>
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+using namespace E;
+using Bytes = std::vector<uint8_t>;
+
+static Bytes contents(const Packet &packet) {
+  Bytes bytes(packet.getSize());
+  packet.readData(0, bytes.data(), bytes.size());
+  return bytes;
+}
+
+TEST(TestPacket, CopyOnWrite) {
+  Packet original(8);
+  uint8_t one = 1, two = 2, three = 3;
+  original.writeData(0, &one, 1);
+
+  // copies and clones see the same contents until one of them writes
+  Packet copy(original);
+  Packet clone = original.clone();
+  Packet assigned(4);
+  assigned = original;
+  EXPECT_EQ(contents(copy), contents(original));
+  EXPECT_EQ(contents(clone), contents(original));
+  EXPECT_EQ(contents(assigned), contents(original));
+
+  copy.writeData(1, &two, 1);
+  clone.writeData(2, &three, 1);
+  EXPECT_EQ(contents(original), Bytes({1, 0, 0, 0, 0, 0, 0, 0}));
+  EXPECT_EQ(contents(copy), Bytes({1, 2, 0, 0, 0, 0, 0, 0}));
+  EXPECT_EQ(contents(clone), Bytes({1, 0, 3, 0, 0, 0, 0, 0}));
+  EXPECT_EQ(contents(assigned), contents(original));
+
+  // a writer gets its own copy while the buffer is still shared
+  original.writeData(3, &three, 1);
+  EXPECT_EQ(contents(assigned), Bytes({1, 0, 0, 0, 0, 0, 0, 0}));
+  assigned = Packet(0);
+  original.writeData(4, &three, 1);
+  EXPECT_EQ(contents(original), Bytes({1, 0, 0, 3, 3, 0, 0, 0}));
+
+  // sizes are per packet
+  copy.setSize(2);
+  EXPECT_EQ(copy.getSize(), 2);
+  EXPECT_EQ(original.getSize(), 8);
+}
+
+TEST(TestPacket, Move) {
+  Packet packet(8);
+  uint8_t one = 1;
+  packet.writeData(0, &one, 1);
+
+  Packet moved(std::move(packet));
+  EXPECT_EQ(packet.getSize(), 0);
+  EXPECT_EQ(packet.writeData(0, &one, 1), 0);
+  EXPECT_EQ(contents(moved)[0], 1);
+
+  Packet assigned(2);
+  assigned = std::move(moved);
+  EXPECT_EQ(moved.getSize(), 0);
+  EXPECT_EQ(contents(assigned)[0], 1);
+}
+
+TEST(TestPacket, Checkpoint) {
+  Packet packet(8);
+  uint8_t one = 1;
+  packet.writeData(7, &one, 1);
+  Packet shared(packet);
+  shared.setSize(4);
+
+  std::stringstream stream;
+  shared.writePacket(stream);
+  Packet restored = Packet::readPacket(stream);
+  EXPECT_EQ(restored.getSize(), 4);
+  EXPECT_EQ(restored.setSize(8), 8);
+  EXPECT_EQ(contents(restored), contents(packet));
+}
+
+TEST(TestPacket, Headroom) {
+  Packet packet(4, 6);
+  uint8_t payload[4] = {1, 2, 3, 4}, header[2] = {9, 9};
+  packet.writeData(0, payload, 4);
+  EXPECT_EQ(packet.getHeadroom(), 6);
+  EXPECT_EQ(packet.getTailroom(), 0);
+
+  // headers go in front, and offsets follow the start of the data
+  packet.push(2);
+  packet.writeData(0, header, 2);
+  EXPECT_EQ(packet.getHeadroom(), 4);
+  EXPECT_EQ(contents(packet), Bytes({9, 9, 1, 2, 3, 4}));
+  EXPECT_EQ(packet.pull(2), 2);
+  EXPECT_EQ(contents(packet), Bytes({1, 2, 3, 4}));
+
+  // a shared buffer keeps the view of each packet
+  Packet copy(packet);
+  copy.push(1);
+  copy.writeData(0, header, 1);
+  EXPECT_EQ(contents(copy), Bytes({9, 1, 2, 3, 4}));
+  EXPECT_EQ(contents(packet), Bytes({1, 2, 3, 4}));
+
+  // more than the headroom reallocates
+  packet.push(8);
+  EXPECT_EQ(packet.getHeadroom(), 0);
+  EXPECT_EQ(packet.getSize(), 12);
+  EXPECT_EQ(packet.pull(8), 8);
+  EXPECT_EQ(contents(packet), Bytes({1, 2, 3, 4}));
+  EXPECT_EQ(packet.pull(8), 4);
+  EXPECT_EQ(packet.getSize(), 0);
+}
+
+TEST(TestPacket, Tailroom) {
+  Packet packet(4);
+  uint8_t one = 1, two = 2;
+  packet.writeData(3, &one, 1);
+  EXPECT_EQ(packet.trim(2), 2);
+  EXPECT_EQ(packet.getTailroom(), 2);
+  EXPECT_EQ(packet.setSize(8), 4);
+
+  packet.put(6);
+  EXPECT_EQ(packet.getSize(), 10);
+  EXPECT_EQ(packet.getTailroom(), 0);
+  packet.writeData(9, &two, 1);
+  EXPECT_EQ(contents(packet), Bytes({0, 0, 0, 1, 0, 0, 0, 0, 0, 2}));
+  EXPECT_EQ(packet.trim(20), 10);
+  EXPECT_EQ(packet.getTailroom(), 10);
+
+  // the headroom survives a checkpoint
+  Packet framed(2, 4);
+  framed.push(1);
+  framed.writeData(0, &two, 1);
+  std::stringstream stream;
+  framed.writePacket(stream);
+  Packet restored = Packet::readPacket(stream);
+  EXPECT_EQ(restored.getHeadroom(), 3);
+  EXPECT_EQ(contents(restored), Bytes({2, 0, 0}));
+}
+
+TEST(TestPacket, Slab) {
+  std::vector<uint8_t> sevens(1514, 7);
+  for (size_t size : {54, 1514, 9000, 20000}) {
+    // a recycled buffer is zeroed again for an ordinary packet
+    {
+      Packet dirty(size);
+      dirty.writeData(0, sevens.data(), std::min(size, sevens.size()));
+    }
+    Packet packet(size);
+    EXPECT_EQ(contents(packet), Bytes(size, 0));
+
+    Packet raw = Packet::uninitialized(size, 14);
+    EXPECT_EQ(raw.getSize(), size);
+    EXPECT_EQ(raw.getHeadroom(), 14);
+    Bytes written(size, 3);
+    EXPECT_EQ(raw.writeData(0, written.data(), size), size);
+    EXPECT_EQ(contents(raw), written);
+  }
+}
+
+TEST(TestPacket, Segments) {
+  auto payload = std::make_shared<const Bytes>(Bytes({1, 2, 3, 4, 5, 6}));
+  Packet packet(2);
+  uint8_t header[2] = {9, 9};
+  packet.writeData(0, header, 2);
+  packet.appendSegment(payload, payload->data() + 1, 3);
+  packet.appendSegment(payload, payload->data() + 4, 2);
+  EXPECT_EQ(packet.getSize(), 7);
+  EXPECT_EQ(packet.getSegmentCount(), 2);
+  EXPECT_EQ(contents(packet), Bytes({9, 9, 2, 3, 4, 5, 6}));
+
+  // reads gather across the segments
+  Bytes middle(4);
+  EXPECT_EQ(packet.readData(3, middle.data(), 10), 4);
+  EXPECT_EQ(middle, Bytes({3, 4, 5, 6}));
+  std::stringstream stream;
+  EXPECT_EQ(packet.readData(1, stream, 3), 3);
+  EXPECT_EQ(stream.str(), std::string("\x09\x02\x03"));
+
+  // sizes cut through the segments, which copies share
+  Packet copy(packet);
+  EXPECT_EQ(copy.trim(1), 1);
+  EXPECT_EQ(copy.setSize(4), 4);
+  EXPECT_EQ(copy.getSegmentCount(), 1);
+  EXPECT_EQ(copy.setSize(10), 4);
+  EXPECT_EQ(contents(copy), Bytes({9, 9, 2, 3}));
+  EXPECT_EQ(contents(packet), Bytes({9, 9, 2, 3, 4, 5, 6}));
+
+  // nor do segments appended to a copy, or a header pushed in front
+  Packet longer(packet);
+  longer.appendSegment(payload, payload->data(), 1);
+  longer.push(1);
+  EXPECT_EQ(longer.getSegmentCount(), 3);
+  EXPECT_EQ(contents(longer), Bytes({0, 9, 9, 2, 3, 4, 5, 6, 1}));
+  EXPECT_EQ(packet.getSegmentCount(), 2);
+  EXPECT_EQ(contents(packet), Bytes({9, 9, 2, 3, 4, 5, 6}));
+
+  // a write into a segment copies the payload, which stays unchanged
+  uint8_t seven = 7;
+  EXPECT_EQ(packet.writeData(5, &seven, 1), 1);
+  EXPECT_EQ(packet.getSegmentCount(), 0);
+  EXPECT_EQ(contents(packet), Bytes({9, 9, 2, 3, 4, 7, 6}));
+  EXPECT_EQ(*payload, Bytes({1, 2, 3, 4, 5, 6}));
+
+  // a checkpoint holds the bytes, not the references
+  Packet framed(1);
+  framed.appendSegment(payload, payload->data(), 2);
+  std::stringstream checkpoint;
+  framed.writePacket(checkpoint);
+  Packet restored = Packet::readPacket(checkpoint);
+  EXPECT_EQ(restored.getSegmentCount(), 0);
+  EXPECT_EQ(contents(restored), Bytes({0, 1, 2}));
+}
+
+TEST(TestPacket, Truncates) {
+  Packet packet(8);
+  uint8_t ones[4] = {1, 1, 1, 1};
+  packet.setSize(4);
+  EXPECT_EQ(packet.writeData(2, ones, 4), 2);
+  Bytes read(4, 7);
+  EXPECT_EQ(packet.readData(2, read.data(), 4), 2);
+  EXPECT_EQ(read, Bytes({1, 1, 7, 7}));
+
+  // nothing is written beyond the size
+  packet.setSize(8);
+  EXPECT_EQ(contents(packet), Bytes({0, 0, 1, 1, 0, 0, 0, 0}));
+}
@@ -0,0 +1,196 @@
+/*
+ * testpacketbatch.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_System.hpp>
+#include <E/Networking/E_Host.hpp>
+#include <E/Networking/E_Networking.hpp>
+#include <E/Networking/E_Packet.hpp>
+#include <E/Networking/E_PacketBatch.hpp>
+#include <E/Networking/E_Switch.hpp>
+
+#include <fstream>
+#include <gtest/gtest.h>
+
+using namespace E;
+
+static Packet frame(uint8_t index) {
+  Packet packet(1000);
+  mac_t dst{0xBC, 0, 0, 0, 0, 2};
+  mac_t src{0xBC, 0, 0, 0, 0, 1};
+  packet.writeData(0, dst.data(), 6);
+  packet.writeData(6, src.data(), 6);
+  packet.writeData(14, &index, 1);
+  return packet;
+}
+
+class Arrival {
+public:
+  Time time;
+  std::vector<uint8_t> indices;
+
+  bool operator==(const Arrival &other) const {
+    return time == other.time && indices == other.indices;
+  }
+};
+
+// Keeps every delivery, of a packet or a batch, as the Ethernet of its Host.
+class Tap : public HostModule {
+public:
+  Tap(Host &host, std::vector<Arrival> &arrivals)
+      : HostModule("Ethernet", host), arrivals(arrivals) {}
+
+protected:
+  std::vector<Arrival> &arrivals;
+
+  virtual void packetArrived(std::string fromModule, Packet &&packet) {
+    arrivals.push_back({getCurrentTime(), {index(packet)}});
+  }
+  virtual void packetsArrived(std::string fromModule, PacketBatch &&batch) {
+    arrivals.push_back({getCurrentTime(), {}});
+    for (const Packet &packet : batch)
+      arrivals.back().indices.push_back(index(packet));
+  }
+  virtual bool writeCheckpoint(std::ostream &out) { return true; }
+  virtual void readCheckpoint(std::istream &in) {}
+
+  static uint8_t index(const Packet &packet) {
+    uint8_t index;
+    packet.readData(14, &index, 1);
+    return index;
+  }
+};
+
+class Hosts {
+public:
+  NetworkSystem system;
+  std::shared_ptr<Host> a;
+  std::shared_ptr<Host> b;
+  std::shared_ptr<Wire> wire;
+  std::shared_ptr<Switch> hub;
+  std::vector<Arrival> arrivals;
+
+  Hosts(bool switched) {
+    // the same packets are evicted from full queues in every run
+    system.setRandomSeed(1614233283);
+    a = system.addModule<Host>("A", system);
+    b = system.addModule<Host>("B", system);
+    b->addHostModule<Tap>(*b, arrivals);
+    if (!switched) {
+      wire = system.addWire(*a, *b).first;
+      return;
+    }
+    hub = system.addModule<Switch>("Switch", system);
+    system.addWire(*a, *hub);
+    int portB = system.addWire(*b, *hub).second.second;
+    hub->addMACEntry(portB, {0xBC, 0, 0, 0, 0, 2});
+  }
+
+  void sendBatch(uint8_t count) {
+    PacketBatch batch;
+    for (uint8_t k = 0; k < count; k++)
+      batch.add(frame(k));
+    a->sendPacket(0, std::move(batch));
+  }
+};
+
+TEST(TestPacketBatch, Wire) {
+  Hosts single(false);
+  for (uint8_t k = 0; k < 8; k++)
+    single.a->sendPacket(0, frame(k));
+  single.system.run(0);
+  ASSERT_EQ(single.arrivals.size(), 8);
+  EXPECT_GT(single.arrivals.back().time, single.arrivals.front().time);
+
+  // serialized one after another, and each delivered as it would be alone
+  Hosts batched(false);
+  batched.sendBatch(8);
+  batched.system.run(0);
+  EXPECT_EQ(batched.arrivals, single.arrivals);
+}
+
+TEST(TestPacketBatch, WireWithoutSpeedLimit) {
+  // every packet arrives after the propagation delay, so all at once
+  Hosts batched(false);
+  batched.wire->setSpeedLimit(false);
+  batched.sendBatch(8);
+  batched.system.run(0);
+  ASSERT_EQ(batched.arrivals.size(), 1);
+  EXPECT_EQ(batched.arrivals[0].indices,
+            std::vector<uint8_t>({0, 1, 2, 3, 4, 5, 6, 7}));
+}
+
+TEST(TestPacketBatch, Switch) {
+  // a Link forwards the packets of a batch through its queue, one by one
+  Hosts network(true);
+  network.sendBatch(8);
+  network.system.run(0);
+  ASSERT_EQ(network.arrivals.size(), 8);
+  for (uint8_t k = 0; k < 8; k++) {
+    EXPECT_EQ(network.arrivals[k].indices, std::vector<uint8_t>({k}));
+    if (k > 0)
+      EXPECT_GT(network.arrivals[k].time, network.arrivals[k - 1].time);
+  }
+}
+
+static std::string readFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+TEST(TestPacketBatch, LinkQueue) {
+  // a slower output port with a short queue drops some of the burst, the
+  // same ones whether the burst comes as a batch or packet by packet
+  const std::string singlePath = ::testing::TempDir() + "single.pcap";
+  const std::string batchedPath = ::testing::TempDir() + "batched.pcap";
+  std::vector<Arrival> expected;
+  std::vector<Arrival> actual;
+  {
+    Hosts single(true);
+    single.hub->setLinkSpeed(400000000);
+    single.hub->setQueueSize(3);
+    single.hub->enablePCAPLogging(singlePath);
+    for (uint8_t k = 0; k < 32; k++)
+      single.a->sendPacket(0, frame(k));
+    single.system.run(0);
+    expected = single.arrivals;
+
+    Hosts batched(true);
+    batched.hub->setLinkSpeed(400000000);
+    batched.hub->setQueueSize(3);
+    batched.hub->enablePCAPLogging(batchedPath);
+    batched.sendBatch(32);
+    batched.system.run(0);
+    actual = batched.arrivals;
+  }
+
+  EXPECT_GT(expected.size(), 3);
+  EXPECT_LT(expected.size(), 32);
+  EXPECT_EQ(actual, expected);
+  EXPECT_EQ(readFile(batchedPath), readFile(singlePath));
+  std::remove(singlePath.c_str());
+  std::remove(batchedPath.c_str());
+}
+
+TEST(TestPacketBatch, Checkpoint) {
+  const std::string path = ::testing::TempDir() + "testpacketbatch.ckpt";
+
+  Hosts reference(false);
+  reference.sendBatch(4);
+  reference.system.run(0);
+  ASSERT_EQ(reference.arrivals.size(), 4);
+
+  // the batch is on the wire when checkpointed
+  Hosts warm(false);
+  warm.sendBatch(4);
+  warm.system.run(1);
+  ASSERT_TRUE(warm.system.checkpoint(path));
+  EXPECT_TRUE(warm.arrivals.empty());
+
+  Hosts fork(false);
+  ASSERT_TRUE(fork.system.restore(path));
+  fork.system.run(0);
+  EXPECT_EQ(fork.arrivals, reference.arrivals);
+  std::remove(path.c_str());
+}
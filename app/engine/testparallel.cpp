@@ -0,0 +1,225 @@
+/*
+ * testparallel.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+#include <E/Networking/E_Networking.hpp>
+#include <E/Networking/E_Packet.hpp>
+#include <E/Networking/E_Wire.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace E;
+
+// Forwards packets to random ports, with timers that tie and get cancelled.
+class Relay : public NetworkModule {
+public:
+  std::vector<std::tuple<Time, uint64_t, int>> trace;
+  std::set<std::thread::id> threads;
+
+  Relay(NetworkSystem &system, uint64_t seed)
+      : NetworkModule(system), rng(seed) {}
+
+  void start(int packets) {
+    for (int k = 0; k < packets; k++)
+      sendMessageSelf(std::make_unique<Tick>(k), k * 1000);
+  }
+
+protected:
+  class Tick : public Module::MessageBase {
+  public:
+    int tag;
+    Tick(int tag) : tag(tag) {}
+    std::unique_ptr<Module::MessageBase> cloneMessage() const override {
+      return std::make_unique<Tick>(tag);
+    }
+  };
+
+  class State {
+  public:
+    size_t traced;
+    std::mt19937_64 rng;
+    UUID timeout;
+  };
+
+  std::mt19937_64 rng;
+  UUID timeout = 0;
+
+  void forward(uint64_t value) {
+    if (ports.empty() || value % 7 == 0)
+      return;
+    Packet packet(64);
+    packet.writeData(0, &value, sizeof(value));
+    sendMessage(ports[rng() % ports.size()],
+                std::make_unique<Wire::Message>(Wire::PACKET_TO_PORT,
+                                                std::move(packet)),
+                rng() % 3 == 0 ? 0 : rng() % 5000);
+  }
+
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message) {
+    threads.insert(std::this_thread::get_id());
+    if (typeid(message) == typeid(Tick &)) {
+      Tick &tick = dynamic_cast<Tick &>(message);
+      trace.push_back({getCurrentTime(), 0, tick.tag});
+      if (tick.tag < 1000)
+        forward(rng());
+      return nullptr;
+    }
+
+    Wire::Message &wire = dynamic_cast<Wire::Message &>(message);
+    uint64_t value;
+    wire.packet.readData(0, &value, sizeof(value));
+    trace.push_back({getCurrentTime(), value, -1});
+
+    // a retransmission timer re-armed on every packet, and a tie
+    cancelMessage(timeout);
+    timeout = sendMessageSelf(std::make_unique<Tick>(1000), 50000);
+    sendMessageSelf(std::make_unique<Tick>(2000), 0);
+    forward(value * 31 + rng() % 4);
+    return nullptr;
+  }
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {}
+  virtual void messageCancelled(const ModuleID to, Module::Message message) {
+    trace.push_back({getCurrentTime(), 0, -2});
+  }
+
+  virtual std::any saveState(const ModuleID from) {
+    return State{trace.size(), rng, timeout};
+  }
+  virtual void restoreState(const ModuleID from, std::any &&state) {
+    State &saved = std::any_cast<State &>(state);
+    trace.resize(saved.traced);
+    rng = saved.rng;
+    timeout = saved.timeout;
+  }
+};
+
+class TestParallel : public ::testing::TestWithParam<size_t> {
+protected:
+  // a ring with chords; wires have different propagation delays
+  static std::vector<std::vector<std::tuple<Time, uint64_t, int>>>
+  simulate(size_t threads, std::set<std::thread::id> &threadIDs,
+           Time optimism = 0, Size *rolledBack = nullptr,
+           EventQueueType queueType = EventQueueType::HEAP) {
+    NetworkSystem system(queueType);
+    system.setParallelism(threads);
+    system.setOptimism(optimism);
+
+    const size_t count = 12;
+    std::vector<std::shared_ptr<Relay>> relays;
+    for (size_t k = 0; k < count; k++)
+      relays.push_back(system.addModule<Relay>(system, 1614233283 + k));
+    for (size_t k = 0; k < count; k++) {
+      system.addWire(*relays[k], *relays[(k + 1) % count], 10000 + k * 1000,
+                     1000000000UL);
+      if (k % 3 == 0)
+        system.addWire(*relays[k], *relays[(k + 5) % count], 20000, 0, false);
+    }
+    for (auto &relay : relays)
+      relay->start(20);
+
+    system.run(1000000000UL);
+    system.run(0);
+
+    std::vector<std::vector<std::tuple<Time, uint64_t, int>>> traces;
+    for (auto &relay : relays) {
+      traces.push_back(relay->trace);
+      threadIDs.insert(relay->threads.begin(), relay->threads.end());
+    }
+    if (rolledBack)
+      *rolledBack = system.getParallelStatistics().rolledBack;
+    return traces;
+  }
+};
+
+TEST_P(TestParallel, MatchesSequential) {
+  std::set<std::thread::id> sequentialThreads;
+  std::set<std::thread::id> parallelThreads;
+  auto expected = simulate(1, sequentialThreads);
+  auto actual = simulate(GetParam(), parallelThreads);
+
+  EXPECT_EQ(sequentialThreads.size(), 1);
+  EXPECT_EQ(parallelThreads.size(), GetParam());
+  ASSERT_EQ(expected.size(), actual.size());
+  size_t events = 0;
+  for (size_t k = 0; k < expected.size(); k++) {
+    EXPECT_EQ(expected[k], actual[k]);
+    events += expected[k].size();
+  }
+  EXPECT_GT(events, 1000);
+}
+
+TEST_P(TestParallel, OptimisticMatchesSequential) {
+  std::set<std::thread::id> sequentialThreads;
+  std::set<std::thread::id> parallelThreads;
+  Size rolledBack = 0;
+  auto expected = simulate(1, sequentialThreads);
+  // rollbacks put events back into the past of the calendar queue
+  auto actual = simulate(GetParam(), parallelThreads, 200000, &rolledBack,
+                         EventQueueType::CALENDAR);
+
+  EXPECT_EQ(parallelThreads.size(), GetParam());
+  EXPECT_GT(rolledBack, 0);
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t k = 0; k < expected.size(); k++)
+    EXPECT_EQ(expected[k], actual[k]);
+}
+
+INSTANTIATE_TEST_SUITE_P(Threads, TestParallel, ::testing::Values(2, 3, 4));
+
+// Two modules in their own partitions, closer than the lookahead claims.
+class Shortcut : public System {
+public:
+  class Hasty : public Module {
+  public:
+    ModuleID peer = 0;
+    Hasty(System &system) : Module(system) {}
+    void start() { sendMessageSelf(std::make_unique<EmptyMessage>(), 0); }
+
+  protected:
+    virtual Module::Message messageReceived(const ModuleID from,
+                                            Module::MessageBase &message) {
+      sendMessage(peer, std::make_unique<EmptyMessage>(), 10);
+      return nullptr;
+    }
+    virtual void messageFinished(const ModuleID to, Module::Message message,
+                                 Module::MessageBase &response) {}
+    virtual void messageCancelled(const ModuleID to, Module::Message message) {
+    }
+  };
+
+  std::shared_ptr<Hasty> first, second;
+
+  Shortcut() {
+    first = addModule<Hasty>(*this);
+    second = addModule<Hasty>(*this);
+    first->peer = lookupModuleID(*second);
+    second->peer = lookupModuleID(*first);
+  }
+
+protected:
+  virtual Partitioning partition(size_t partitions) {
+    Partitioning partitioning;
+    partitioning.count = 2;
+    partitioning.lookahead = 1000;
+    partitioning.partitionOf[lookupModuleID(*first)] = 0;
+    partitioning.partitionOf[lookupModuleID(*second)] = 1;
+    return partitioning;
+  }
+};
+
+TEST(TestParallelLookahead, ShortDelayAborts) {
+  // not a debug death: release builds must not deliver into the past
+  EXPECT_DEATH(
+      {
+        Shortcut system;
+        system.setParallelism(2);
+        system.first->start();
+        system.run(100000);
+      },
+      "shorter than the lookahead");
+}
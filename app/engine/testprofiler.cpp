@@ -0,0 +1,110 @@
+/*
+ * testprofiler.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_Profiler.hpp>
+#include <E/E_System.hpp>
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+
+using namespace E;
+
+class Ping : public Module::MessageBase {};
+class Pong : public Module::MessageBase {};
+
+// Answers every Ping with a Pong.
+class Echo : public Module {
+public:
+  Echo(System &system, bool batched) : Module(system) {
+    setBatchDelivery(batched);
+  }
+
+protected:
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message) {
+    return std::make_unique<Pong>();
+  }
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {}
+};
+
+// Sends Pings, and cancels some of them.
+class Client : public Module {
+public:
+  Client(System &system) : Module(system) {}
+
+  void start(ModuleID to, int count, int cancelled) {
+    for (int k = 0; k < count; k++) {
+      UUID id = sendMessage(to, std::make_unique<Ping>(), 10 + k % 4);
+      if (k < cancelled)
+        cancelMessage(id);
+    }
+  }
+
+protected:
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {}
+  virtual void messageCancelled(const ModuleID to, Module::Message message) {}
+};
+
+static void countCalls(bool batched) {
+  const std::string path = ::testing::TempDir() + "testprofiler.json";
+  std::remove(path.c_str());
+
+  System system;
+  system.setProfiling(path);
+  auto client = system.addModule<Client>(system);
+  auto echo = system.addModule<Echo>(system, batched);
+  client->start(2, 100, 10);
+  system.run(0);
+  client->start(2, 50, 0);
+  system.run(0);
+
+  const Profiler *profiler = system.getProfiler();
+  ASSERT_NE(profiler, nullptr);
+  EXPECT_EQ(profiler->getRuns(), 2);
+  EXPECT_EQ(profiler->getEvents(), 140);
+  EXPECT_GT(profiler->getMaxDepth(), 0);
+  EXPECT_FALSE(profiler->getSamples().empty());
+
+  Profiler::Counter ping = profiler->getCounter(2, typeid(Ping));
+  EXPECT_EQ(ping.calls[Profiler::RECEIVED], 140);
+  EXPECT_EQ(ping.calls[Profiler::FINISHED], 0);
+  Profiler::Counter sent = profiler->getCounter(1, typeid(Ping));
+  EXPECT_EQ(sent.calls[Profiler::RECEIVED], 0);
+  EXPECT_EQ(sent.calls[Profiler::FINISHED], 140);
+  EXPECT_EQ(sent.calls[Profiler::CANCELLED], 10);
+  Profiler::Counter pong = profiler->getCounter(2, typeid(Pong));
+  EXPECT_EQ(pong.calls[Profiler::FINISHED], 140);
+
+  std::ifstream file(path);
+  ASSERT_TRUE(file.good());
+  std::stringstream json;
+  json << file.rdbuf();
+  EXPECT_NE(json.str().find("\"runs\": 2"), std::string::npos);
+  EXPECT_NE(json.str().find("\"events\": 140"), std::string::npos);
+  EXPECT_NE(json.str().find("\"id\": 1"), std::string::npos);
+  EXPECT_NE(json.str().find("\"id\": 2"), std::string::npos);
+  std::remove(path.c_str());
+}
+
+TEST(TestProfiler, CountsCalls) { countCalls(false); }
+
+TEST(TestProfiler, CountsBatchedCalls) { countCalls(true); }
+
+TEST(TestProfiler, Disabled) {
+  System system;
+  EXPECT_EQ(system.getProfiler(), nullptr);
+  system.setProfiling(::testing::TempDir() + "testprofiler.json");
+  system.setProfiling("");
+  auto client = system.addModule<Client>(system);
+  auto echo = system.addModule<Echo>(system, false);
+  client->start(2, 10, 0);
+  system.run(0);
+  EXPECT_EQ(system.getProfiler(), nullptr);
+}
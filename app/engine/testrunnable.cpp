@@ -0,0 +1,127 @@
+/*
+ * testrunnable.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+#include <E/E_System.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace E;
+
+class Sleeper;
+
+// Wakes Runnables up after a delay, like a blocking system call would.
+class Clock : public Module {
+public:
+  Clock(System &system) : Module(system), system(system) {}
+
+  std::vector<std::shared_ptr<Sleeper>> sleepers;
+
+  void sleep(size_t index, Time delay) {
+    sendMessageSelf(std::make_unique<Alarm>(index), delay);
+  }
+
+protected:
+  class Alarm : public Module::MessageBase {
+  public:
+    size_t index;
+    Alarm(size_t index) : index(index) {}
+  };
+
+  System &system;
+
+  virtual Module::Message messageReceived(const ModuleID from,
+                                          Module::MessageBase &message);
+  virtual void messageFinished(const ModuleID to, Module::Message message,
+                               Module::MessageBase &response) {}
+  virtual void messageCancelled(const ModuleID to, Module::Message message) {}
+};
+
+class Sleeper : public Runnable {
+public:
+  Sleeper(RunnableType type, Clock &clock, size_t index,
+          std::vector<std::pair<Time, size_t>> &trace)
+      : Runnable(type), clock(clock), index(index), trace(trace) {}
+
+  void wakeUp() { ready(); }
+  size_t depth = 0;
+  size_t steps = 0;
+
+protected:
+  Clock &clock;
+  size_t index;
+  std::vector<std::pair<Time, size_t>> &trace;
+
+  // uses some stack, so a fiber that is switched out keeps its frames
+  size_t recurse(size_t level) {
+    volatile char buffer[1024];
+    buffer[0] = (char)level;
+    if (level == 0) {
+      clock.sleep(index, (index * 7 + steps++) % 13);
+      wait();
+      return buffer[0];
+    }
+    return recurse(level - 1) + buffer[0];
+  }
+
+  virtual void main() {
+    for (size_t k = 0; k < 20; k++) {
+      trace.push_back({clock.getCurrentTime(), index});
+      depth += recurse(k % 8);
+    }
+  }
+};
+
+Module::Message Clock::messageReceived(const ModuleID from,
+                                       Module::MessageBase &message) {
+  Alarm &alarm = dynamic_cast<Alarm &>(message);
+  sleepers[alarm.index]->wakeUp();
+  system.addRunnable(sleepers[alarm.index]);
+  return nullptr;
+}
+
+static std::vector<std::pair<Time, size_t>> simulate(RunnableType type,
+                                                     size_t count,
+                                                     size_t &depth) {
+  std::vector<std::pair<Time, size_t>> trace;
+  System system;
+  system.setRunnableType(type);
+  auto clock = system.addModule<Clock>(system);
+  for (size_t k = 0; k < count; k++)
+    clock->sleepers.push_back(
+        std::make_shared<Sleeper>(type, *clock, k, trace));
+  for (auto &sleeper : clock->sleepers) {
+    sleeper->start();
+    system.addRunnable(sleeper);
+  }
+  system.run(0);
+
+  depth = 0;
+  for (auto &sleeper : clock->sleepers)
+    depth += sleeper->depth;
+  clock->sleepers.clear();
+  // Runnables made ready together are woken in no particular order
+  std::sort(trace.begin(), trace.end());
+  return trace;
+}
+
+TEST(TestRunnable, FiberMatchesThread) {
+  size_t threadDepth, fiberDepth;
+  auto expected = simulate(RunnableType::THREAD, 50, threadDepth);
+  auto actual = simulate(RunnableType::FIBER, 50, fiberDepth);
+  EXPECT_EQ(expected.size(), 50 * 20);
+  EXPECT_EQ(expected, actual);
+  EXPECT_EQ(threadDepth, fiberDepth);
+}
+
+TEST(TestRunnable, ManyFibers) {
+  // far more than we would like to have OS threads for
+  size_t depth;
+  auto trace = simulate(RunnableType::FIBER, 2000, depth);
+  EXPECT_EQ(trace.size(), 2000 * 20);
+  // stacks are recycled by the next System
+  trace = simulate(RunnableType::FIBER, 2000, depth);
+  EXPECT_EQ(trace.size(), 2000 * 20);
+}
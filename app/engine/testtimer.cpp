@@ -0,0 +1,170 @@
+/*
+ * testtimer.cpp
+ */
+
+#include <E/E_Common.hpp>
+#include <E/E_System.hpp>
+#include <E/Networking/E_Host.hpp>
+#include <E/Networking/E_Networking.hpp>
+#include <E/Networking/E_TimerModule.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace E;
+
+class Plan {
+public:
+  std::vector<std::pair<Time, Time>> timers; // timeAfter, slack
+  std::set<size_t> cancelled;                // indices into timers
+  std::vector<std::pair<size_t, Time>> rung; // index, time
+};
+
+// Arms the timers of a Plan when initialized.
+class Alarm : public HostModule, public TimerModule {
+public:
+  Alarm(Host &host, Plan &plan)
+      : HostModule("Alarm", host), TimerModule("Alarm", host), plan(plan) {}
+
+  virtual void initialize() {
+    std::vector<UUID> ids;
+    for (size_t k = 0; k < plan.timers.size(); k++)
+      ids.push_back(addTimer(k, plan.timers[k].first, plan.timers[k].second));
+    for (size_t k : plan.cancelled)
+      cancelTimer(ids[k]);
+  }
+
+protected:
+  Plan &plan;
+
+  virtual void packetArrived(std::string fromModule, Packet &&packet) {}
+  virtual void timerCallback(std::any payload) {
+    plan.rung.push_back(
+        {std::any_cast<size_t>(payload), HostModule::getCurrentTime()});
+  }
+};
+
+static void ring(Plan &plan) {
+  NetworkSystem system;
+  auto host = system.addModule<Host>("Host", system);
+  host->addHostModule<Alarm>(*host, plan);
+  host->initializeHostModule("Alarm");
+  system.run(0);
+}
+
+static std::set<Time> ringTimes(const Plan &plan) {
+  std::set<Time> times;
+  for (auto &[index, time] : plan.rung)
+    times.insert(time);
+  return times;
+}
+
+TEST(TestTimer, Coalesces) {
+  Plan plan;
+  for (Time k = 0; k < 100; k++)
+    plan.timers.push_back({1000 + k * 10, 500});
+  ring(plan);
+
+  ASSERT_EQ(plan.rung.size(), 100);
+  for (size_t k = 0; k < plan.rung.size(); k++) {
+    auto [index, time] = plan.rung[k];
+    EXPECT_EQ(index, k); // in the order of their deadlines
+    EXPECT_GE(time, plan.timers[index].first);
+    EXPECT_LE(time, plan.timers[index].first + plan.timers[index].second);
+  }
+  // 1000 to 1500 ring at 1500, and 1510 to 1990 at 2010
+  EXPECT_EQ(ringTimes(plan), std::set<Time>({1500, 2010}));
+}
+
+TEST(TestTimer, WithoutSlack) {
+  Plan plan;
+  for (Time k = 0; k < 100; k++)
+    plan.timers.push_back({1000 + k * 10, 0});
+  ring(plan);
+
+  ASSERT_EQ(plan.rung.size(), 100);
+  for (auto &[index, time] : plan.rung)
+    EXPECT_EQ(time, plan.timers[index].first);
+  EXPECT_EQ(ringTimes(plan).size(), 100);
+}
+
+TEST(TestTimer, Cancels) {
+  Plan plan;
+  for (Time k = 0; k < 100; k++)
+    plan.timers.push_back({1000 + k * 10, 500});
+  plan.timers.push_back({1000, 0});
+  // every timer rung at 1500, and some of those at 2010
+  for (size_t k = 0; k <= 50; k++)
+    plan.cancelled.insert(k);
+  plan.cancelled.insert(60);
+  plan.cancelled.insert(100);
+  ring(plan);
+
+  std::vector<size_t> rung;
+  for (auto &[index, time] : plan.rung)
+    rung.push_back(index);
+  std::vector<size_t> expected;
+  for (size_t k = 51; k < 100; k++)
+    if (k != 60)
+      expected.push_back(k);
+  EXPECT_EQ(rung, expected);
+  EXPECT_EQ(ringTimes(plan), std::set<Time>({2010}));
+}
+
+class Rings {
+public:
+  std::vector<Time> self;
+  std::vector<Time> endless;
+};
+
+// Rings every 100, every 300 from the third ring on, and stops itself after
+// the sixth. diagnose changes the period of a second, endless timer.
+class Metronome : public HostModule, public TimerModule {
+public:
+  Metronome(Host &host, Rings &rings)
+      : HostModule("Metronome", host), TimerModule("Metronome", host),
+        rings(rings) {}
+
+  virtual void initialize() {
+    self = addPeriodicTimer(1, 100);
+    endless = addPeriodicTimer(2, 1000);
+  }
+
+  virtual std::any diagnose(std::any param) {
+    modifyPeriodicTimer(endless, std::any_cast<Time>(param));
+    return 0;
+  }
+
+protected:
+  Rings &rings;
+  UUID self;
+  UUID endless;
+
+  virtual void packetArrived(std::string fromModule, Packet &&packet) {}
+  virtual void timerCallback(std::any payload) {
+    if (std::any_cast<int>(payload) == 2) {
+      rings.endless.push_back(HostModule::getCurrentTime());
+      return;
+    }
+    rings.self.push_back(HostModule::getCurrentTime());
+    if (rings.self.size() == 3)
+      modifyPeriodicTimer(self, 300);
+    if (rings.self.size() == 6)
+      cancelTimer(self);
+  }
+};
+
+TEST(TestTimer, Periodic) {
+  Rings rings;
+  NetworkSystem system;
+  auto host = system.addModule<Host>("Host", system);
+  host->addHostModule<Metronome>(*host, rings);
+  host->initializeHostModule("Metronome");
+  system.run(2500);
+  // from the last event, at 2000
+  host->diagnoseHostModule("Metronome", (Time)150);
+  system.run(3000);
+
+  EXPECT_EQ(rings.self, std::vector<Time>({100, 200, 300, 600, 900, 1200}));
+  EXPECT_EQ(rings.endless, std::vector<Time>({1000, 2000, 2150, 2300, 2450,
+                                              2600, 2750, 2900}));
+}
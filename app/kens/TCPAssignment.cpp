@@ -172,7 +172,7 @@ void TCPAssignment::syscall_accept(UUID syscallUUID, int pid, int fd, sockaddr*
     tp->fd = fd;
     tp->accept_addrPtr = addrPtr;
     tp->accept_addrLenPtr = addrLenPtr;
-    this->addTimer(tp, 100000000U);
+    this->addTimer(tp, 100000000U, 10000000U);
     return;
   }
 
@@ -272,7 +272,7 @@ void TCPAssignment::syscall_read(UUID syscallUUID, int pid, int fd, void* start,
     tp->fd = fd;
     tp->read_start = start;
     tp->read_len = len;
-    this->addTimer(tp, 100000000U);
+    this->addTimer(tp, 100000000U, 10000000U);
     return;
   }
   uint32_t available = s->readEnd - s->readStart;
@@ -57,6 +57,12 @@ protected:
     printf("[RANDOM_SEED : %d RUN_SOLUTION : %d UNRELIABLE : %d]\n", seed,
            run_solution, unreliable);
   }
+
+  // applications run as fibers instead of threads if FIBER is set
+  static void setup_system(NetworkSystem &system) {
+    if (std::getenv("FIBER"))
+      system.setRunnableType(RunnableType::FIBER);
+  }
 };
 
 template <class Target> class TestEnv1 : public KensTesting {
@@ -68,6 +74,7 @@ protected:
 
   virtual void SetUp() {
     setup_env();
+    setup_system(netSystem);
 
     host1 = netSystem.addModule<Host>("TestHost1", netSystem);
     host2 = netSystem.addModule<Host>("TestHost2", netSystem);
@@ -162,6 +169,7 @@ protected:
 
   virtual void SetUp() {
     setup_env();
+    setup_system(netSystem);
 
     host1 = netSystem.addModule<Host>("TestHost1", netSystem);
     host2 = netSystem.addModule<Host>("TestHost2", netSystem);
@@ -260,14 +268,15 @@ protected:
   static constexpr int num_client = CLIENTS;
   Size port_speed = 10000000;
   Time propagationDelay = TimeUtil::makeTime(10, TimeUtil::MSEC);
-  uint64_t prev_log;
 
   virtual void SetUp() {
 
     setup_env();
+    setup_system(netSystem);
 
-    prev_log = NetworkLog::defaultLevel;
-    NetworkLog::defaultLevel |= (
+    netSystem.setNetworkLogLevel(
+        netSystem.getNetworkLogLevel() |
+        (
         //(1 << NetworkLog::SYSCALL_RAISED) |
         //(1 << NetworkLog::SYSCALL_FINISHED) |
         //(1 << NetworkLog::PACKET_ALLOC) |
@@ -279,7 +288,7 @@ protected:
         //(1 << NetworkLog::PACKET_FROM_HOST) |
         //(1 << NetworkLog::PACKET_QUEUE) |
         //(1 << NetworkLog::TCP_LOG) |
-        0UL);
+        0UL));
 
     server_host = netSystem.addModule<Host>("CongestionServer", netSystem);
     switchingHub = netSystem.addModule<Switch>("Switch1", netSystem);
@@ -342,7 +351,7 @@ protected:
     file_name.append(".pcap");
     switchingHub->enablePCAPLogging(file_name, 64);
   }
-  virtual void TearDown() { NetworkLog::defaultLevel = prev_log; }
+  virtual void TearDown() {}
 
   void runTest() {
     netSystem.run(TimeUtil::makeTime(TIMEOUT, TimeUtil::SEC));
@@ -3,6 +3,7 @@
  *
  */
 
+#include <E/E_Checkpoint.hpp>
 #include <E/E_Common.hpp>
 #include <E/Networking/E_Host.hpp>
 #include <E/Networking/E_NetworkUtil.hpp>
@@ -57,6 +58,22 @@ int RoutingTable::writeToPacket(char* dst, size_t entryCount){
   return count;
 }
 
+void RoutingTable::writeCheckpoint(std::ostream &out){
+  Checkpoint::write(out, (uint64_t)table.size());
+  for(auto &entry : table){
+    Checkpoint::write(out, entry.first);
+    Checkpoint::write(out, entry.second);
+  }
+}
+
+void RoutingTable::readCheckpoint(std::istream &in){
+  table.clear();
+  for(uint64_t k = Checkpoint::read<uint64_t>(in); k > 0; k--){
+    unsigned int ip = Checkpoint::read<unsigned int>(in);
+    table[ip] = Checkpoint::read<int>(in);
+  }
+}
+
 RoutingAssignment::RoutingAssignment(Host &host)
     : HostModule("UDP", host), RoutingInfoInterface(host),
       TimerModule("UDP", host) {}
@@ -129,7 +146,7 @@ void RoutingAssignment::initialize() {
     }
   }
 
-  this->addTimer(this, 10000000000U);
+  this->addPeriodicTimer(this, 10000000000U);
 
 }
 
@@ -298,8 +315,23 @@ void RoutingAssignment::timerCallback(std::any payload) {
       this->sendPacket("IPv4", std::move(mypacket));
     }
   }
+}
+
+bool RoutingAssignment::writeCheckpoint(std::ostream &out) {
+  routingTable.writeCheckpoint(out);
+  return true;
+}
 
-  this->addTimer(this, 10000000000U);
+void RoutingAssignment::readCheckpoint(std::istream &in) {
+  routingTable.readCheckpoint(in);
 }
 
+// the only timer is the periodic broadcast, whose payload is this module
+bool RoutingAssignment::writeTimerPayload(const std::any &payload,
+                                          std::ostream &out) {
+  return std::any_cast<RoutingAssignment *>(payload) == this;
+}
+
+std::any RoutingAssignment::readTimerPayload(std::istream &in) { return this; }
+
 } // namespace E
\ No newline at end of file
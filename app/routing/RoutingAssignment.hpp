@@ -76,6 +76,8 @@ public:
   int getMetric(unsigned int ip);
   int size();//returns the number of entries in this routing table.
   int writeToPacket(char* dst, size_t entryCount);
+  void writeCheckpoint(std::ostream &out);
+  void readCheckpoint(std::istream &in);
 };
 
 class RoutingAssignment : public HostModule,
@@ -119,6 +121,13 @@ protected:
     return ripQuery(ip);
   }
   virtual void packetArrived(std::string fromModule, Packet &&packet) final;
+
+  // see System::checkpoint
+  virtual bool writeCheckpoint(std::ostream &out) final;
+  virtual void readCheckpoint(std::istream &in) final;
+  virtual bool writeTimerPayload(const std::any &payload,
+                                 std::ostream &out) final;
+  virtual std::any readTimerPayload(std::istream &in) final;
 };
 
 } // namespace E
@@ -37,6 +37,18 @@ protected:
     srand(seed);
     RecordProperty("random_seed", seed);
     printf("[RANDOM_SEED : %d]\n", seed);
+
+    const char *parallel = std::getenv("PARALLEL");
+    if (parallel) {
+      netSystem.setParallelism(atoi(parallel));
+    }
+    const char *optimism = std::getenv("OPTIMISM");
+    if (optimism) {
+      netSystem.setOptimism(strtoull(optimism, nullptr, 10));
+    }
+    if (std::getenv("FIBER")) {
+      netSystem.setRunnableType(RunnableType::FIBER);
+    }
   }
 
   NetworkSystem netSystem;
@@ -0,0 +1,51 @@
+/**
+ * @file   E_Checkpoint.hpp
+ * @brief  Header for E::Checkpoint
+ */
+
+#ifndef E_CHECKPOINT_HPP_
+#define E_CHECKPOINT_HPP_
+
+#include <E/E_Common.hpp>
+
+#include <sstream>
+
+namespace E {
+
+/**
+ * @brief Checkpoint has the helpers used to write the state of a System and
+ * its modules to a checkpoint, and to read it back.
+ *
+ * Values are stored in the byte order of the machine, so a checkpoint is
+ * restored on the same kind of machine it was taken on.
+ *
+ * @see System::checkpoint, Module::writeCheckpoint
+ */
+class Checkpoint {
+public:
+  /**
+   * @brief Write a value which can be copied byte by byte (no pointers).
+   */
+  template <typename T> static void write(std::ostream &out, const T &value) {
+    static_assert(std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>);
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  /**
+   * @brief Write a string (or any block of bytes), preceded by its length.
+   */
+  static void write(std::ostream &out, const std::string &value);
+
+  template <typename T> static T read(std::istream &in) {
+    static_assert(std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>);
+    T value;
+    in.read(reinterpret_cast<char *>(&value), sizeof(T));
+    return value;
+  }
+
+  static std::string readString(std::istream &in);
+};
+
+} // namespace E
+
+#endif /* E_CHECKPOINT_HPP_ */
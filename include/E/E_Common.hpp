@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <any>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cinttypes>
 #include <cmath>
@@ -23,6 +24,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <list>
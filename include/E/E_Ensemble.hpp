@@ -0,0 +1,71 @@
+/**
+ * @file   E_Ensemble.hpp
+ * @brief  Header for E::Ensemble
+ */
+
+#ifndef E_ENSEMBLE_HPP_
+#define E_ENSEMBLE_HPP_
+
+#include <E/E_Common.hpp>
+
+namespace E {
+
+/**
+ * @brief Ensemble runs many independent simulations side by side on a pool of
+ * threads, e.g. a sweep over random seeds, queue sizes or link speeds.
+ *
+ * Each run builds, configures and runs its own System (usually a
+ * NetworkSystem) in the given function. Systems do not share any state, so a
+ * run only has to avoid process-wide state of its own, such as rand() (see
+ * System::setRandomSeed) or a pcap file name used by another run.
+ *
+ * @see System
+ */
+class Ensemble {
+public:
+  /**
+   * @brief Outcome of a single run.
+   */
+  class Result {
+  public:
+    size_t index;   ///< index of the run
+    std::any value; ///< returned by the run
+    Real seconds;   ///< wall-clock time of the run
+    size_t worker;  ///< thread of the pool that executed the run
+  };
+
+  /**
+   * @brief A single run. It is given its index among the runs.
+   */
+  using Run = std::function<std::any(size_t index)>;
+
+  /**
+   * @param threads Size of the thread pool. 0 uses every hardware thread.
+   */
+  Ensemble(size_t threads = 0);
+
+  /**
+   * @brief Execute the runs and wait for all of them.
+   *
+   * @param count Number of runs.
+   * @param run Function executing a run. It is called concurrently.
+   *
+   * @return Results ordered by index, whichever order the runs finished in.
+   */
+  std::vector<Result> run(size_t count, const Run &run);
+
+  /**
+   * @return Wall-clock time of the last Ensemble::run.
+   */
+  Real getSeconds();
+
+  size_t getThreadCount();
+
+private:
+  size_t threads;
+  Real seconds;
+};
+
+} // namespace E
+
+#endif /* E_ENSEMBLE_HPP_ */
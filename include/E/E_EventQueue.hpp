@@ -0,0 +1,149 @@
+/**
+ * @file   E_EventQueue.hpp
+ * @brief  Header for E::EventQueue and its backends
+ */
+
+#ifndef E_EVENTQUEUE_HPP_
+#define E_EVENTQUEUE_HPP_
+
+#include <E/E_Common.hpp>
+
+namespace E {
+
+/**
+ * @brief Pending event queue backends usable by System.
+ *
+ * @see System::System
+ */
+enum class EventQueueType {
+  HEAP,     ///< Indexed 4-ary heap. O(log n) insert, dispatch and removal.
+  CALENDAR, ///< Calendar queue. O(1) amortized insert and dispatch.
+};
+
+/**
+ * @brief EventQueue keeps pending events of a System ordered by
+ * (wakeup, seq). Every backend must produce exactly the same dispatch order.
+ *
+ * @see HeapEventQueue, CalendarEventQueue
+ */
+class EventQueue {
+public:
+  class Entry {
+  public:
+    Time wakeup;
+    UUID seq;      ///< Sequence number of the send. Breaks wakeup ties.
+    uint32_t slot; ///< Event slot in the System. Not part of the ordering.
+
+    bool operator<(const Entry &b) const {
+      if (wakeup != b.wakeup)
+        return wakeup < b.wakeup;
+      else
+        return seq < b.seq;
+    }
+  };
+
+  EventQueue() {}
+  virtual ~EventQueue() {}
+
+  /**
+   * @brief Insert a new event.
+   * @param entry Event to be inserted. It may be earlier than the last
+   * dispatched event only when a dispatch is rolled back.
+   */
+  virtual void push(const Entry &entry) = 0;
+
+  /**
+   * @return The earliest event. The queue must not be empty.
+   */
+  virtual const Entry &top() = 0;
+
+  /**
+   * @brief Remove the earliest event. The queue must not be empty.
+   */
+  virtual void pop() = 0;
+
+  /**
+   * @brief Remove a pending event before it is dispatched.
+   * @param entry Event to be removed. It must be in the queue.
+   */
+  virtual void remove(const Entry &entry) = 0;
+
+  virtual bool empty() const = 0;
+  virtual size_t size() const = 0;
+
+  /**
+   * @param type Backend to be created.
+   * @return New empty queue of the given backend.
+   */
+  static std::unique_ptr<EventQueue> create(EventQueueType type);
+};
+
+/**
+ * @brief Indexed 4-ary heap backend.
+ * The heap remembers where each slot is stored, so a cancelled event is
+ * removed right away instead of staying in the heap until its wakeup.
+ */
+class HeapEventQueue : public EventQueue {
+private:
+  static constexpr size_t ARITY = 4;
+  std::vector<Entry> heap;
+  std::vector<uint32_t> position; // slot -> index in heap
+
+  void place(size_t index, const Entry &entry);
+  void siftUp(size_t index);
+  void siftDown(size_t index);
+  void removeAt(size_t index);
+
+public:
+  virtual void push(const Entry &entry) override;
+  virtual const Entry &top() override;
+  virtual void pop() override;
+  virtual void remove(const Entry &entry) override;
+  virtual bool empty() const override;
+  virtual size_t size() const override;
+};
+
+/**
+ * @brief Calendar queue backend (R. Brown, CACM 1988).
+ * Events are hashed into an array of buckets ("days") of a fixed width in
+ * nanoseconds. Each bucket is kept sorted, and dispatch scans the buckets
+ * like the days of a year. The number of buckets and their width are
+ * re-estimated whenever the population doubles or halves, which keeps
+ * enqueue and dispatch O(1) on average for the hold-like workloads of a
+ * network simulation.
+ */
+class CalendarEventQueue : public EventQueue {
+private:
+  // each bucket is sorted in ascending order; new events are usually the
+  // latest ones of their bucket, so insertion is mostly push_back
+  std::vector<std::deque<Entry>> buckets;
+  Time width;
+  size_t count;
+
+  // position of the last dispatched event
+  size_t lastBucket;
+  Time bucketTop;
+  Time lastWakeup;
+
+  // bucket holding the earliest event, if already searched
+  std::optional<size_t> current;
+
+  size_t bucketOf(Time wakeup) const;
+  void resize(size_t newSize);
+  Time estimateWidth() const;
+  void findNext();
+
+public:
+  CalendarEventQueue();
+
+  virtual void push(const Entry &entry) override;
+  virtual const Entry &top() override;
+  virtual void pop() override;
+  virtual void remove(const Entry &entry) override;
+  virtual bool empty() const override;
+  virtual size_t size() const override;
+};
+
+} // namespace E
+
+#endif /* E_EVENTQUEUE_HPP_ */
@@ -77,10 +77,18 @@ protected:
 #endif
       ;
 
+  /**
+   * @brief Changes the log level of this instance.
+   *
+   * @param level Log level
+   */
+  void setLevel(int level);
+
 public:
   /**
-   * @brief Default log level.
+   * @brief Default log level of new instances.
    *
+   * @see System::setLogLevel
    */
   static int defaultLevel;
 };
@@ -24,6 +24,7 @@ class Module {
 private:
   System &system;
   ModuleID id;
+  bool batchDelivery;
 
 public:
   /**
@@ -38,6 +39,31 @@ public:
   std::string getModuleName(const ModuleID moduleID);
   Time getCurrentTime();
 
+  /**
+   * @brief Compact type tag of a message. Messages of the engine carry
+   * their own tag, so a module can switch on it (a jump table) instead of
+   * comparing typeid and calling dynamic_cast on every hop.
+   * Messages without a tag are UNTAGGED and still need RTTI.
+   * Tags from USER upward are free for other message types.
+   *
+   * @see Module::messageCast, Module::visitMessage
+   */
+  enum class MessageTag : uint16_t {
+    UNTAGGED,
+    EMPTY,
+    WIRE,
+    LINK,
+    HOST_SYSCALL,
+    HOST_RETURN,
+    HOST_PACKET_PASS,
+    HOST_TIMER,
+    HOST_TIMERS,
+    HOST_PERIODIC_TIMER,
+    WIRE_BATCH,
+    HOST_PACKET_BATCH_PASS,
+    USER = 256,
+  };
+
   /**
    * @brief Interface of Message. Every message implementation
    * must inherit this class.
@@ -47,18 +73,103 @@ public:
    */
   class MessageBase {
   public:
-    MessageBase() {}
+    /**
+     * @brief Tag of this class. A tagged message class redefines it and
+     * passes it to the constructor of MessageBase.
+     */
+    static constexpr MessageTag TAG = MessageTag::UNTAGGED;
+
+    MessageBase(MessageTag tag = MessageTag::UNTAGGED)
+        : tag(tag), oneWay(false) {}
     virtual ~MessageBase() {}
+
+    MessageTag getTag() const { return tag; }
+
+    /**
+     * @brief Copy this message, so it can be delivered again after a
+     * rollback (see System::setOptimism).
+     * @return Copy of this message, or null if it cannot be copied (default).
+     * A message that cannot be copied is never handled speculatively.
+     */
+    virtual std::unique_ptr<MessageBase> cloneMessage() const {
+      return nullptr;
+    }
+
+    /**
+     * @brief Messages (of any class) are allocated from per-thread free
+     * lists by size, so a steady simulation reuses the memory of finished
+     * messages instead of calling the global operator new on every send.
+     * Messages larger than MAX_POOLED bytes are not pooled.
+     */
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr, size_t size);
+
+    static constexpr size_t MAX_POOLED = 256;
+
+  private:
+    MessageTag tag;
+    bool oneWay; // sent by postMessage
+
+    friend class Module;
+    friend class System;
   };
 
   class EmptyMessage : public MessageBase {
   public:
+    static constexpr MessageTag TAG = MessageTag::EMPTY;
+    EmptyMessage() : MessageBase(TAG) {}
     static EmptyMessage &shared();
     bool operator==(const EmptyMessage &b) const { return true; }
   };
 
   using Message = std::unique_ptr<MessageBase>;
 
+  /**
+   * @brief A message delivered in a batch (see Module::messagesReceivedBatch).
+   */
+  class Delivery {
+  public:
+    ModuleID from;    ///< sender of the message
+    Message message;  ///< DO NOT MOVE OR DEALLOCATE IT
+    Message response; ///< instant response; stays null if there is none
+
+    Delivery(ModuleID from, Message message, Module *sender)
+        : from(from), message(std::move(message)), sender(sender) {}
+
+  private:
+    Module *sender;
+    friend class System;
+  };
+
+  /**
+   * @brief Downcast a message by its tag, without RTTI.
+   * @param message Message to be cast.
+   * @return The message as T, or null if it has another tag.
+   */
+  template <typename T> static T *messageCast(MessageBase &message) {
+    static_assert(T::TAG != MessageTag::UNTAGGED);
+    if (message.getTag() != T::TAG)
+      return nullptr;
+    return static_cast<T *>(&message);
+  }
+
+  /**
+   * @brief Call the visitor with the message downcast to the one of the
+   * given message classes that has its tag.
+   * @param message Message to be dispatched.
+   * @param visitor Callable accepting a reference to each of Messages.
+   * @return false if the message has none of their tags.
+   */
+  template <typename... Messages, typename Visitor>
+  static bool visitMessage(MessageBase &message, Visitor &&visitor) {
+    static_assert(((Messages::TAG != MessageTag::UNTAGGED) && ...));
+    const MessageTag tag = message.getTag();
+    return ((tag == Messages::TAG
+                 ? (visitor(static_cast<Messages &>(message)), true)
+                 : false) ||
+            ...);
+  }
+
 protected:
   /**
    * @brief This is a callback function called by the System.
@@ -86,6 +197,36 @@ protected:
     return nullptr;
   }
 
+  /**
+   * @brief This is a callback function called by the System, instead of
+   * messageReceived, once batch delivery is enabled (see setBatchDelivery).
+   * It is given every message for this module that is due at the same time
+   * and comes next in the System's order, so a burst of packets can be
+   * handled in a single loop. The default implementation calls
+   * messageReceived for each of them.
+   *
+   * The messages are finished (see messageFinished) after this function
+   * returns, in the order of the batch. Messages of the batch are already
+   * taken out of the System, so they can no longer be cancelled.
+   *
+   * @param batch Messages in the order they would be received one by one.
+   * Set the response of a message to give an instant response.
+   */
+  virtual void messagesReceivedBatch(std::vector<Delivery> &batch) {
+    for (Delivery &delivery : batch)
+      delivery.response = messageReceived(delivery.from, *delivery.message);
+  }
+
+  /**
+   * @brief Receive messages due at the same time in batches, through
+   * messagesReceivedBatch. Enable it only if this module never cancels
+   * messages sent to itself. Batches are used by sequential runs; the
+   * parallel modes deliver messages one by one.
+   *
+   * @param enable Whether batch delivery is enabled. Disabled by default.
+   */
+  void setBatchDelivery(bool enable) { batchDelivery = enable; }
+
   /**
    * @brief This is a callback function called by the System.
    * This function is automatically called after your message is processed by
@@ -119,8 +260,8 @@ protected:
   /**
    * @brief This is a callback function called by the System.
    * This function is automatically called when the message is cancelled before
-   * it is processed. This function is called AT THE TIME WHEN THE MESSAGE WAS
-   * SUPPOSED TO BE SENT. If you want to handle Message, override this function
+   * it is processed. This function is called IMMEDIATELY, from inside
+   * cancelMessage. If you want to handle Message, override this function
    * with your own handler. YOU MUST DEALLOCATE EVERY CANCELLED MESSAGE YOU
    * ALLOCATED JUST HERE.
    *
@@ -142,6 +283,97 @@ protected:
     assert(0);
   }
 
+  /**
+   * @brief This is a callback function called by the System.
+   * In the optimistic parallel mode (see System::setOptimism), this function
+   * is called before this module handles a message speculatively. If the
+   * message turns out to be handled too early, the returned state is given
+   * back to restoreState and the message is delivered again later.
+   *
+   * Everything changed while handling a message must be saved (including
+   * the UUIDs of pending messages, and output files which must be rewound).
+   * Messages sent meanwhile are withdrawn by the System.
+   *
+   * @param from Sender of the message to be handled. A module handling
+   * messages in the partition of their sender (e.g. Wire) saves only the
+   * state that this sender can change.
+   * @return Saved state, or an empty std::any if this module cannot be rolled
+   * back (default).
+   *
+   * @see restoreState
+   */
+  virtual std::any saveState(const ModuleID from) {
+    (void)from;
+    return {};
+  }
+
+  /**
+   * @brief This is a callback function called by the System.
+   * Roll this module back to a state returned by saveState.
+   *
+   * @param from Sender given to saveState.
+   * @param state State returned by saveState.
+   *
+   * @see saveState
+   */
+  virtual void restoreState(const ModuleID from, std::any &&state) {
+    (void)from;
+    (void)state;
+    assert(0);
+  }
+
+  /**
+   * @brief This is a callback function called by the System.
+   * Write the state of this module to a checkpoint (see System::checkpoint).
+   * The configuration given while setting the System up (addresses, tables,
+   * wires) is left out, since a checkpoint is restored into a System set up
+   * the same way.
+   *
+   * @param out Stream to write to (see Checkpoint for helpers).
+   * @return false if this module cannot be checkpointed (default).
+   *
+   * @see readCheckpoint
+   */
+  virtual bool writeCheckpoint(std::ostream &out) {
+    (void)out;
+    return false;
+  }
+
+  /**
+   * @brief This is a callback function called by the System.
+   * Restore the state written by writeCheckpoint.
+   *
+   * @param in Stream holding exactly what writeCheckpoint wrote.
+   */
+  virtual void readCheckpoint(std::istream &in) {
+    (void)in;
+    assert(0);
+  }
+
+  /**
+   * @brief This is a callback function called by the System.
+   * Write a pending message sent by this module to a checkpoint. Its tag is
+   * written by the System. The default implementation handles EmptyMessage.
+   *
+   * @param message Message sent by this module.
+   * @param out Stream to write to.
+   * @return false if the message cannot be checkpointed.
+   *
+   * @see readMessage
+   */
+  virtual bool writeMessage(const MessageBase &message, std::ostream &out);
+
+  /**
+   * @brief This is a callback function called by the System.
+   * Rebuild a message written by writeMessage. It is sent again by this
+   * module when the checkpoint is restored.
+   *
+   * @param tag Tag of the message.
+   * @param in Stream holding exactly what writeMessage wrote.
+   * @return The message, or null if the tag is unknown.
+   */
+  virtual Message readMessage(MessageTag tag, std::istream &in);
+
   /**
    * @brief Send a Message to other Module.
    * Every message has its own delay before it is actually sent.
@@ -154,9 +386,13 @@ protected:
    * @param timeAfter Delay of this message. The receiver will receive the
    * Message at [current time] + [delay].
    * @return UUID of generated message. This UUID is used for cancellation of
-   * the message.
+   * the message, and is no longer valid once the message is delivered or
+   * cancelled. A message sent to a module of another partition cannot be
+   * cancelled, and 0 is returned for it.
    *
    * @note You cannot override this function.
+   * @note In a partitioned System, a message to another partition must be
+   * delayed by at least the lookahead. A shorter delay aborts the program.
    * @see messageFinished and messageReceived for allocate/deallocate
    * convention.
    */
@@ -174,7 +410,8 @@ protected:
    * @param timeAfter Delay of this message. The receiver will receive the
    * Message at [current time] + [delay].
    * @return UUID of generated message. This UUID is used for cancellation of
-   * the message.
+   * the message, and is no longer valid once the message is delivered or
+   * cancelled.
    *
    * @note You cannot override this function.
    * @see messageFinished and messageReceived for allocate/deallocate
@@ -182,10 +419,38 @@ protected:
    */
   virtual UUID sendMessageSelf(Module::Message message, Time timeAfter) final;
 
+  /**
+   * @brief Send a one-way Message to other Module. It is delivered just like
+   * sendMessage, but the System destroys it right after messageReceived
+   * instead of handing it back to messageFinished of this module. Use it
+   * when messageFinished has nothing to do, such as for packets.
+   * A response returned by the receiver is still finished by the receiver,
+   * and a cancelled message still comes back to messageCancelled.
+   *
+   * @param to Destination Module. You can send a Message to yourself (this).
+   * @param message Message to be sent.
+   * @param timeAfter Delay of this message.
+   * @return UUID of generated message, as sendMessage.
+   *
+   * @note You cannot override this function.
+   * @see sendMessage
+   */
+  virtual UUID postMessage(const ModuleID to, Module::Message message,
+                           Time timeAfter) final;
+
+  /**
+   * @brief Send a one-way Message to self (see postMessage).
+   *
+   * @note You cannot override this function.
+   */
+  virtual UUID postMessageSelf(Module::Message message, Time timeAfter) final;
+
   /**
    * @brief Cancel the raised Message.
    * If a message is not actually sent yet, you can cancel the message.
    * If the message is already sent, this function has no effect.
+   * Messages sent across partitions cannot be cancelled. Their UUID is 0,
+   * and cancelling it returns false.
    *
    * @param messageID Unique ID that represents the target Message to be
    * cancelled.
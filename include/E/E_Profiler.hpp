@@ -0,0 +1,132 @@
+/**
+ * @file   E_Profiler.hpp
+ * @brief  Header for E::Profiler
+ */
+
+#ifndef E_PROFILER_HPP_
+#define E_PROFILER_HPP_
+
+#include <E/E_Common.hpp>
+#include <E/E_Module.hpp>
+
+#include <chrono>
+#include <typeindex>
+
+namespace E {
+
+/**
+ * @brief Profiler accumulates where a System spends its time: calls of the
+ * message handlers and the wall-clock time spent in them, per module and
+ * message class, and the number of pending events over time.
+ *
+ * @see System::setProfiling
+ */
+class Profiler {
+public:
+  enum Callback {
+    RECEIVED,  ///< Module::messageReceived, by the receiver
+    FINISHED,  ///< Module::messageFinished, by the sender
+    CANCELLED, ///< Module::messageCancelled, by the sender
+    CALLBACKS,
+  };
+
+  class Counter {
+  public:
+    std::array<Size, CALLBACKS> calls = {};
+    std::array<uint64_t, CALLBACKS> nsec = {}; ///< wall-clock time
+  };
+
+  class Sample {
+  public:
+    Time time;  ///< simulated time
+    Size depth; ///< pending events
+  };
+
+  /**
+   * @return Wall clock in nanoseconds.
+   */
+  static uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  Profiler();
+
+  /**
+   * @brief Count a call of a handler.
+   *
+   * @param module Module whose handler was called.
+   * @param type Class of the message handled.
+   * @param callback Handler called.
+   * @param spent Wall-clock time spent in the handler.
+   */
+  void record(ModuleID module, const std::type_info &type, Callback callback,
+              uint64_t spent);
+
+  /**
+   * @brief Count a call of a handler which began at since.
+   * @return Wall clock now, where the next handler begins.
+   */
+  uint64_t lap(ModuleID module, const std::type_info &type, Callback callback,
+               uint64_t since);
+
+  /**
+   * @brief Count a dispatched event, and sample the queue once in a while.
+   *
+   * @param time Simulated time of the event.
+   * @param depth Events still pending.
+   */
+  void dispatched(Time time, Size depth);
+
+  /**
+   * @brief Add the counters of another Profiler (e.g. of another partition)
+   * and clear them.
+   */
+  void merge(Profiler &other);
+
+  /**
+   * @brief Add a run of the System.
+   *
+   * @param simulated Simulated time elapsed.
+   * @param nsec Wall-clock time elapsed.
+   */
+  void addRun(Time simulated, uint64_t nsec);
+
+  /**
+   * @return Counters of a module for a message class, zero if none.
+   */
+  Counter getCounter(ModuleID module, const std::type_info &type) const;
+
+  Size getEvents() const;
+  Size getRuns() const;
+  Size getMaxDepth() const;
+  const std::vector<Sample> &getSamples() const;
+
+  /**
+   * @brief Write everything as JSON. Modules are sorted by the time spent in
+   * their handlers, the most expensive first.
+   *
+   * @param out Stream to write to.
+   * @param name Name of a module.
+   */
+  void writeJSON(std::ostream &out,
+                 const std::function<std::string(ModuleID)> &name) const;
+
+private:
+  // bounds the samples; the interval doubles when they are full
+  static constexpr Size MAX_SAMPLES = 4096;
+
+  std::map<ModuleID, std::map<std::type_index, Counter>> counters;
+  std::vector<Sample> samples;
+  Size sampleInterval;
+  Size events;
+  Size maxDepth;
+  Size runs;
+  Time simulated;
+  uint64_t nsec;
+};
+
+} // namespace E
+
+#endif /* E_PROFILER_HPP_ */
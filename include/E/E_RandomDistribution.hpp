@@ -25,6 +25,10 @@ public:
   virtual ~RandomDistribution();
   virtual Real nextDistribution(Real min, Real max) = 0;
   virtual std::list<Real> distribute(Size count, Real total) final;
+
+  // state of the engine, see Checkpoint
+  virtual void writeState(std::ostream &out) const final;
+  virtual void readState(std::istream &in) final;
 };
 
 class UniformDistribution : public RandomDistribution {
@@ -56,6 +60,8 @@ public:
 
 class LinearDistribution : public RandomDistribution {
 public:
+  LinearDistribution();
+  LinearDistribution(UUID seed);
   virtual Real nextDistribution(Real min, Real max);
 };
 
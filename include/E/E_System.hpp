@@ -9,14 +9,31 @@
 #define E_SYSTEM_HPP_
 
 #include <E/E_Common.hpp>
+#include <E/E_EventQueue.hpp>
 #include <E/E_Log.hpp>
+#include <E/E_Profiler.hpp>
 #include <E/E_Module.hpp>
 
+#include <ucontext.h>
+
 namespace E {
 
-class TimerContainer;
 class Runnable;
 
+/**
+ * @brief How a Runnable is executed.
+ *
+ * @note A fiber destroyed before its main returns is not unwound, so the
+ * destructors of the objects on its stack never run.
+ * @see System::setRunnableType
+ */
+enum class RunnableType {
+  THREAD, ///< One OS thread per Runnable, handed over with a condition
+          ///< variable.
+  FIBER,  ///< A stackful coroutine on a pooled stack, switched in and out by
+          ///< the thread running the System. No OS context switch.
+};
+
 /**
  * @brief System provides a virtual clock used during the simulation.
  * Current virtual clock can be obtained by System::getCurrentTime.
@@ -28,49 +45,207 @@ class Runnable;
  */
 class System : private Log {
 private:
-  std::unordered_set<std::shared_ptr<Runnable>> runnableReady;
-  static const ModuleID newModuleID();
-  class TimerContainerInner {
+  ModuleID nextModuleID;
+  const ModuleID newModuleID();
+
+  // unset seed: draw seeds from rand(), as before
+  std::optional<std::mt19937_64> randomEngine;
+
+  /*
+   * Pending events live in recycled slots. The UUID handed out by
+   * sendMessage is (generation << 32 | scheduler << 24 | slot index); the
+   * generation is bumped whenever a slot is released, so stale UUIDs never
+   * match a reused slot.
+   */
+  class EventSlot {
   public:
-    const ModuleID from;
-    const ModuleID to;
-    bool canceled;
     Time wakeup;
+    UUID seq;
+    ModuleID from;
+    ModuleID to;
+    Module *sender; // modules of from and to, so dispatch needs no lookup
+    Module *receiver;
+    uint32_t generation;
     Module::Message message;
-    UUID uuid;
-    TimerContainerInner(const ModuleID from, const ModuleID to, bool canceled,
-                        Time wakeup, Module::Message message, UUID uuid)
-        : from(from), to(to), canceled(canceled), wakeup(wakeup),
-          message(std::move(message)), uuid(uuid) {}
   };
 
-  using TimerContainer = std::shared_ptr<TimerContainerInner>;
+  /*
+   * Event dispatched during the current window of the parallel mode, and the
+   * range of Spawned events it sent (including those sent by the Runnables it
+   * woke up).
+   */
+  class Dispatched {
+  public:
+    Time wakeup;
+    UUID seq;
+    size_t firstSpawned;
+    size_t lastSpawned;
+
+    // optimistic mode only: how to undo a speculative dispatch
+    bool speculative;
+    Time previousTime;
+    size_t firstUndo;
+    size_t firstSaved;
+  };
+
+  /*
+   * Change to the event slots made by a speculative dispatch: a slot released
+   * (dispatched or cancelled message, with a copy of the message), or a slot
+   * allocated by a send.
+   */
+  class Undo {
+  public:
+    bool released;
+    bool appended;
+    uint32_t slot;
+    EventSlot copy;
+  };
+
+  // module state saved before a speculative dispatch
+  class Saved {
+  public:
+    Module *module;
+    ModuleID from;
+    std::any state;
+  };
 
-  class TimerContainerLess {
+  /*
+   * Event sent during the current window of the parallel mode. Its final
+   * sequence number is only known once the windows of all partitions are
+   * merged. Events for other partitions are kept here until then.
+   */
+  class Spawned {
   public:
-    bool operator()(const TimerContainer a, const TimerContainer b) {
-      if (a->wakeup != b->wakeup)
-        return a->wakeup > b->wakeup;
-      else
-        return a->uuid > b->uuid; // XXX if uuid returns to the start??
-    }
+    size_t partition;
+    uint32_t slot;
+    bool pending;
+    UUID seq;
+    Time wakeup;
+    ModuleID from;
+    ModuleID to;
+    Module::Message message;
+  };
+
+  /*
+   * Scheduler holds everything needed to dispatch events in order: the
+   * pending events, the virtual clock and the ready Runnables.
+   * A System has a single Scheduler unless it runs in parallel, where each
+   * partition gets its own.
+   */
+  class Scheduler {
+  public:
+    System &system;
+    size_t index;
+    std::unique_ptr<EventQueue> queue;
+    std::vector<EventSlot> slots;
+    std::vector<uint32_t> freeSlots;
+    Time currentTime;
+    std::unordered_set<std::shared_ptr<Runnable>> runnableReady;
+
+    std::vector<Dispatched> dispatched;
+    std::vector<Spawned> spawned;
+    std::vector<Undo> undo;
+    std::vector<Saved> saved;
+    bool speculating;
+    std::vector<Module::Delivery> batch; // reused by dispatchBatch
+    std::unique_ptr<Profiler> profiler; // see setProfiling
+
+    Scheduler(System &system, size_t index, EventQueueType queueType);
   };
-  UUID currentID;
-  Time currentTime;
+
+  // scheduler running on this thread during a parallel window
+  static thread_local Scheduler *active;
+  // System running on this thread (or on the thread that woke it up)
+  static thread_local System *running;
+
+  EventQueueType queueType;
+  RunnableType runnableType;
+  UUID nextSeq;
+  std::vector<std::unique_ptr<Scheduler>> schedulers;
+
+  size_t parallelism;
+  Time optimism;
+  bool partitioned;
+  std::vector<size_t> partitionIndex; // dense copy of partitionOf
+  std::unordered_map<UUID, UUID> movedMessages;
+  std::string profilePath;
+  std::unique_ptr<Profiler> profile; // every run so far
 
 protected:
   ModuleID lookupModuleID(Module &module);
-  std::unordered_map<ModuleID, std::shared_ptr<Module>> registeredModule;
+  // indexed by ModuleID; IDs are dense and start at 1
+  std::vector<std::shared_ptr<Module>> registeredModule;
+
+  /**
+   * @brief Assignment of modules to partitions for the parallel mode.
+   * A message between modules of different partitions must be sent with a
+   * delay of at least lookahead.
+   *
+   * @see System::partition
+   */
+  class Partitioning {
+  public:
+    /**
+     * @brief The module has no state shared between its senders, and handles
+     * each message in the partition of the sender (e.g. Wire).
+     */
+    static constexpr size_t SENDER = SIZE_MAX;
+
+    size_t count = 1;
+    Time lookahead = 0;
+    std::unordered_map<ModuleID, size_t> partitionOf;
+  };
+
+  /**
+   * @brief Split the registered modules for the parallel mode.
+   * It is called once, on the first run after setParallelism.
+   * The default implementation keeps every module in a single partition.
+   *
+   * @param partitions Number of partitions requested.
+   * @return Partitioning of the registered modules. Unlisted modules go to
+   * partition 0.
+   */
+  virtual Partitioning partition(size_t partitions);
+
+  /**
+   * @brief Write the state a subclass keeps in the System (e.g. counters) to
+   * a checkpoint. The default implementation writes the random seeds.
+   *
+   * @see checkpoint
+   */
+  virtual void writeCheckpoint(std::ostream &out);
+
+  /**
+   * @brief Read back what writeCheckpoint wrote.
+   */
+  virtual void readCheckpoint(std::istream &in);
 
 private:
-  std::priority_queue<TimerContainer, std::vector<TimerContainer>,
-                      TimerContainerLess>
-      timerQueue;
-  std::unordered_map<UUID, TimerContainer> activeTimer;
-  std::unordered_set<UUID> activeUUID;
-
-  UUID allocateUUID();
-  bool deallocateUUID(UUID uuid);
+  Partitioning partitioning;
+
+  Scheduler &current();
+  bool inWindow();
+  size_t partitionFor(const ModuleID from, const ModuleID to);
+  UUID schedule(Scheduler &scheduler, Time wakeup, UUID seq,
+                const ModuleID from, const ModuleID to,
+                Module::Message message);
+  uint32_t allocateSlot(Scheduler &scheduler);
+  void releaseSlot(Scheduler &scheduler, uint32_t slot);
+  void dispatch(Scheduler &scheduler, const EventQueue::Entry &next);
+  void dispatchBatch(Scheduler &scheduler, const EventQueue::Entry &next);
+  void dispatchProfiled(Profiler &profiler, const ModuleID from,
+                        const ModuleID to, Module &sender, Module &receiver,
+                        Module::Message message);
+  void wakeRunnables(Scheduler &scheduler);
+
+  void startPartitions();
+  void runSequential(Time till);
+  void runParallel(Time till);
+  void runWindow(Scheduler &scheduler, Time safeEnd, Time end, Time till);
+  bool speculate(Scheduler &scheduler, const EventQueue::Entry &next);
+  void rollback(Scheduler &scheduler, Time to);
+  void mergeWindow();
+
   bool isRegistered(const ModuleID moduleID);
   UUID sendMessage(const ModuleID from, const ModuleID to,
                    Module::Message message, Time timeAfter);
@@ -79,8 +254,11 @@ private:
 public:
   /**
    * @brief Nothing is needed to construct a System
+   *
+   * @param queueType Backend for pending events. Every backend keeps the
+   * same total ordering of events, so this only affects performance.
    */
-  System();
+  System(EventQueueType queueType = EventQueueType::HEAP);
   virtual ~System();
 
   /**
@@ -92,6 +270,153 @@ public:
    */
   void run(Time till);
 
+  /**
+   * @brief Run the System on several threads (conservative parallel
+   * simulation). Modules are split into partitions (see System::partition)
+   * and the partitions advance together in windows no longer than the
+   * lookahead, so no message can arrive from the past. Events are delivered
+   * in exactly the same order as the sequential run.
+   *
+   * Modules of different partitions must not share any state (including
+   * rand()), and a message sent to another partition cannot be cancelled.
+   *
+   * @param threads Number of partitions. 1 runs sequentially.
+   *
+   * @note It must be called before the first run.
+   */
+  void setParallelism(size_t threads);
+
+  /**
+   * @brief Let the partitions run ahead optimistically (Time Warp).
+   * Each window may extend the given time beyond the earliest pending event,
+   * instead of the lookahead. Messages beyond the lookahead are handled
+   * speculatively if the message can be copied (see
+   * Module::MessageBase::cloneMessage) and the receiver can save its
+   * state (see Module::saveState); otherwise the partition waits.
+   * When a message from another partition arrives in the past of its
+   * receiver, every partition is rolled back to the time of that message:
+   * states are restored and the messages sent by the undone events are
+   * withdrawn. Everything before the rollback time (the global virtual time)
+   * is committed and its saved states are discarded.
+   *
+   * The order of events is still identical to the sequential run.
+   *
+   * @param window Optimistic window length. 0 disables the optimism.
+   *
+   * @see setParallelism
+   */
+  void setOptimism(Time window);
+
+  /**
+   * @brief Select how the Runnables (applications) created for this System
+   * are executed. Either way, a Runnable only runs while the System waits for
+   * it, so the order of events does not change.
+   *
+   * @param type RunnableType::THREAD (default) or RunnableType::FIBER.
+   *
+   * @note It must be called before any Runnable of this System is created.
+   */
+  void setRunnableType(RunnableType type);
+
+  /**
+   * @return How the Runnables of this System are executed.
+   */
+  RunnableType getRunnableType();
+
+  /**
+   * @brief Seed the random number generators of the Modules of this System
+   * (e.g. packet drops of a Switch) from this System only. Without a seed
+   * they are seeded by rand(), which is shared by the whole process.
+   *
+   * @param seed Seed of this System.
+   *
+   * @note It must be called before the Modules are added.
+   */
+  void setRandomSeed(uint64_t seed);
+
+  /**
+   * @return Seed for a random number generator of a Module.
+   *
+   * @see setRandomSeed
+   */
+  uint64_t nextRandomSeed();
+
+  /**
+   * @brief Set the log level of this System.
+   * Log::defaultLevel is only the initial level of a new System.
+   *
+   * @param level Log level
+   */
+  void setLogLevel(int level);
+
+  /**
+   * @return The System being run by the calling thread, or nullptr when
+   * called outside of System::run. Applications woken up by a System see that
+   * System.
+   */
+  static System *getRunningSystem();
+
+  /**
+   * @brief Counters of the parallel mode.
+   */
+  class ParallelStatistics {
+  public:
+    Size partitions = 1;
+    Time lookahead = 0;
+    Size windows = 0;
+    Size committed = 0;  ///< events dispatched for good
+    Size rolledBack = 0; ///< speculative events undone
+  };
+
+  /**
+   * @return Counters accumulated by every parallel run of this System.
+   */
+  const ParallelStatistics &getParallelStatistics();
+
+  /**
+   * @brief Profile the message handlers: calls and wall-clock time of
+   * messageReceived, messageFinished and messageCancelled per module and
+   * message class, the number of pending events over time, and the speed of
+   * the runs. Everything since profiling began is written to the file as
+   * JSON whenever run returns.
+   *
+   * @param path JSON file to be written. An empty path stops profiling.
+   */
+  void setProfiling(const std::string &path);
+
+  /**
+   * @return Counters of the profiled runs, or nullptr without profiling.
+   */
+  const Profiler *getProfiler();
+
+  /**
+   * @brief Save this System to a file: its time, the pending messages and
+   * the state of every module. It can be restored into a System set up the
+   * same way (the same modules added in the same order, with the same
+   * configuration), e.g. to start many experiments from the end of a single
+   * warm-up.
+   *
+   * Every module, and every pending message of its sender, must support
+   * checkpoints (see Module::writeCheckpoint and Module::writeMessage).
+   * Runnables cannot be saved. Checkpoints are taken between runs, and not
+   * once the System is split for the parallel mode.
+   *
+   * @param path File to be written.
+   * @return false if something cannot be saved. Nothing is written then.
+   */
+  bool checkpoint(const std::string &path);
+
+  /**
+   * @brief Restore a file written by checkpoint. The messages pending in this
+   * System are dropped (they are not cancelled), and replaced with those of
+   * the checkpoint, which keep their UUIDs.
+   *
+   * @param path File to be read.
+   * @return false if the file cannot be read or was written by a System set
+   * up with other modules. This System is left untouched then.
+   */
+  bool restore(const std::string &path);
+
   /**
    * @return Returns current virtual clock of the System.
    */
@@ -125,19 +450,22 @@ public:
     static_assert(std::is_base_of<Module, T>::value);
     auto module = std::make_shared<T>(std::forward<Args>(args)...);
     module->id = newModuleID();
-    bool ret = registeredModule.insert({module->id, module}).second;
-    (void)ret;
-    assert(ret);
+    assert(module->id == registeredModule.size());
+    registeredModule.push_back(module);
     return module;
   }
   std::string getModuleName(const ModuleID moduleID);
 
+private:
+  ParallelStatistics statistics;
+
   friend Module::Module(System &system);
   friend Module::~Module();
 
   friend UUID Module::sendMessage(const ModuleID to, Module::Message message,
                                   Time timeAfter);
   friend bool Module::cancelMessage(UUID timer);
+  friend class Runnable;
 };
 
 /**
@@ -153,8 +481,11 @@ class Runnable {
 protected:
   /**
    * @brief Constructs a Runnable interface.
+   *
+   * @param type Run on its own thread, or as a fiber on the thread of the
+   * System.
    */
-  Runnable();
+  Runnable(RunnableType type = RunnableType::THREAD);
   virtual ~Runnable();
 
   /**
@@ -172,7 +503,7 @@ protected:
   virtual void main() = 0;
 
   /**
-   * @brief Thread code
+   * @brief Thread (or fiber) code
    */
   virtual void run() final;
 
@@ -205,12 +536,22 @@ public:
   friend class System;
 
 private:
+  static void fiberEntry(uint32_t high, uint32_t low);
+
+  RunnableType type;
   State state;
   std::mutex stateMtx;
   std::unique_lock<std::mutex> threadLock; //  for thread
   std::unique_lock<std::mutex> schedLock;  //  for scheduler
   std::condition_variable cond;
   std::thread thread;
+  System::Scheduler *scheduler; // scheduler that woke this Runnable
+  System *system;               // System of that scheduler
+
+  // fiber only
+  ucontext_t context;
+  ucontext_t caller;
+  void *stack;
 };
 
 } // namespace E
@@ -0,0 +1,317 @@
+/**
+ * @file   E_HeaderView.hpp
+ * @brief  Typed views of the protocol headers in a Packet
+ */
+
+#ifndef E_HEADERVIEW_HPP_
+#define E_HEADERVIEW_HPP_
+
+#include <E/E_Common.hpp>
+#include <E/Networking/E_Packet.hpp>
+
+namespace E {
+
+/**
+ * @brief HeaderView reads and writes the fields of a protocol header at fixed
+ * offsets in the bytes of a packet, converting them from and to network byte
+ * order. Nothing is copied: the view points into the packet.
+ *
+ * A view over uint8_t can change the header, and one over const uint8_t only
+ * read it. The offsets of the fields are checked at compile time, and the
+ * length of the packet with assert, so only in debug builds.
+ *
+ * @param Byte uint8_t, or const uint8_t for a read-only view
+ * @param Size Length of the header without options
+ * @see Packet::accessData
+ */
+template <typename Byte, size_t Size> class HeaderView {
+public:
+  static constexpr size_t SIZE = Size;
+  using PacketRef =
+      std::conditional_t<std::is_const_v<Byte>, const Packet &, Packet &>;
+
+  /**
+   * @param bytes Start of the header.
+   */
+  constexpr explicit HeaderView(Byte *bytes) : bytes(bytes) {
+    assert(bytes != nullptr);
+  }
+
+  /**
+   * @param packet Packet holding the header, which must outlive the view.
+   * @param offset Start of the header in the packet.
+   */
+  HeaderView(PacketRef packet, size_t offset)
+      : HeaderView(packet.accessData(offset, Size)) {}
+
+  /**
+   * @return Start of the header.
+   */
+  constexpr Byte *data() const { return bytes; }
+
+protected:
+  Byte *bytes;
+
+  template <typename T, size_t Offset> constexpr T load() const {
+    static_assert(Offset + sizeof(T) <= Size, "field beyond the header");
+    T value = 0;
+    for (size_t k = 0; k < sizeof(T); k++)
+      value = (T)(value << 8 | bytes[Offset + k]);
+    return value;
+  }
+
+  template <typename T, size_t Offset> constexpr void store(T value) const {
+    static_assert(Offset + sizeof(T) <= Size, "field beyond the header");
+    for (size_t k = sizeof(T); k-- > 0;) {
+      bytes[Offset + k] = (uint8_t)value;
+      value = (T)(value >> 8);
+    }
+  }
+
+  template <size_t N, size_t Offset>
+  constexpr std::array<uint8_t, N> loadArray() const {
+    static_assert(Offset + N <= Size, "field beyond the header");
+    std::array<uint8_t, N> array = {};
+    for (size_t k = 0; k < N; k++)
+      array[k] = bytes[Offset + k];
+    return array;
+  }
+
+  template <size_t N, size_t Offset>
+  constexpr void storeArray(const std::array<uint8_t, N> &array) const {
+    static_assert(Offset + N <= Size, "field beyond the header");
+    for (size_t k = 0; k < N; k++)
+      bytes[Offset + k] = array[k];
+  }
+};
+
+/**
+ * @brief Ethernet II header.
+ */
+template <typename Byte>
+class BasicEthernetHeaderView : public HeaderView<Byte, 14> {
+public:
+  using HeaderView<Byte, 14>::HeaderView;
+
+  static constexpr uint16_t IPV4 = 0x0800;
+  static constexpr uint16_t IPV6 = 0x86DD;
+
+  constexpr mac_t destination() const {
+    return this->template loadArray<6, 0>();
+  }
+  constexpr void setDestination(const mac_t &mac) const {
+    this->template storeArray<6, 0>(mac);
+  }
+  constexpr mac_t source() const { return this->template loadArray<6, 6>(); }
+  constexpr void setSource(const mac_t &mac) const {
+    this->template storeArray<6, 6>(mac);
+  }
+  constexpr uint16_t etherType() const {
+    return this->template load<uint16_t, 12>();
+  }
+  constexpr void setEtherType(uint16_t type) const {
+    this->template store<uint16_t, 12>(type);
+  }
+};
+
+/**
+ * @brief IPv4 header, without options.
+ */
+template <typename Byte>
+class BasicIPv4HeaderView : public HeaderView<Byte, 20> {
+public:
+  using HeaderView<Byte, 20>::HeaderView;
+
+  static constexpr uint8_t TCP = 0x06;
+  static constexpr uint8_t UDP = 0x11;
+  static constexpr uint16_t DONT_FRAGMENT = 0x4000;
+
+  constexpr uint8_t version() const {
+    return this->template load<uint8_t, 0>() >> 4;
+  }
+  constexpr void setVersion(uint8_t version) const {
+    this->template store<uint8_t, 0>(
+        (uint8_t)(version << 4 | (this->template load<uint8_t, 0>() & 0x0F)));
+  }
+  /// @return Length of the header in bytes, with options.
+  constexpr size_t headerLength() const {
+    return (this->template load<uint8_t, 0>() & 0x0F) * 4;
+  }
+  constexpr void setHeaderLength(size_t length) const {
+    this->template store<uint8_t, 0>(
+        (uint8_t)((this->template load<uint8_t, 0>() & 0xF0) | length / 4));
+  }
+  /// @return DSCP and ECN.
+  constexpr uint8_t typeOfService() const {
+    return this->template load<uint8_t, 1>();
+  }
+  constexpr void setTypeOfService(uint8_t tos) const {
+    this->template store<uint8_t, 1>(tos);
+  }
+  constexpr uint16_t totalLength() const {
+    return this->template load<uint16_t, 2>();
+  }
+  constexpr void setTotalLength(uint16_t length) const {
+    this->template store<uint16_t, 2>(length);
+  }
+  constexpr uint16_t identification() const {
+    return this->template load<uint16_t, 4>();
+  }
+  constexpr void setIdentification(uint16_t id) const {
+    this->template store<uint16_t, 4>(id);
+  }
+  /// @return Flags and fragment offset.
+  constexpr uint16_t fragment() const {
+    return this->template load<uint16_t, 6>();
+  }
+  constexpr void setFragment(uint16_t fragment) const {
+    this->template store<uint16_t, 6>(fragment);
+  }
+  constexpr uint8_t timeToLive() const {
+    return this->template load<uint8_t, 8>();
+  }
+  constexpr void setTimeToLive(uint8_t ttl) const {
+    this->template store<uint8_t, 8>(ttl);
+  }
+  constexpr uint8_t protocol() const {
+    return this->template load<uint8_t, 9>();
+  }
+  constexpr void setProtocol(uint8_t protocol) const {
+    this->template store<uint8_t, 9>(protocol);
+  }
+  constexpr uint16_t checksum() const {
+    return this->template load<uint16_t, 10>();
+  }
+  constexpr void setChecksum(uint16_t checksum) const {
+    this->template store<uint16_t, 10>(checksum);
+  }
+  constexpr ipv4_t source() const {
+    return this->template loadArray<4, 12>();
+  }
+  constexpr void setSource(const ipv4_t &ip) const {
+    this->template storeArray<4, 12>(ip);
+  }
+  constexpr ipv4_t destination() const {
+    return this->template loadArray<4, 16>();
+  }
+  constexpr void setDestination(const ipv4_t &ip) const {
+    this->template storeArray<4, 16>(ip);
+  }
+};
+
+/**
+ * @brief TCP header, without options.
+ */
+template <typename Byte>
+class BasicTCPHeaderView : public HeaderView<Byte, 20> {
+public:
+  using HeaderView<Byte, 20>::HeaderView;
+
+  static constexpr uint8_t FIN = 0x01;
+  static constexpr uint8_t SYN = 0x02;
+  static constexpr uint8_t RST = 0x04;
+  static constexpr uint8_t PSH = 0x08;
+  static constexpr uint8_t ACK = 0x10;
+  static constexpr uint8_t URG = 0x20;
+
+  constexpr uint16_t sourcePort() const {
+    return this->template load<uint16_t, 0>();
+  }
+  constexpr void setSourcePort(uint16_t port) const {
+    this->template store<uint16_t, 0>(port);
+  }
+  constexpr uint16_t destinationPort() const {
+    return this->template load<uint16_t, 2>();
+  }
+  constexpr void setDestinationPort(uint16_t port) const {
+    this->template store<uint16_t, 2>(port);
+  }
+  constexpr uint32_t sequence() const {
+    return this->template load<uint32_t, 4>();
+  }
+  constexpr void setSequence(uint32_t sequence) const {
+    this->template store<uint32_t, 4>(sequence);
+  }
+  constexpr uint32_t acknowledgement() const {
+    return this->template load<uint32_t, 8>();
+  }
+  constexpr void setAcknowledgement(uint32_t acknowledgement) const {
+    this->template store<uint32_t, 8>(acknowledgement);
+  }
+  /// @return Length of the header in bytes, with options.
+  constexpr size_t headerLength() const {
+    return (this->template load<uint8_t, 12>() >> 4) * 4;
+  }
+  constexpr void setHeaderLength(size_t length) const {
+    this->template store<uint8_t, 12>((uint8_t)(length / 4 << 4));
+  }
+  constexpr uint8_t flags() const { return this->template load<uint8_t, 13>(); }
+  constexpr void setFlags(uint8_t flags) const {
+    this->template store<uint8_t, 13>(flags);
+  }
+  constexpr uint16_t window() const {
+    return this->template load<uint16_t, 14>();
+  }
+  constexpr void setWindow(uint16_t window) const {
+    this->template store<uint16_t, 14>(window);
+  }
+  constexpr uint16_t checksum() const {
+    return this->template load<uint16_t, 16>();
+  }
+  constexpr void setChecksum(uint16_t checksum) const {
+    this->template store<uint16_t, 16>(checksum);
+  }
+  constexpr uint16_t urgentPointer() const {
+    return this->template load<uint16_t, 18>();
+  }
+  constexpr void setUrgentPointer(uint16_t pointer) const {
+    this->template store<uint16_t, 18>(pointer);
+  }
+};
+
+/**
+ * @brief UDP header.
+ */
+template <typename Byte>
+class BasicUDPHeaderView : public HeaderView<Byte, 8> {
+public:
+  using HeaderView<Byte, 8>::HeaderView;
+
+  constexpr uint16_t sourcePort() const {
+    return this->template load<uint16_t, 0>();
+  }
+  constexpr void setSourcePort(uint16_t port) const {
+    this->template store<uint16_t, 0>(port);
+  }
+  constexpr uint16_t destinationPort() const {
+    return this->template load<uint16_t, 2>();
+  }
+  constexpr void setDestinationPort(uint16_t port) const {
+    this->template store<uint16_t, 2>(port);
+  }
+  constexpr uint16_t length() const {
+    return this->template load<uint16_t, 4>();
+  }
+  constexpr void setLength(uint16_t length) const {
+    this->template store<uint16_t, 4>(length);
+  }
+  constexpr uint16_t checksum() const {
+    return this->template load<uint16_t, 6>();
+  }
+  constexpr void setChecksum(uint16_t checksum) const {
+    this->template store<uint16_t, 6>(checksum);
+  }
+};
+
+using EthernetHeaderView = BasicEthernetHeaderView<uint8_t>;
+using ConstEthernetHeaderView = BasicEthernetHeaderView<const uint8_t>;
+using IPv4HeaderView = BasicIPv4HeaderView<uint8_t>;
+using ConstIPv4HeaderView = BasicIPv4HeaderView<const uint8_t>;
+using TCPHeaderView = BasicTCPHeaderView<uint8_t>;
+using ConstTCPHeaderView = BasicTCPHeaderView<const uint8_t>;
+using UDPHeaderView = BasicUDPHeaderView<uint8_t>;
+using ConstUDPHeaderView = BasicUDPHeaderView<const uint8_t>;
+
+} // namespace E
+
+#endif /* E_HEADERVIEW_HPP_ */
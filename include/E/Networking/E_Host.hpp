@@ -14,6 +14,7 @@
 #include <E/Networking/E_NetworkLog.hpp>
 #include <E/Networking/E_Networking.hpp>
 #include <E/Networking/E_Packet.hpp>
+#include <E/Networking/E_PacketBatch.hpp>
 #include <E/Networking/E_RoutingInfo.hpp>
 #include <E/Networking/E_TimerModule.hpp>
 #include <E/Networking/E_Wire.hpp>
@@ -94,6 +95,15 @@ protected:
   virtual void sendPacket(std::string toModule, Packet &&packet) final;
   void sendPacket(std::string toModule, const Packet &packet);
 
+  /**
+   * @brief Send a burst of packets to a HostModule as one event.
+   * Sent to "Host", the batch goes out of a port as one event as well.
+   *
+   * @param toModule Name of the destination HostModule.
+   * @param batch Packets to be sent, in order.
+   */
+  void sendPacket(std::string toModule, PacketBatch &&batch);
+
   /**
    * @return Returns current virtual clock of the System.
    */
@@ -135,6 +145,39 @@ protected:
 #endif
       ;
 
+  // Virtuals added since 3.3.0 are declared last, after those a solution
+  // built against older headers may rely on.
+
+  /**
+   * @brief This function is called by Host when this module receives a
+   * PacketBatch. By default, packetArrived is called for each packet in turn.
+   * Override it to handle a burst at once.
+   *
+   * @param fromModule Name of the HostModule who sent this batch.
+   * @param batch Received packets.
+   */
+  virtual void packetsArrived(std::string fromModule, PacketBatch &&batch);
+
+  /**
+   * @brief This function is called by Host when the System is checkpointed.
+   * Write the state of this module (see Module::writeCheckpoint).
+   *
+   * @param out Stream to write to (see Checkpoint for helpers).
+   * @return false if this module cannot be checkpointed (default).
+   */
+  virtual bool writeCheckpoint(std::ostream &out) {
+    (void)out;
+    return false;
+  }
+
+  /**
+   * @brief Restore the state written by writeCheckpoint.
+   */
+  virtual void readCheckpoint(std::istream &in) {
+    (void)in;
+    assert(0);
+  }
+
   friend class Host;
 };
 
@@ -272,6 +315,8 @@ protected:
    * so we cannot control the starting time.
    * Calling this function guarantees that E_Main thread is
    * successfully launched.
+   * Applications run as fibers instead if the NetworkSystem says so
+   * (see System::setRunnableType).
    */
   virtual void initialize() final;
   /**
@@ -353,6 +398,58 @@ private:
   std::unordered_map<int, ProcessInfo> processInfoMap;
   std::unordered_map<UUID, int> syscallMap; // to PID
 
+  // timers added with slack, rung together by a Timers message per wakeup
+  class CoalescedTimer {
+  public:
+    std::string from;
+    std::any payload;
+    Time deadline;
+    Time wakeup;
+  };
+  class TimerBucket {
+  public:
+    UUID event; // the Timers message
+    std::vector<UUID> timers;
+  };
+  UUID nextTimerID;
+  std::unordered_map<UUID, CoalescedTimer> coalescedTimers;
+  std::map<Time, TimerBucket> timerBuckets; // by wakeup
+
+  // periodic timers, each re-armed with the PeriodicTimer message it rang
+  class Periodic {
+  public:
+    std::string from;
+    std::any payload;
+    Time period;
+    UUID event; // 0 while ringing
+  };
+  std::unordered_map<UUID, Periodic> periodicTimers;
+  std::vector<Module::Message> spareTicks; // PeriodicTimer messages not in use
+
+public:
+  /**
+   * @brief Checksum offload of a port, as a NIC would do it.
+   *
+   * A sender may leave the IPv4 and TCP checksums of a packet partial
+   * (Packet::Metadata::checksumPartial). A port with transmit offload sends it
+   * as it is; otherwise the Host computes the checksums before sending. They
+   * are computed later only if the bytes are needed: for a pcap capture, by a
+   * Switch corrupting the frame, or by a receiver without receive offload.
+   *
+   * A port with receive offload sets transportChecksumVerified in the
+   * metadata of packets whose TCP checksum is valid, or still partial.
+   * Otherwise the flag is never set, and the stack has to check the checksum
+   * itself.
+   */
+  class ChecksumOffload {
+  public:
+    bool transmit = false; ///< partial packets are sent as they are
+    bool receive = false;  ///< TCP checksums are verified on arrival
+  };
+
+private:
+  std::vector<ChecksumOffload> offloads; // by port, if set
+
   virtual Module::Message messageReceived(const ModuleID from,
                                           Module::MessageBase &message) final;
   virtual void messageFinished(const ModuleID to, Module::Message message,
@@ -360,6 +457,13 @@ private:
   virtual void messageCancelled(const ModuleID to,
                                 Module::Message message) final;
 
+  // host modules and their timers; not while an application is running
+  virtual bool writeCheckpoint(std::ostream &out) final;
+  virtual void readCheckpoint(std::istream &in) final;
+  virtual bool writeMessage(const MessageBase &message,
+                            std::ostream &out) final;
+  virtual Module::Message readMessage(MessageTag tag, std::istream &in) final;
+
 public:
   Host(std::string name, NetworkSystem &system);
   virtual ~Host();
@@ -408,52 +512,107 @@ public:
   void launchApplication(int pid);
   std::any diagnoseHostModule(const char *name, std::any param);
   Size getWireSpeed(int port_num);
+  RunnableType getRunnableType();
+
+  /**
+   * @param portIndex Port to configure.
+   * @param offload Checksums the port computes and verifies.
+   */
+  void setChecksumOffload(size_t portIndex, ChecksumOffload offload);
+
+  /**
+   * @param portIndex Port of this Host.
+   * @return Checksum offload of the port, none unless set.
+   */
+  ChecksumOffload getChecksumOffload(size_t portIndex);
 
   class Syscall : public Module::MessageBase {
   public:
+    static constexpr MessageTag TAG = MessageTag::HOST_SYSCALL;
     int pid;
     SystemCallInterface::SystemCallParameter param;
     Syscall(int pid, SystemCallInterface::SystemCallParameter param)
-        : pid(pid), param(param) {}
+        : MessageBase(TAG), pid(pid), param(param) {}
     ~Syscall() override {}
   };
 
   // Application Return
   class Return : public Module::MessageBase {
   public:
+    static constexpr MessageTag TAG = MessageTag::HOST_RETURN;
     int pid;
     int returnValue;
-    Return(int pid, int returnValue) : pid(pid), returnValue(returnValue) {}
+    Return(int pid, int returnValue)
+        : MessageBase(TAG), pid(pid), returnValue(returnValue) {}
     ~Return() override {}
   };
   class PacketPass : public Module::MessageBase {
   public:
+    static constexpr MessageTag TAG = MessageTag::HOST_PACKET_PASS;
     std::optional<std::string> from;
     std::optional<std::string> to;
     Packet packet;
     PacketPass(std::optional<std::string> from, std::optional<std::string> to,
                Packet &&packet)
-        : from(from), to(to), packet(packet) {}
-    PacketPass(Packet &&packet) : from({}), to({}), packet(packet) {}
+        : MessageBase(TAG), from(from), to(to), packet(std::move(packet)) {}
+    PacketPass(Packet &&packet)
+        : MessageBase(TAG), from({}), to({}), packet(std::move(packet)) {}
     ~PacketPass() override {}
   };
+  class PacketBatchPass : public Module::MessageBase {
+  public:
+    static constexpr MessageTag TAG = MessageTag::HOST_PACKET_BATCH_PASS;
+    std::optional<std::string> from;
+    std::optional<std::string> to;
+    PacketBatch batch;
+    PacketBatchPass(std::optional<std::string> from,
+                    std::optional<std::string> to, PacketBatch &&batch)
+        : MessageBase(TAG), from(from), to(to), batch(std::move(batch)) {}
+    ~PacketBatchPass() override {}
+  };
   class Timer : public Module::MessageBase {
   public:
+    static constexpr MessageTag TAG = MessageTag::HOST_TIMER;
     std::string from;
     std::any payload;
-    Timer(std::string from, std::any payload) : from(from), payload(payload) {}
+    Timer(std::string from, std::any payload)
+        : MessageBase(TAG), from(from), payload(payload) {}
     ~Timer() override {}
   };
+  class PeriodicTimer : public Module::MessageBase {
+  public:
+    static constexpr MessageTag TAG = MessageTag::HOST_PERIODIC_TIMER;
+    UUID timer;
+    PeriodicTimer(UUID timer) : MessageBase(TAG), timer(timer) {}
+    ~PeriodicTimer() override {}
+  };
+  // rings the coalesced timers due now
+  class Timers : public Module::MessageBase {
+  public:
+    static constexpr MessageTag TAG = MessageTag::HOST_TIMERS;
+    Timers() : MessageBase(TAG) {}
+    ~Timers() override {}
+  };
 
   virtual void sendPacket(size_t portIndex, Packet &&packet) final;
+  virtual void sendPacket(size_t portIndex, PacketBatch &&batch) final;
 
 private:
   virtual void sendPacketToModule(std::optional<std::string> fromModule,
                                   std::string toModule, Packet &&packet) final;
+  virtual void sendPacketToModule(std::optional<std::string> fromModule,
+                                  std::string toModule,
+                                  PacketBatch &&batch) final;
+  virtual int selectPort(const Packet &packet) final;
 
   virtual UUID addTimer(std::string fromModule, std::any payload,
-                        Time timeAfter) final;
+                        Time timeAfter, Time slack) final;
   virtual void cancelTimer(UUID key) final;
+  virtual void ringTimers() final;
+  virtual UUID addPeriodicTimer(std::string fromModule, std::any payload,
+                                Time period) final;
+  virtual void modifyPeriodicTimer(UUID key, Time period) final;
+  virtual void armPeriodicTimer(UUID key, Module::Message tick) final;
   virtual UUID
   issueSystemCall(int pid,
                   const SystemCallInterface::SystemCallParameter &param) final;
@@ -468,6 +627,8 @@ private:
   friend HostModule::HostModule(std::string name, Host &host);
   friend HostModule::~HostModule();
   friend void HostModule::sendPacket(std::string toModule, Packet &&packet);
+  friend void HostModule::sendPacket(std::string toModule,
+                                     PacketBatch &&batch);
 
   friend SystemCallInterface::SystemCallInterface(int domain, int protocol,
                                                   Host &host);
@@ -478,8 +639,11 @@ private:
   friend int SystemCallApplication::E_Syscall(
       const SystemCallInterface::SystemCallParameter &param);
   friend void SystemCallApplication::finalizeApplication(int returnValue);
-  friend UUID TimerModule::addTimer(std::any payload, Time timeAfter);
+  friend UUID TimerModule::addTimer(std::any payload, Time timeAfter,
+                                    Time slack);
   friend void TimerModule::cancelTimer(UUID key);
+  friend UUID TimerModule::addPeriodicTimer(std::any payload, Time period);
+  friend void TimerModule::modifyPeriodicTimer(UUID key, Time period);
 };
 
 } // namespace E
@@ -32,23 +32,51 @@ private:
                                Module::MessageBase &response) final;
   virtual void messageCancelled(const ModuleID to,
                                 Module::Message message) final;
+  virtual void messagesReceivedBatch(std::vector<Delivery> &batch) final;
+  void checkQueue(const ModuleID wireID);
 
   std::ofstream pcap_file;
+  std::string pcap_filename;
   bool pcap_enabled;
+  bool pcap_rewound; // a rollback moved back in the pcap file
   Size snaplen;
   LinearDistribution rand_dist;
 
+  class State {
+  public:
+    std::unordered_map<ModuleID, Time> nextAvailable;
+    std::unordered_map<ModuleID, std::list<Packet>> outputQueue;
+    LinearDistribution rand_dist;
+    std::streampos pcap_position;
+  };
+
 protected:
   std::unordered_map<ModuleID, Time> nextAvailable;
   std::unordered_map<ModuleID, std::list<Packet>> outputQueue;
   Size bps;
   Size max_queue_length;
   virtual void packetArrived(const ModuleID inWireID, Packet &&packet) = 0;
+  // a batch from a wire; by default, each of its packets in turn
+  virtual void packetsArrived(const ModuleID inWireID, PacketBatch &&batch);
   virtual void packetSent(const ModuleID wireID, Packet &&packet) {
     (void)wireID;
     (void)packet;
   };
   virtual void sendPacket(const ModuleID wireID, Packet &&packet) final;
+  // queues the packets one by one, as the queue serializes them anyway
+  virtual void sendPacket(const ModuleID wireID, PacketBatch &&batch) final;
+
+  // queues, random state and the pcap file position; see Module::saveState
+  virtual std::any saveState(const ModuleID from) override;
+  virtual void restoreState(const ModuleID from, std::any &&state) override;
+
+  // queues and random state; the pcap file only gets what follows a restore
+  virtual bool writeCheckpoint(std::ostream &out) override;
+  virtual void readCheckpoint(std::istream &in) override;
+  virtual bool writeMessage(const MessageBase &message,
+                            std::ostream &out) override;
+  virtual Module::Message readMessage(MessageTag tag,
+                                      std::istream &in) override;
 
 public:
   Link(std::string name, NetworkSystem &system);
@@ -68,10 +96,15 @@ public:
   };
   class Message : public Module::MessageBase {
   public:
+    static constexpr MessageTag TAG = MessageTag::LINK;
     enum MessageType type;
     ModuleID wireID;
     Message(enum MessageType type, ModuleID wireID)
-        : type(type), wireID(wireID) {}
+        : MessageBase(TAG), type(type), wireID(wireID) {}
+
+    std::unique_ptr<Module::MessageBase> cloneMessage() const override {
+      return std::make_unique<Message>(type, wireID);
+    }
   };
 
   /**
@@ -29,7 +29,8 @@ public:
   /**
    * @brief Constructs a NetworkLog instance.
    *
-   * @param system System
+   * @param system System. The log level is taken from it if it is a
+   * NetworkSystem (see NetworkSystem::setNetworkLogLevel).
    */
   NetworkLog(System &system);
   /**
@@ -109,10 +110,18 @@ public:
    */
   void vprint_log(uint64_t level, const char *format, va_list args);
 
+  /**
+   * @brief Changes the log level of this instance.
+   *
+   * @param level log level
+   */
+  void setLevel(uint64_t level);
+
 public:
   /**
-   * @brief Default log level.
+   * @brief Default log level of new NetworkSystems.
    *
+   * @see NetworkSystem::setNetworkLogLevel
    */
   static uint64_t defaultLevel;
 };
@@ -12,20 +12,56 @@
 
 namespace E {
 
+class Packet;
+
 class NetworkUtil {
 private:
   NetworkUtil();
   virtual ~NetworkUtil();
 
 public:
+  /**
+   * Implementations of the one's complement sum. All of them return the same
+   * result; they only differ in how many bytes they add at once. Buffers too
+   * short to fill the vector lanes are always summed by the scalar one.
+   */
+  enum class SumKernel {
+    SCALAR, ///< 64 bits at a time. Available everywhere.
+    SSE2,   ///< 128 bits at a time. x86 only.
+    AVX2,   ///< 256 bits at a time. x86 only.
+  };
+
   /**
    * Calculate checksum once
    * @param buffer Buffer to calculate.
    * @param size Size of buffer.
    * @return Checksum
+   * @note Uses the fastest SumKernel the CPU supports, chosen on first use.
    */
   static uint16_t one_sum(const uint8_t *buffer, size_t size);
 
+  /**
+   * Calculate checksum once with the given kernel.
+   * @param buffer Buffer to calculate.
+   * @param size Size of buffer.
+   * @param kernel Kernel to use, which must be supported.
+   * @return Checksum
+   * @see sum_supported
+   */
+  static uint16_t one_sum(const uint8_t *buffer, size_t size,
+                          SumKernel kernel);
+
+  /**
+   * @param kernel Kernel to check.
+   * @return Whether this CPU can run the kernel.
+   */
+  static bool sum_supported(SumKernel kernel);
+
+  /**
+   * @return Kernel used by one_sum and tcp_sum.
+   */
+  static SumKernel sum_kernel();
+
   /**
    * Calculate TCP checksum.
    * @param source Source address (pseudo header)
@@ -38,6 +74,56 @@ public:
   static uint16_t tcp_sum(uint32_t source, uint32_t dest,
                           const uint8_t *tcp_seg, size_t length);
 
+  /**
+   * Adjust a checksum for a changed 16-bit field, without summing the data
+   * again.
+   * @param old_sum Checksum as stored, in host byte order.
+   * @param old_field Old value of the field, in host byte order.
+   * @param new_field New value of the field, in host byte order.
+   * @return Checksum to store
+   * @note See RFC 1624, equation 3. The field must be an even number of bytes
+   * from the start of the summed data.
+   */
+  static uint16_t checksum_adjust(uint16_t old_sum, uint16_t old_field,
+                                  uint16_t new_field);
+
+  /**
+   * Adjust a checksum for a changed 32-bit field, such as an address or a
+   * sequence number.
+   * @see checksum_adjust(uint16_t, uint16_t, uint16_t)
+   */
+  static uint16_t checksum_adjust(uint16_t old_sum, uint32_t old_field,
+                                  uint32_t new_field);
+
+  /**
+   * Write a 16-bit field of a packet and adjust the checksum covering it.
+   * An 8-bit field is written with the other half of its 16-bit word.
+   * @param packet Packet to change.
+   * @param sum_offset Offset of the checksum in the packet.
+   * @param field_offset Offset of the field in the packet.
+   * @param value New value of the field, in host byte order.
+   * @note Both the field and the checksum must lie within the packet; this is
+   * asserted, and without asserts nothing is written.
+   * @see checksum_adjust(uint16_t, uint16_t, uint16_t)
+   */
+  static void checksum_write(Packet &packet, size_t sum_offset,
+                             size_t field_offset, uint16_t value);
+
+  /**
+   * Write a 32-bit field of a packet and adjust the checksum covering it.
+   * @see checksum_write(Packet &, size_t, size_t, uint16_t)
+   */
+  static void checksum_write(Packet &packet, size_t sum_offset,
+                             size_t field_offset, uint32_t value);
+
+  /**
+   * Compute the checksums a sender left partial, of the IPv4 header and of a
+   * TCP segment, and clear Packet::Metadata::checksumPartial.
+   * @param packet Ethernet frame to finalize. Nothing is done unless it is
+   * partial.
+   */
+  static void checksum_finalize(Packet &packet);
+
   /**
    * Converts a uint64_t variable to std::array
    * @param N Size of array
@@ -28,6 +28,13 @@ public:
 
 protected:
   std::vector<ModuleID> ports;
+
+  // packets sent to the ports (Wire::Message and Wire::BatchMessage) can be
+  // checkpointed
+  virtual bool writeMessage(const MessageBase &message,
+                            std::ostream &out) override;
+  virtual Module::Message readMessage(MessageTag tag,
+                                      std::istream &in) override;
 };
 
 /**
@@ -37,13 +44,30 @@ protected:
  */
 class NetworkSystem : public System, private NetworkLog {
 private:
-  UUID packetUUIDStart;
-  std::unordered_set<UUID> packetUUIDSet;
-  void freePacketUUID(UUID uuid);
+  // partitions of a parallel run allocate packets concurrently
+  std::atomic<UUID> nextPacketUUID;
   UUID allocatePacketUUID();
+  uint64_t networkLogLevel;
+
+  // wire, left and right module of every added Wire
+  std::vector<std::array<ModuleID, 3>> wires;
+
+protected:
+  /**
+   * @brief Split the network at its wires.
+   * Modules joined by wires are kept close together, and wires without
+   * propagation delay are never cut. The lookahead is the smallest
+   * propagation delay among the cut wires. Wires themselves handle packets in
+   * the partition of the sending module.
+   */
+  virtual Partitioning partition(size_t partitions) override;
+
+  // packet UUIDs, besides the state of System
+  virtual void writeCheckpoint(std::ostream &out) override;
+  virtual void readCheckpoint(std::istream &in) override;
 
 public:
-  NetworkSystem();
+  NetworkSystem(EventQueueType queueType = EventQueueType::HEAP);
   virtual ~NetworkSystem();
   std::pair<std::shared_ptr<Wire>, std::pair<int, int>>
   addWire(NetworkModule &left, NetworkModule &right,
@@ -51,6 +75,24 @@ public:
           bool limit_speed = true);
 
   Size getWireSpeed(const ModuleID moduleID);
+
+  /**
+   * @brief Set the log level of the network modules (and Hosts) of this
+   * NetworkSystem. NetworkLog::defaultLevel is only the initial level of a new
+   * NetworkSystem.
+   *
+   * @param level log level (see NetworkLog::LOG_LEVEL)
+   *
+   * @note Modules take the level when they are added.
+   */
+  void setNetworkLogLevel(uint64_t level);
+
+  /**
+   * @return Log level of the network modules of this NetworkSystem.
+   */
+  uint64_t getNetworkLogLevel();
+
+  friend class Packet;
 };
 
 } // namespace E
@@ -17,27 +17,117 @@ class NetworkSystem;
 /**
  * @brief This class abstracts a packet.
  * You cannot directly allocate/deallocate Packet.
- * Also you cannot directly access the internal buffer.
- * Use access functions.
+ * Use access functions, or accessData for a header view.
  *
+ * Copies and clones share the internal buffer, which is copied only when one
+ * of them writes to it (copy-on-write). Copying a Packet is thus cheap.
+ *
+ * The buffer may hold unused room before the data (headroom) and after it
+ * (tailroom). A layer adds its header in the headroom with push, and removes
+ * it with pull, without moving the rest of the data. Offsets in writeData and
+ * readData are always relative to the current start of the data.
+ *
+ * After the bytes in its buffer, a packet may reference segments of memory
+ * it does not own, such as a payload in a send buffer (scatter-gather).
+ * Reads gather across the segments; a write, put or pull beyond the buffer
+ * copies them into it first.
+ *
+ * Each packet carries Metadata, which the Host fills from the headers when a
+ * frame arrives, so that the layers above need not parse them again.
+ *
+ * Buffers come from per-thread free lists of a few size classes, so that
+ * sending a packet does not call malloc once the lists are warm.
  */
 class Packet : public Module::MessageBase {
+public:
+  /**
+   * @brief What is known of a packet without parsing it again. The offsets
+   * are from the start of the data, and are cleared by push and pull.
+   * Copies and clones carry the metadata of their original.
+   *
+   * A sender may set checksumPartial instead of computing the IPv4 and TCP
+   * checksums, and leave them to the port.
+   * @see Host::ChecksumOffload, NetworkUtil::checksum_finalize
+   */
+  class Metadata {
+  public:
+    static constexpr uint16_t UNPARSED = 0xFFFF;
+
+    uint16_t networkOffset = UNPARSED;      ///< IPv4 header
+    uint16_t transportOffset = UNPARSED;    ///< TCP or UDP header
+    uint16_t payloadOffset = UNPARSED;      ///< after the TCP or UDP header
+    int16_t port = -1;                      ///< port of the Host it arrived at
+    uint8_t protocol = 0;                   ///< IP protocol, if parsed
+    bool checksumVerified = false;          ///< IPv4 header checksum is valid
+    bool transportChecksumVerified = false; ///< TCP checksum is valid
+    bool checksumPartial = false;           ///< checksums left to the port
+    uint32_t flowHash = 0; ///< of addresses, protocol and ports, if parsed
+  };
+
 private:
-  Packet(UUID uuid, size_t maxSize);
-  std::vector<char> buffer;
-  size_t bufferSize;
-  size_t dataSize;
+  // memory referenced after the data in the buffer, kept alive by owner
+  class Segment {
+  public:
+    std::shared_ptr<const void> owner;
+    const char *data;
+    size_t length;
+  };
 
+  // reference-counted storage, shared by copies until written; the segments
+  // are shared along with the bytes, so that Packet keeps its 3.3.0 size
+  class Buffer {
+  public:
+    std::atomic<uint32_t> references;
+    size_t capacity;
+    std::vector<Segment> segments;
+
+    char *data() { return reinterpret_cast<char *>(this + 1); }
+    static Buffer *allocate(size_t capacity);
+    static void release(Buffer *buffer);
+  };
+
+  Packet(UUID uuid, size_t maxSize, size_t headroom, bool zero);
+  Buffer *buffer;    // null if empty
   UUID packetID;
+  uint32_t head;     // offset of the data in the buffer
+  uint32_t dataSize; // bytes in the buffer; the segments follow
+
+  Metadata metadata;
 
-  static std::unordered_set<UUID> packetUUIDSet;
-  static UUID packetUUIDStart;
   static UUID allocatePacketUUID();
-  static void freePacketUUID(UUID uuid);
+
+  // makes the buffer private to this packet before a write
+  void unshare();
+
+  // moves the data and the segments to a new buffer with the given headroom
+  // and room for the data
+  void reallocate(size_t headroom, size_t bufferSize);
+
+  // copies the segments into the buffer
+  void linearize();
+
+  // forgets the offsets in the metadata, which no longer hold
+  void clearOffsets();
+
+  // calls copy(bytes, length) for each piece of the given range
+  template <typename Copy>
+  size_t gather(size_t offset, size_t length, Copy &&copy) const;
+
+  char *data() { return buffer->data() + head; }
+  const char *data() const { return buffer->data() + head; }
+
+  // from the data to the end of the buffer
+  size_t bufferSize() const {
+    return buffer != nullptr ? buffer->capacity - head : 0;
+  }
+  bool hasSegments() const {
+    return buffer != nullptr && !buffer->segments.empty();
+  }
 
 public:
   /**
    * Copy constructor. (Copied packet has same UUID)
+   * The buffer is shared until either packet is written.
    * @param other Packet to copy.
    */
   Packet(const Packet &other);
@@ -65,10 +155,27 @@ public:
    */
   Packet(size_t maxSize);
 
+  /**
+   * @param maxSize Maximum packet size, not counting the headroom.
+   * @param headroom Room reserved before the data, for push.
+   */
+  Packet(size_t maxSize, size_t headroom);
+
+  /**
+   * @brief Allocate a packet without zeroing its buffer.
+   * The contents are undefined until written, so this is only for writers
+   * which overwrite the whole packet, such as a frame copied in at once.
+   * @param maxSize Maximum packet size, not counting the headroom.
+   * @param headroom Room reserved before the data, for push.
+   * @return New packet, with a new UUID.
+   */
+  static Packet uninitialized(size_t maxSize, size_t headroom = 0);
+
   ~Packet() override;
 
   /**
    * Clone packet (Cloned packet has a different UUID)
+   * The buffer is shared until either packet is written.
    * @return Cloned packet.
    */
   Packet clone() const;
@@ -90,6 +197,61 @@ public:
    */
   size_t readData(size_t offset, void *data, size_t length) const;
 
+  /**
+   * @param offset Start read skipping first n bytes of the packet.
+   * @param out Stream to write the packet content to.
+   * @param length Length of data to be written.
+   * @return Actual written bytes.
+   */
+  size_t readData(size_t offset, std::ostream &out, size_t length) const;
+
+  /**
+   * @brief Direct access to a range of the packet, for header views.
+   * The range is copied into the buffer first if it reaches into a segment,
+   * and the buffer stops being shared with copies of the packet.
+   * @param offset Start of the range.
+   * @param length Length of the range.
+   * @return Start of the range, or nullptr if the packet is too short.
+   * The pointer is valid until the size or the headroom changes.
+   * @see E_HeaderView.hpp
+   */
+  uint8_t *accessData(size_t offset, size_t length);
+
+  /**
+   * @brief Direct read-only access to a range of the packet.
+   * @param offset Start of the range.
+   * @param length Length of the range.
+   * @return Start of the range, or nullptr if the packet is too short or
+   * the range is not contiguous (spans segments).
+   */
+  const uint8_t *accessData(size_t offset, size_t length) const;
+
+  /**
+   * @brief Append memory to the packet without copying it.
+   * The memory must not change while the packet or a copy of it refers to
+   * it; owner keeps it alive until then.
+   * @param owner Owner of the memory, such as a shared send buffer.
+   * @param data Start of the memory.
+   * @param length Length of the memory.
+   */
+  void appendSegment(std::shared_ptr<const void> owner, const void *data,
+                     size_t length);
+
+  /**
+   * @return Number of segments referenced after the buffer.
+   */
+  size_t getSegmentCount() const;
+
+  /**
+   * @return Metadata of this packet, to be read or annotated.
+   */
+  Metadata &getMetadata();
+
+  /**
+   * @return Metadata of this packet.
+   */
+  const Metadata &getMetadata() const;
+
   /**
    * @brief Change the size of this Packet
    * The size cannot be larger than the internal buffer.
@@ -103,8 +265,60 @@ public:
    */
   size_t getSize() const;
 
+  /**
+   * @brief Prepend room for a header to the data.
+   * The buffer is reallocated if the headroom is smaller than length.
+   * The new bytes keep what the buffer held before (zero in a new packet).
+   * @param length Length of the header.
+   */
+  void push(size_t length);
+
+  /**
+   * @brief Remove a header from the start of the data.
+   * The removed bytes become headroom.
+   * @param length Length of the header.
+   * @return Actual removed bytes.
+   */
+  size_t pull(size_t length);
+
+  /**
+   * @brief Append room to the end of the data.
+   * The buffer is reallocated if the tailroom is smaller than length.
+   * @param length Length to append.
+   */
+  void put(size_t length);
+
+  /**
+   * @brief Remove bytes from the end of the data.
+   * The removed bytes become tailroom.
+   * @param length Length to remove.
+   * @return Actual removed bytes.
+   */
+  size_t trim(size_t length);
+
+  /**
+   * @return Room before the data, available to push without reallocation.
+   */
+  size_t getHeadroom() const;
+
+  /**
+   * @return Room after the data, available to put without reallocation.
+   */
+  size_t getTailroom() const;
+
   void clearContext();
 
+  /**
+   * @brief Write this packet, with its UUID, to a checkpoint.
+   * @see System::checkpoint
+   */
+  void writePacket(std::ostream &out) const;
+
+  /**
+   * @return Packet written by writePacket.
+   */
+  static Packet readPacket(std::istream &in);
+
   friend class NetworkSystem;
 };
 
@@ -0,0 +1,64 @@
+/**
+ * @file   E_PacketBatch.hpp
+ * @brief  Header for E::PacketBatch
+ */
+
+#ifndef E_PACKETBATCH_HPP_
+#define E_PACKETBATCH_HPP_
+
+#include <E/E_Common.hpp>
+#include <E/Networking/E_Packet.hpp>
+
+namespace E {
+
+/**
+ * @brief PacketBatch is a burst of packets which travel together, as one
+ * event per hop instead of one per packet.
+ *
+ * A Wire still serializes the packets of a batch one after another. It
+ * delivers each packet at the time it would have arrived if sent alone, so
+ * packets arriving at the same time are delivered together, and a batch
+ * leaves a speed-limited wire packet by packet. A Link forwards the packets
+ * of a batch one by one, through its output queues.
+ *
+ * @see HostModule::sendPacket
+ */
+class PacketBatch {
+private:
+  std::vector<Packet> packets;
+
+public:
+  PacketBatch() = default;
+
+  /**
+   * @param packet Packet to be sent after those already in the batch.
+   */
+  void add(Packet &&packet) { packets.push_back(std::move(packet)); }
+
+  size_t size() const { return packets.size(); }
+  bool empty() const { return packets.empty(); }
+  void clear() { packets.clear(); }
+
+  Packet &operator[](size_t index) { return packets[index]; }
+  const Packet &operator[](size_t index) const { return packets[index]; }
+
+  std::vector<Packet>::iterator begin() { return packets.begin(); }
+  std::vector<Packet>::iterator end() { return packets.end(); }
+  std::vector<Packet>::const_iterator begin() const { return packets.begin(); }
+  std::vector<Packet>::const_iterator end() const { return packets.end(); }
+
+  /**
+   * @brief Write the packets of this batch to a checkpoint.
+   * @see Packet::writePacket
+   */
+  void writeBatch(std::ostream &out) const;
+
+  /**
+   * @return Batch written by writeBatch.
+   */
+  static PacketBatch readBatch(std::istream &in);
+};
+
+} // namespace E
+
+#endif /* E_PACKETBATCH_HPP_ */
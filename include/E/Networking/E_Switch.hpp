@@ -24,6 +24,10 @@ private:
 
 protected:
   virtual void packetArrived(const ModuleID inWireID, Packet &&packet);
+  virtual std::any saveState(const ModuleID from) override;
+  virtual void restoreState(const ModuleID from, std::any &&state) override;
+  virtual bool writeCheckpoint(std::ostream &out) override;
+  virtual void readCheckpoint(std::istream &in) override;
 
 public:
   Switch(std::string name, NetworkSystem &system, bool unreliable = false);
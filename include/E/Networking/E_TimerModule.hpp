@@ -59,7 +59,8 @@ protected:
   /**
    * @brief Cancel the timer request.
    *
-   * @param key Unique ID that indicates the timer request.
+   * @param key Unique ID that indicates the timer request. A periodic timer
+   * may cancel itself in its timerCallback.
    *
    * @note You cannot override this function.
    * There is no Module::messageCancelled here, so be sure that
@@ -69,6 +70,62 @@ protected:
    */
   virtual void cancelTimer(UUID key) final;
 
+  /**
+   * @brief Request an alarm that rings after specified time, give or take a
+   * slack.
+   *
+   * @param payload Metadata you needed. Can be null.
+   * @param timeAfter Specify when the alarm will ring.
+   * @param slack The alarm may ring up to slack later than timeAfter, so that
+   * the Host can ring it together with other alarms due around then (like the
+   * timer slack of Linux). Zero rings it exactly on time.
+   * @return Unique ID that indicates the timer request.
+   */
+  UUID addTimer(std::any payload, Time timeAfter, Time slack);
+
+  /**
+   * @brief Request an alarm that rings every period, until cancelled. The
+   * Host keeps one message for it and sends it again after every ring.
+   *
+   * @param payload Metadata you needed, given to every timerCallback.
+   * @param period Time between the rings, the first one included.
+   * @return Unique ID that indicates the timer request.
+   *
+   * @see cancelTimer, modifyPeriodicTimer
+   */
+  UUID addPeriodicTimer(std::any payload, Time period);
+
+  /**
+   * @brief Change the period of a periodic timer. It rings next after the
+   * new period, counted from now.
+   *
+   * @param key Unique ID returned by addPeriodicTimer.
+   * @param period New time between the rings.
+   */
+  void modifyPeriodicTimer(UUID key, Time period);
+
+  /**
+   * @brief Write the payload of a pending timer to a checkpoint (see
+   * System::checkpoint). A payload pointing to this module writes nothing.
+   *
+   * @param payload Payload given to addTimer.
+   * @return false if the payload cannot be checkpointed (default).
+   */
+  virtual bool writeTimerPayload(const std::any &payload, std::ostream &out) {
+    (void)payload;
+    (void)out;
+    return false;
+  }
+
+  /**
+   * @return Payload written by writeTimerPayload.
+   */
+  virtual std::any readTimerPayload(std::istream &in) {
+    (void)in;
+    assert(0);
+    return {};
+  }
+
   friend class Host;
 };
 
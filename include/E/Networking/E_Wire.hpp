@@ -12,6 +12,7 @@
 #include <E/E_Module.hpp>
 #include <E/Networking/E_NetworkLog.hpp>
 #include <E/Networking/E_Packet.hpp>
+#include <E/Networking/E_PacketBatch.hpp>
 
 namespace E {
 class NetworkSystem;
@@ -69,6 +70,12 @@ public:
    */
   virtual void setPropagationDelay(Time delay) final;
 
+  /**
+   * @return Get propagation delay.
+   * @note You cannot override this function.
+   */
+  virtual Time getPropagationDelay() final;
+
   enum MessageType {
     PACKET_TO_PORT,
     PACKET_FROM_PORT,
@@ -76,24 +83,70 @@ public:
 
   class Message : public Module::MessageBase {
   public:
+    static constexpr MessageTag TAG = MessageTag::WIRE;
     enum MessageType type;
     Packet packet;
 
     Message(enum MessageType type, Packet &&packet)
-        : type(type), packet(packet) {}
+        : MessageBase(TAG), type(type), packet(std::move(packet)) {}
 
     ~Message() override = default;
+
+    std::unique_ptr<Module::MessageBase> cloneMessage() const override {
+      return std::make_unique<Message>(type, Packet(packet));
+    }
+
+    // see Module::writeMessage; every sender of packets uses these
+    void writeMessage(std::ostream &out) const;
+    static std::unique_ptr<Message> readMessage(std::istream &in);
+  };
+
+  /**
+   * @brief Packets sent through the Wire as one event (see PacketBatch).
+   */
+  class BatchMessage : public Module::MessageBase {
+  public:
+    static constexpr MessageTag TAG = MessageTag::WIRE_BATCH;
+    enum MessageType type;
+    PacketBatch batch;
+
+    BatchMessage(enum MessageType type, PacketBatch &&batch)
+        : MessageBase(TAG), type(type), batch(std::move(batch)) {}
+
+    ~BatchMessage() override = default;
+
+    std::unique_ptr<Module::MessageBase> cloneMessage() const override {
+      return std::make_unique<BatchMessage>(type, PacketBatch(batch));
+    }
+
+    void writeMessage(std::ostream &out) const;
+    static std::unique_ptr<BatchMessage> readMessage(std::istream &in);
   };
 
   virtual Time nextSendAvailable(const ModuleID me) final;
 
 private:
+  // reserves the wire for a packet of the given size, and returns the delay
+  // until it has arrived at the destination
+  Time transmit(int destination, Size size);
+
   virtual Module::Message messageReceived(const ModuleID from,
                                           Module::MessageBase &message) final;
   virtual void messageFinished(const ModuleID to, Module::Message message,
                                Module::MessageBase &response) final;
   virtual void messageCancelled(const ModuleID to,
                                 Module::Message message) final;
+
+  // only the direction used by the sender is saved, since the other one
+  // may be used by another partition at the same time
+  virtual std::any saveState(const ModuleID from) final;
+  virtual void restoreState(const ModuleID from, std::any &&state) final;
+
+  virtual bool writeCheckpoint(std::ostream &out) final;
+  virtual void readCheckpoint(std::istream &in) final;
+  virtual bool writeMessage(const MessageBase &message,
+                            std::ostream &out) final;
+  virtual Module::Message readMessage(MessageTag tag, std::istream &in) final;
 };
 
 } // namespace E
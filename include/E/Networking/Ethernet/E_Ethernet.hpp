@@ -18,8 +18,17 @@ public:
   Ethernet(Host &host);
   virtual ~Ethernet();
 
+private:
+  // handles a packet, and returns the module to pass it to, if any
+  std::optional<std::string> forward(std::string fromModule, Packet &packet);
+
 protected:
   virtual void packetArrived(std::string fromModule, Packet &&packet) final;
+  virtual void packetsArrived(std::string fromModule,
+                              PacketBatch &&batch) final;
+  // stateless
+  virtual bool writeCheckpoint(std::ostream &out) final { return true; }
+  virtual void readCheckpoint(std::istream &in) final {}
 };
 
 } // namespace E
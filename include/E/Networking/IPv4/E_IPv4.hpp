@@ -21,8 +21,16 @@ public:
   IPv4(Host &host);
   virtual ~IPv4();
 
+private:
+  // handles a packet, and returns the module to pass it to, if any
+  std::optional<std::string> forward(std::string fromModule, Packet &packet);
+
 protected:
   virtual void packetArrived(std::string fromModule, Packet &&packet) final;
+  virtual void packetsArrived(std::string fromModule,
+                              PacketBatch &&batch) final;
+  virtual bool writeCheckpoint(std::ostream &out) final;
+  virtual void readCheckpoint(std::istream &in) final;
 };
 
 } // namespace E
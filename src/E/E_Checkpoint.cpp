@@ -0,0 +1,23 @@
+/*
+ * E_Checkpoint.cpp
+ */
+
+#include <E/E_Checkpoint.hpp>
+
+namespace E {
+
+void Checkpoint::write(std::ostream &out, const std::string &value) {
+  write(out, (uint64_t)value.size());
+  out.write(value.data(), value.size());
+}
+
+std::string Checkpoint::readString(std::istream &in) {
+  uint64_t size = read<uint64_t>(in);
+  if (!in)
+    return {};
+  std::string value(size, '\0');
+  in.read(value.data(), size);
+  return value;
+}
+
+} // namespace E
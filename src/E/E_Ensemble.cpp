@@ -0,0 +1,51 @@
+/*
+ * E_Ensemble.cpp
+ */
+
+#include <E/E_Ensemble.hpp>
+
+#include <chrono>
+
+namespace E {
+
+Ensemble::Ensemble(size_t threads) : threads(threads), seconds(0) {
+  if (this->threads == 0)
+    this->threads = std::max(1U, std::thread::hardware_concurrency());
+}
+
+std::vector<Ensemble::Result> Ensemble::run(size_t count, const Run &run) {
+  using Clock = std::chrono::steady_clock;
+  std::vector<Result> results(count);
+  std::atomic<size_t> next(0);
+
+  auto work = [&](size_t worker) {
+    while (true) {
+      size_t index = next++;
+      if (index >= count)
+        break;
+      auto start = Clock::now();
+      std::any value = run(index);
+      auto end = Clock::now();
+      results[index] = {index, std::move(value),
+                        std::chrono::duration<Real>(end - start).count(),
+                        worker};
+    }
+  };
+
+  auto start = Clock::now();
+  std::vector<std::thread> workers;
+  for (size_t k = 1; k < std::min(threads, count); k++)
+    workers.emplace_back(work, k);
+  work(0);
+  for (auto &worker : workers)
+    worker.join();
+  seconds = std::chrono::duration<Real>(Clock::now() - start).count();
+
+  return results;
+}
+
+Real Ensemble::getSeconds() { return seconds; }
+
+size_t Ensemble::getThreadCount() { return threads; }
+
+} // namespace E
@@ -0,0 +1,247 @@
+/*
+ * E_EventQueue.cpp
+ */
+
+#include <E/E_EventQueue.hpp>
+
+namespace E {
+
+std::unique_ptr<EventQueue> EventQueue::create(EventQueueType type) {
+  switch (type) {
+  case EventQueueType::HEAP:
+    return std::make_unique<HeapEventQueue>();
+  case EventQueueType::CALENDAR:
+    return std::make_unique<CalendarEventQueue>();
+  }
+  assert(0);
+  return nullptr;
+}
+
+void HeapEventQueue::place(size_t index, const Entry &entry) {
+  heap[index] = entry;
+  position[entry.slot] = index;
+}
+
+void HeapEventQueue::siftUp(size_t index) {
+  Entry entry = heap[index];
+  while (index > 0) {
+    size_t parent = (index - 1) / ARITY;
+    if (!(entry < heap[parent]))
+      break;
+    place(index, heap[parent]);
+    index = parent;
+  }
+  place(index, entry);
+}
+
+void HeapEventQueue::siftDown(size_t index) {
+  Entry entry = heap[index];
+  while (true) {
+    size_t first = index * ARITY + 1;
+    if (first >= heap.size())
+      break;
+    size_t last = std::min(first + ARITY, heap.size());
+    size_t smallest = first;
+    for (size_t child = first + 1; child < last; child++) {
+      if (heap[child] < heap[smallest])
+        smallest = child;
+    }
+    if (!(heap[smallest] < entry))
+      break;
+    place(index, heap[smallest]);
+    index = smallest;
+  }
+  place(index, entry);
+}
+
+void HeapEventQueue::removeAt(size_t index) {
+  assert(index < heap.size());
+  Entry last = heap.back();
+  heap.pop_back();
+  if (index == heap.size())
+    return;
+  place(index, last);
+  if (index > 0 && last < heap[(index - 1) / ARITY])
+    siftUp(index);
+  else
+    siftDown(index);
+}
+
+void HeapEventQueue::push(const Entry &entry) {
+  if (entry.slot >= position.size())
+    position.resize(entry.slot + 1);
+  heap.push_back(entry);
+  siftUp(heap.size() - 1);
+}
+
+const EventQueue::Entry &HeapEventQueue::top() {
+  assert(!heap.empty());
+  return heap.front();
+}
+
+void HeapEventQueue::pop() { removeAt(0); }
+
+void HeapEventQueue::remove(const Entry &entry) {
+  assert(entry.slot < position.size());
+  size_t index = position[entry.slot];
+  assert(index < heap.size() && heap[index].slot == entry.slot);
+  removeAt(index);
+}
+
+bool HeapEventQueue::empty() const { return heap.empty(); }
+
+size_t HeapEventQueue::size() const { return heap.size(); }
+
+// Brown's parameters: start with two buckets, resize when the population
+// crosses twice/half the number of buckets, and estimate the bucket width
+// from the separation of (at most) 25 events at the head of the queue.
+static constexpr size_t CALENDAR_MIN_BUCKETS = 2;
+static constexpr size_t CALENDAR_SAMPLE = 25;
+static constexpr Time CALENDAR_INITIAL_WIDTH = 1000; // 1 usec
+
+CalendarEventQueue::CalendarEventQueue()
+    : buckets(CALENDAR_MIN_BUCKETS), width(CALENDAR_INITIAL_WIDTH), count(0),
+      lastBucket(0), bucketTop(CALENDAR_INITIAL_WIDTH), lastWakeup(0) {}
+
+size_t CalendarEventQueue::bucketOf(Time wakeup) const {
+  // the number of buckets is always a power of two
+  return (wakeup / width) & (buckets.size() - 1);
+}
+
+void CalendarEventQueue::push(const Entry &entry) {
+  if (entry.wakeup < lastWakeup) {
+    // put back by a rollback; resume the scan from there
+    lastWakeup = entry.wakeup;
+    lastBucket = bucketOf(lastWakeup);
+    bucketTop = (lastWakeup / width + 1) * width;
+  }
+  std::deque<Entry> &bucket = buckets[bucketOf(entry.wakeup)];
+  if (bucket.empty() || bucket.back() < entry)
+    bucket.push_back(entry);
+  else
+    bucket.insert(std::upper_bound(bucket.begin(), bucket.end(), entry),
+                  entry);
+  count++;
+  current.reset();
+
+  if (count > 2 * buckets.size())
+    resize(2 * buckets.size());
+}
+
+void CalendarEventQueue::findNext() {
+  assert(count > 0);
+  if (current)
+    return;
+
+  size_t index = lastBucket;
+  Time top = bucketTop;
+  for (size_t k = 0; k < buckets.size(); k++) {
+    const std::deque<Entry> &bucket = buckets[index];
+    if (!bucket.empty() && bucket.front().wakeup < top) {
+      current = index;
+      return;
+    }
+    index = (index + 1) & (buckets.size() - 1);
+    top += width;
+  }
+
+  // Nothing in this year. Fall back to a direct search.
+  const Entry *earliest = nullptr;
+  for (size_t k = 0; k < buckets.size(); k++) {
+    if (!buckets[k].empty() &&
+        (earliest == nullptr || buckets[k].front() < *earliest)) {
+      earliest = &buckets[k].front();
+      current = k;
+    }
+  }
+  assert(earliest);
+}
+
+const EventQueue::Entry &CalendarEventQueue::top() {
+  findNext();
+  return buckets[*current].front();
+}
+
+void CalendarEventQueue::pop() {
+  findNext();
+  std::deque<Entry> &bucket = buckets[*current];
+  lastWakeup = bucket.front().wakeup;
+  lastBucket = *current;
+  bucketTop = (lastWakeup / width + 1) * width;
+  bucket.pop_front();
+  count--;
+  current.reset();
+
+  if (buckets.size() > CALENDAR_MIN_BUCKETS && count < buckets.size() / 2)
+    resize(buckets.size() / 2);
+}
+
+void CalendarEventQueue::remove(const Entry &entry) {
+  std::deque<Entry> &bucket = buckets[bucketOf(entry.wakeup)];
+  auto iter = std::lower_bound(bucket.begin(), bucket.end(), entry);
+  assert(iter != bucket.end() && iter->slot == entry.slot);
+  bucket.erase(iter);
+  count--;
+  current.reset();
+
+  if (buckets.size() > CALENDAR_MIN_BUCKETS && count < buckets.size() / 2)
+    resize(buckets.size() / 2);
+}
+
+bool CalendarEventQueue::empty() const { return count == 0; }
+
+size_t CalendarEventQueue::size() const { return count; }
+
+Time CalendarEventQueue::estimateWidth() const {
+  std::vector<Entry> sample;
+  sample.reserve(count);
+  for (const auto &bucket : buckets)
+    sample.insert(sample.end(), bucket.begin(), bucket.end());
+
+  size_t n = std::min(sample.size(), CALENDAR_SAMPLE);
+  if (n < 2)
+    return width;
+  std::partial_sort(sample.begin(), sample.begin() + n, sample.end());
+
+  Time total = sample[n - 1].wakeup - sample[0].wakeup;
+  Real average = (Real)total / (n - 1);
+
+  // ignore unusually large separations
+  Time trimmed = 0;
+  size_t trimmedCount = 0;
+  for (size_t k = 1; k < n; k++) {
+    Time separation = sample[k].wakeup - sample[k - 1].wakeup;
+    if (separation <= 2 * average) {
+      trimmed += separation;
+      trimmedCount++;
+    }
+  }
+  if (trimmedCount == 0 || trimmed == 0)
+    return width;
+
+  return std::max<Time>(1, 3 * trimmed / trimmedCount);
+}
+
+void CalendarEventQueue::resize(size_t newSize) {
+  Time newWidth = estimateWidth();
+  std::vector<std::deque<Entry>> old = std::move(buckets);
+
+  buckets = std::vector<std::deque<Entry>>(newSize);
+  width = newWidth;
+  for (auto &bucket : old) {
+    for (const Entry &entry : bucket) {
+      std::deque<Entry> &target = buckets[bucketOf(entry.wakeup)];
+      if (target.empty() || target.back() < entry)
+        target.push_back(entry);
+      else
+        target.insert(std::upper_bound(target.begin(), target.end(), entry),
+                      entry);
+    }
+  }
+
+  lastBucket = bucketOf(lastWakeup);
+  bucketTop = (lastWakeup / width + 1) * width;
+  current.reset();
+}
+
+} // namespace E
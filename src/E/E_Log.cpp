@@ -20,6 +20,8 @@ Log::Log() { this->level = defaultLevel; }
 Log::Log(int level) { this->level = level; }
 Log::~Log() {}
 
+void Log::setLevel(int level) { this->level = level; }
+
 void Log::print_log(int level, const char *format, ...) {
   if (level > this->level)
     return;
@@ -14,7 +14,71 @@
 
 namespace E {
 
-Module::Module(System &system) : system(system), id(0) {}
+namespace {
+// Free blocks of MessageBase::operator new, by size in GRANULE units. A
+// message may be freed by another thread than the one which allocated it, so
+// each list is capped and the rest goes back to the heap.
+class MessagePool {
+public:
+  static constexpr size_t GRANULE = 16;
+  static constexpr size_t CLASSES = Module::MessageBase::MAX_POOLED / GRANULE;
+  static constexpr size_t MAX_FREE = 4096;
+
+  class Block {
+  public:
+    Block *next;
+  };
+
+  std::array<Block *, CLASSES> free = {};
+  std::array<size_t, CLASSES> count = {};
+
+  ~MessagePool();
+};
+
+thread_local MessagePool pool;
+thread_local bool poolDestroyed = false; // messages freed at thread exit
+
+MessagePool::~MessagePool() {
+  for (Block *block : free) {
+    while (block != nullptr) {
+      Block *next = block->next;
+      ::operator delete(block);
+      block = next;
+    }
+  }
+  poolDestroyed = true;
+}
+} // namespace
+
+void *Module::MessageBase::operator new(size_t size) {
+  const size_t index = (size + MessagePool::GRANULE - 1) / MessagePool::GRANULE;
+  if (index == 0 || index > MessagePool::CLASSES)
+    return ::operator new(size);
+  // always the whole class, as delete may file it in a live pool
+  if (poolDestroyed || pool.free[index - 1] == nullptr)
+    return ::operator new(index * MessagePool::GRANULE);
+  MessagePool::Block *&head = pool.free[index - 1];
+  MessagePool::Block *block = head;
+  head = block->next;
+  pool.count[index - 1]--;
+  return block;
+}
+
+void Module::MessageBase::operator delete(void *ptr, size_t size) {
+  const size_t index = (size + MessagePool::GRANULE - 1) / MessagePool::GRANULE;
+  if (index == 0 || index > MessagePool::CLASSES || poolDestroyed ||
+      pool.count[index - 1] == MessagePool::MAX_FREE) {
+    ::operator delete(ptr);
+    return;
+  }
+  MessagePool::Block *block = static_cast<MessagePool::Block *>(ptr);
+  block->next = pool.free[index - 1];
+  pool.free[index - 1] = block;
+  pool.count[index - 1]++;
+}
+
+Module::Module(System &system)
+    : system(system), id(0), batchDelivery(false) {}
 
 Module::~Module() {}
 
@@ -31,6 +95,28 @@ UUID Module::sendMessageSelf(Module::Message message, Time timeAfter) {
   return sendMessage(id, std::move(message), timeAfter);
 }
 
+UUID Module::postMessage(const ModuleID to, Module::Message message,
+                         Time timeAfter) {
+  message->oneWay = true;
+  return sendMessage(to, std::move(message), timeAfter);
+}
+
+UUID Module::postMessageSelf(Module::Message message, Time timeAfter) {
+  return postMessage(id, std::move(message), timeAfter);
+}
+
+bool Module::writeMessage(const MessageBase &message, std::ostream &out) {
+  (void)out;
+  return message.getTag() == EmptyMessage::TAG;
+}
+
+Module::Message Module::readMessage(MessageTag tag, std::istream &in) {
+  (void)in;
+  if (tag == EmptyMessage::TAG)
+    return std::make_unique<EmptyMessage>();
+  return nullptr;
+}
+
 std::string Module::getModuleName() {
 
   const char *type_name = typeid(*this).name();
@@ -0,0 +1,170 @@
+/*
+ * E_Profiler.cpp
+ */
+
+#include <E/E_Profiler.hpp>
+
+#ifdef HAVE_DEMANGLE
+#include <cxxabi.h>
+#endif
+
+namespace E {
+
+Profiler::Profiler()
+    : sampleInterval(1), events(0), maxDepth(0), runs(0), simulated(0),
+      nsec(0) {}
+
+void Profiler::record(ModuleID module, const std::type_info &type,
+                      Callback callback, uint64_t spent) {
+  Counter &counter = counters[module][std::type_index(type)];
+  counter.calls[callback]++;
+  counter.nsec[callback] += spent;
+}
+
+uint64_t Profiler::lap(ModuleID module, const std::type_info &type,
+                       Callback callback, uint64_t since) {
+  uint64_t until = now();
+  record(module, type, callback, until - since);
+  return until;
+}
+
+void Profiler::dispatched(Time time, Size depth) {
+  maxDepth = std::max(maxDepth, depth);
+  if (events++ % sampleInterval != 0)
+    return;
+  samples.push_back({time, depth});
+  if (samples.size() == MAX_SAMPLES) {
+    for (Size k = 0; k < MAX_SAMPLES / 2; k++)
+      samples[k] = samples[k * 2];
+    samples.resize(MAX_SAMPLES / 2);
+    sampleInterval *= 2;
+  }
+}
+
+void Profiler::merge(Profiler &other) {
+  for (auto &[module, types] : other.counters) {
+    for (auto &[type, counter] : types) {
+      Counter &total = counters[module][type];
+      for (int k = 0; k < CALLBACKS; k++) {
+        total.calls[k] += counter.calls[k];
+        total.nsec[k] += counter.nsec[k];
+      }
+    }
+  }
+  // samples of each partition, at its own pace
+  samples.insert(samples.end(), other.samples.begin(), other.samples.end());
+  std::stable_sort(
+      samples.begin(), samples.end(),
+      [](const Sample &a, const Sample &b) { return a.time < b.time; });
+  events += other.events;
+  maxDepth = std::max(maxDepth, other.maxDepth);
+
+  other.counters.clear();
+  other.samples.clear();
+  other.sampleInterval = 1;
+  other.events = 0;
+  other.maxDepth = 0;
+}
+
+void Profiler::addRun(Time simulated, uint64_t nsec) {
+  runs++;
+  this->simulated += simulated;
+  this->nsec += nsec;
+}
+
+Profiler::Counter Profiler::getCounter(ModuleID module,
+                                       const std::type_info &type) const {
+  auto types = counters.find(module);
+  if (types == counters.end())
+    return Counter();
+  auto iter = types->second.find(std::type_index(type));
+  if (iter == types->second.end())
+    return Counter();
+  return iter->second;
+}
+
+Size Profiler::getEvents() const { return events; }
+
+Size Profiler::getRuns() const { return runs; }
+
+Size Profiler::getMaxDepth() const { return maxDepth; }
+
+const std::vector<Profiler::Sample> &Profiler::getSamples() const {
+  return samples;
+}
+
+static std::string typeName(const std::type_index &type) {
+#ifdef HAVE_DEMANGLE
+  auto ptr = std::unique_ptr<char, decltype(&std::free)>{
+      abi::__cxa_demangle(type.name(), nullptr, nullptr, nullptr), std::free};
+  if (ptr != nullptr)
+    return ptr.get();
+#endif
+  return type.name();
+}
+
+static std::string quote(const std::string &text) {
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\')
+      quoted += '\\';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+void Profiler::writeJSON(
+    std::ostream &out,
+    const std::function<std::string(ModuleID)> &name) const {
+  static const char *CALLBACK_NAME[CALLBACKS] = {"received", "finished",
+                                                 "cancelled"};
+  const Real seconds = nsec / 1e9;
+
+  // modules by the time spent in their handlers
+  std::vector<std::pair<ModuleID, uint64_t>> modules;
+  for (auto &[module, types] : counters) {
+    modules.push_back({module, 0});
+    for (auto &[type, counter] : types)
+      for (int k = 0; k < CALLBACKS; k++)
+        modules.back().second += counter.nsec[k];
+  }
+  std::stable_sort(modules.begin(), modules.end(),
+                   [](auto &a, auto &b) { return a.second > b.second; });
+
+  out << "{\n";
+  out << "  \"runs\": " << runs << ",\n";
+  out << "  \"events\": " << events << ",\n";
+  out << "  \"wallSeconds\": " << seconds << ",\n";
+  out << "  \"simulatedSeconds\": " << simulated / 1e9 << ",\n";
+  out << "  \"eventsPerWallSecond\": " << (nsec > 0 ? events / seconds : 0)
+      << ",\n";
+  out << "  \"simulatedPerWall\": "
+      << (nsec > 0 ? (Real)simulated / nsec : 0) << ",\n";
+  out << "  \"queue\": {\"maxDepth\": " << maxDepth << ", \"samples\": [";
+  for (Size k = 0; k < samples.size(); k++)
+    out << (k > 0 ? ", " : "") << "[" << samples[k].time << ", "
+        << samples[k].depth << "]";
+  out << "]},\n";
+
+  out << "  \"modules\": [";
+  for (Size m = 0; m < modules.size(); m++) {
+    const ModuleID module = modules[m].first;
+    out << (m > 0 ? "," : "") << "\n    {\"id\": " << module
+        << ", \"module\": " << quote(name(module))
+        << ", \"nsec\": " << modules[m].second << ", \"messages\": [";
+    bool first = true;
+    for (auto &[type, counter] : counters.at(module)) {
+      out << (first ? "" : ",") << "\n      {\"type\": "
+          << quote(typeName(type));
+      for (int k = 0; k < CALLBACKS; k++)
+        out << ", \"" << CALLBACK_NAME[k] << "\": {\"calls\": "
+            << counter.calls[k] << ", \"nsec\": " << counter.nsec[k] << "}";
+      out << "}";
+      first = false;
+    }
+    out << "]}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+} // namespace E
@@ -5,6 +5,7 @@
  *      Author: Keunhong Lee
  */
 
+#include <E/E_Checkpoint.hpp>
 #include <E/E_Common.hpp>
 #include <E/E_RandomDistribution.hpp>
 
@@ -36,6 +37,17 @@ std::list<Real> RandomDistribution::distribute(Size count, Real total) {
   return ret;
 }
 
+void RandomDistribution::writeState(std::ostream &out) const {
+  std::ostringstream state;
+  state << engine;
+  Checkpoint::write(out, state.str());
+}
+
+void RandomDistribution::readState(std::istream &in) {
+  std::istringstream state(Checkpoint::readString(in));
+  state >> engine;
+}
+
 UniformDistribution::UniformDistribution() : RandomDistribution() {}
 
 UniformDistribution::UniformDistribution(UUID seed)
@@ -74,6 +86,10 @@ Real ExpDistribution::nextDistribution(Real min, Real max) {
   return std::min(min + (-log(dist(engine)) / lambda), max);
 }
 
+LinearDistribution::LinearDistribution() : RandomDistribution() {}
+
+LinearDistribution::LinearDistribution(UUID seed) : RandomDistribution(seed) {}
+
 Real LinearDistribution::nextDistribution(Real min, Real max) {
   std::uniform_real_distribution<Real> dist(0, 1);
   Real uniform = dist(engine);
@@ -5,184 +5,865 @@
  *      Author: Keunhong Lee
  */
 
+#include <E/E_Checkpoint.hpp>
 #include <E/E_Module.hpp>
 #include <E/E_System.hpp>
 
+#include <fstream>
+#include <sys/mman.h>
+
 namespace E {
 class Module;
 
-System::System() {
-  currentTime = 0;
-  this->currentID = 0;
+// UUID of a pending message: generation (32) | scheduler (8) | slot (24)
+static constexpr int SLOT_BITS = 24;
+static constexpr uint32_t SLOT_MASK = (1U << SLOT_BITS) - 1;
+static constexpr size_t MAX_SCHEDULERS = 1U << (32 - SLOT_BITS);
+
+// sequence numbers given during a parallel window, until the merge
+static constexpr UUID PROVISIONAL = 1ULL << 63;
+
+thread_local System::Scheduler *System::active = nullptr;
+thread_local System *System::running = nullptr;
+
+// Fiber stacks are recycled, since applications come and go all the time.
+// Each stack has a guard page below it.
+static constexpr size_t FIBER_STACK_SIZE = 256 * 1024;
+static constexpr size_t FIBER_GUARD_SIZE = 4096;
+static std::vector<void *> fiberStacks;
+static std::mutex fiberStackMutex;
+
+static void *allocateFiberStack() {
+  {
+    std::lock_guard<std::mutex> guard(fiberStackMutex);
+    if (!fiberStacks.empty()) {
+      void *stack = fiberStacks.back();
+      fiberStacks.pop_back();
+      return stack;
+    }
+  }
+  void *region = mmap(nullptr, FIBER_GUARD_SIZE + FIBER_STACK_SIZE,
+                      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+  assert(region != MAP_FAILED);
+  mprotect(region, FIBER_GUARD_SIZE, PROT_NONE);
+  return (char *)region + FIBER_GUARD_SIZE;
+}
+
+static void releaseFiberStack(void *stack) {
+  std::lock_guard<std::mutex> guard(fiberStackMutex);
+  fiberStacks.push_back(stack);
+}
+
+System::Scheduler::Scheduler(System &system, size_t index,
+                             EventQueueType queueType)
+    : system(system), index(index), queue(EventQueue::create(queueType)),
+      currentTime(0), speculating(false) {
+  if (system.profile != nullptr)
+    profiler = std::make_unique<Profiler>();
+}
+
+System::System(EventQueueType queueType)
+    : nextModuleID(1), queueType(queueType),
+      runnableType(RunnableType::THREAD), registeredModule(1) {
+  this->nextSeq = 0;
+  this->parallelism = 1;
+  this->optimism = 0;
+  this->partitioned = false;
+  schedulers.push_back(std::make_unique<Scheduler>(*this, 0, queueType));
 }
 
 System::~System() {
-  activeTimer.clear();
-  while (!timerQueue.empty()) {
-    timerQueue.pop();
+  for (auto &scheduler : schedulers) {
+    while (!scheduler->queue->empty()) {
+      scheduler->queue->pop();
+    }
+    scheduler->slots.clear();
+    scheduler->freeSlots.clear();
   }
 
-  for (auto it = registeredModule.begin(); it != registeredModule.end(); ++it) {
+  for (auto &module : registeredModule) {
 
-    if (it->second.use_count() != 1) {
+    if (module != nullptr && module.use_count() != 1) {
       printf("Module must not live longer than System\n");
       abort();
     }
   }
 }
+
+System::Scheduler &System::current() {
+  if (active != nullptr && &active->system == this)
+    return *active;
+  return *schedulers[0];
+}
+
+bool System::inWindow() { return active != nullptr && &active->system == this; }
+
+size_t System::partitionFor(const ModuleID from, const ModuleID to) {
+  size_t partition = to < partitionIndex.size() ? partitionIndex[to] : 0;
+  if (partition == Partitioning::SENDER)
+    partition = from < partitionIndex.size() ? partitionIndex[from] : 0;
+  assert(partition < schedulers.size());
+  return partition;
+}
+
 UUID System::sendMessage(const ModuleID from, const ModuleID to,
                          Module::Message message, Time timeAfter) {
-  UUID uuid = allocateUUID();
-  TimerContainer container = std::make_shared<TimerContainerInner>(
-      from, to, false, this->getCurrentTime() + timeAfter, std::move(message),
-      uuid);
-
-  activeTimer.insert(std::pair<UUID, TimerContainer>(uuid, container));
-  timerQueue.push(container);
-
-  return uuid;
-}
-UUID System::allocateUUID() {
-  UUID startID = currentID;
-  do {
-    UUID candidate = currentID++;
-    if (activeUUID.find(candidate) == activeUUID.end()) {
-      activeUUID.insert(candidate);
-      return candidate;
-    }
-  } while (startID != currentID);
-  assert(0);
+  Scheduler &scheduler = current();
+  const Time wakeup = scheduler.currentTime + timeAfter;
+  const size_t target = schedulers.size() > 1 ? partitionFor(from, to) : 0;
+
+  if (!inWindow())
+    return schedule(*schedulers[target], wakeup, nextSeq++, from, to,
+                    std::move(message));
+
+  const UUID seq = PROVISIONAL | scheduler.spawned.size();
+  scheduler.spawned.emplace_back();
+  Spawned &spawned = scheduler.spawned.back();
+  spawned.partition = target;
+  spawned.seq = PROVISIONAL;
+  if (target == scheduler.index) {
+    const size_t slots = scheduler.slots.size();
+    UUID messageID =
+        schedule(scheduler, wakeup, seq, from, to, std::move(message));
+    spawned.slot = messageID & SLOT_MASK;
+    spawned.pending = true;
+    if (scheduler.speculating) {
+      scheduler.undo.emplace_back();
+      scheduler.undo.back().released = false;
+      scheduler.undo.back().appended = scheduler.slots.size() != slots;
+      scheduler.undo.back().slot = spawned.slot;
+    }
+    return messageID;
+  }
+
+  // delivered to the other partition after the window
+  if (timeAfter < partitioning.lookahead) {
+    fprintf(stderr,
+            "Message from module %" PRIuPTR " to %" PRIuPTR
+            " crosses partitions with delay %" PRIu64
+            ", shorter than the lookahead %" PRIu64 "\n",
+            from, to, timeAfter, partitioning.lookahead);
+    abort();
+  }
+  spawned.pending = false;
+  spawned.wakeup = wakeup;
+  spawned.from = from;
+  spawned.to = to;
+  spawned.message = std::move(message);
   return 0;
 }
 
-bool System::deallocateUUID(UUID candidate) {
-  if (activeUUID.find(candidate) == activeUUID.end())
-    return false;
-  activeUUID.erase(candidate);
-  return true;
+UUID System::schedule(Scheduler &scheduler, Time wakeup, UUID seq,
+                      const ModuleID from, const ModuleID to,
+                      Module::Message message) {
+  assert(isRegistered(from) && isRegistered(to));
+  uint32_t index = allocateSlot(scheduler);
+  EventSlot &slot = scheduler.slots[index];
+  slot.wakeup = wakeup;
+  slot.seq = seq;
+  slot.from = from;
+  slot.to = to;
+  slot.sender = registeredModule[from].get();
+  slot.receiver = registeredModule[to].get();
+  slot.message = std::move(message);
+
+  scheduler.queue->push({slot.wakeup, slot.seq, index});
+
+  return ((UUID)slot.generation << 32) | (scheduler.index << SLOT_BITS) |
+         index;
+}
+
+uint32_t System::allocateSlot(Scheduler &scheduler) {
+  if (!scheduler.freeSlots.empty()) {
+    uint32_t index = scheduler.freeSlots.back();
+    scheduler.freeSlots.pop_back();
+    return index;
+  }
+  assert(scheduler.slots.size() < SLOT_MASK);
+  scheduler.slots.emplace_back();
+  scheduler.slots.back().generation = 1;
+  return scheduler.slots.size() - 1;
+}
+
+void System::releaseSlot(Scheduler &scheduler, uint32_t index) {
+  EventSlot &slot = scheduler.slots[index];
+  assert(slot.message == nullptr);
+  slot.generation++;
+  scheduler.freeSlots.push_back(index);
 }
 
 bool System::isRegistered(const ModuleID module) {
-  return this->registeredModule.find(module) != this->registeredModule.end();
+  return module < registeredModule.size() && registeredModule[module];
 }
 
-Time System::getCurrentTime() { return this->currentTime; }
+Time System::getCurrentTime() { return current().currentTime; }
 
 bool System::cancelMessage(UUID messageID) {
-  std::unordered_map<UUID, TimerContainer>::iterator iter =
-      this->activeTimer.find(messageID);
-  if (iter == this->activeTimer.end())
+  auto moved = movedMessages.find(messageID);
+  if (moved != movedMessages.end())
+    messageID = moved->second;
+
+  const size_t partition = ((uint32_t)messageID) >> SLOT_BITS;
+  const uint32_t index = messageID & SLOT_MASK;
+  const uint32_t generation = messageID >> 32;
+  if (partition >= schedulers.size())
     return false;
-  iter->second->canceled = true;
+
+  Scheduler &scheduler = *schedulers[partition];
+  if (index >= scheduler.slots.size() ||
+      scheduler.slots[index].generation != generation)
+    return false;
+  // a partition cannot touch the events of the others during a window
+  assert(!inWindow() || &scheduler == active);
+
+  EventSlot &slot = scheduler.slots[index];
+  scheduler.queue->remove({slot.wakeup, slot.seq, index});
+  if (slot.seq & PROVISIONAL)
+    scheduler.spawned[slot.seq & ~PROVISIONAL].pending = false;
+  if (inWindow() && scheduler.speculating) {
+    scheduler.undo.emplace_back();
+    Undo &undo = scheduler.undo.back();
+    undo.released = true;
+    undo.slot = index;
+    undo.copy.wakeup = slot.wakeup;
+    undo.copy.seq = slot.seq;
+    undo.copy.from = slot.from;
+    undo.copy.to = slot.to;
+    undo.copy.sender = slot.sender;
+    undo.copy.receiver = slot.receiver;
+    undo.copy.generation = slot.generation;
+    undo.copy.message = slot.message->cloneMessage();
+    // a speculative handler may only cancel messages it can restore
+    assert(undo.copy.message != nullptr);
+    undo.copy.message->oneWay = slot.message->oneWay;
+  }
+
+  Module *sender = slot.sender;
+  const ModuleID from = slot.from;
+  const ModuleID to = slot.to;
+  Module::Message message = std::move(slot.message);
+  releaseSlot(scheduler, index);
+
+  if (scheduler.profiler != nullptr) {
+    const std::type_info &type = typeid(*message);
+    uint64_t clock = Profiler::now();
+    sender->messageCancelled(to, std::move(message));
+    scheduler.profiler->lap(from, type, Profiler::CANCELLED, clock);
+    return true;
+  }
+  sender->messageCancelled(to, std::move(message));
   return true;
 }
 
+void System::dispatch(Scheduler &scheduler, const EventQueue::Entry &next) {
+  // The slot is released before dispatching, so the handlers may send new
+  // messages (reusing it) and cancelling the current one fails.
+  EventSlot &slot = scheduler.slots[next.slot];
+  const ModuleID from = slot.from;
+  const ModuleID to = slot.to;
+  Module &sender = *slot.sender;
+  Module &receiver = *slot.receiver;
+  Module::Message message = std::move(slot.message);
+  if (slot.seq & PROVISIONAL)
+    scheduler.spawned[slot.seq & ~PROVISIONAL].pending = false;
+  releaseSlot(scheduler, next.slot);
+
+  scheduler.currentTime = next.wakeup;
+  Profiler *profiler = scheduler.profiler.get();
+  if (profiler != nullptr) {
+    dispatchProfiled(*profiler, from, to, sender, receiver, std::move(message));
+    profiler->dispatched(next.wakeup, scheduler.queue->size());
+    return;
+  }
+  Module::Message ret = receiver.messageReceived(from, *message);
+  if (!message->oneWay)
+    sender.messageFinished(
+        to, std::move(message),
+        ret != nullptr ? *ret : Module::EmptyMessage::shared());
+  if (ret != nullptr)
+    receiver.messageFinished(to, std::move(ret),
+                             Module::EmptyMessage::shared());
+}
+
+void System::dispatchProfiled(Profiler &profiler, const ModuleID from,
+                              const ModuleID to, Module &sender,
+                              Module &receiver, Module::Message message) {
+  const std::type_info &type = typeid(*message);
+  uint64_t clock = Profiler::now();
+  Module::Message ret = receiver.messageReceived(from, *message);
+  clock = profiler.lap(to, type, Profiler::RECEIVED, clock);
+  if (!message->oneWay) {
+    sender.messageFinished(
+        to, std::move(message),
+        ret != nullptr ? *ret : Module::EmptyMessage::shared());
+    clock = profiler.lap(from, type, Profiler::FINISHED, clock);
+  }
+  if (ret != nullptr) {
+    const std::type_info &responseType = typeid(*ret);
+    receiver.messageFinished(to, std::move(ret),
+                             Module::EmptyMessage::shared());
+    profiler.lap(to, responseType, Profiler::FINISHED, clock);
+  }
+}
+
+void System::dispatchBatch(Scheduler &scheduler,
+                           const EventQueue::Entry &next) {
+  // Gather the events due at the same time for the same module, which come
+  // next in the queue. Their order stays the same as one by one.
+  const ModuleID to = scheduler.slots[next.slot].to;
+  Module &receiver = *scheduler.slots[next.slot].receiver;
+  std::vector<Module::Delivery> batch;
+  batch.swap(scheduler.batch);
+  EventQueue::Entry entry = next;
+  while (true) {
+    EventSlot &slot = scheduler.slots[entry.slot];
+    batch.emplace_back(slot.from, std::move(slot.message), slot.sender);
+    releaseSlot(scheduler, entry.slot);
+    if (scheduler.queue->empty())
+      break;
+    entry = scheduler.queue->top();
+    if (entry.wakeup != next.wakeup || scheduler.slots[entry.slot].to != to)
+      break;
+    scheduler.queue->pop();
+  }
+
+  scheduler.currentTime = next.wakeup;
+  Profiler *profiler = scheduler.profiler.get();
+  uint64_t clock = profiler != nullptr ? Profiler::now() : 0;
+  receiver.messagesReceivedBatch(batch);
+  if (profiler != nullptr) {
+    // the batch is handled at once, so each message gets an equal share
+    const uint64_t spent = Profiler::now() - clock;
+    for (Module::Delivery &delivery : batch) {
+      profiler->record(to, typeid(*delivery.message), Profiler::RECEIVED,
+                       spent / batch.size());
+      profiler->dispatched(next.wakeup, scheduler.queue->size());
+    }
+    clock += spent;
+  }
+  for (Module::Delivery &delivery : batch) {
+    Module::Message &ret = delivery.response;
+    Module::MessageBase &response =
+        ret != nullptr ? *ret : Module::EmptyMessage::shared();
+    const std::type_info &type = typeid(*delivery.message);
+    if (!delivery.message->oneWay) {
+      delivery.sender->messageFinished(to, std::move(delivery.message),
+                                       response);
+      if (profiler != nullptr)
+        clock = profiler->lap(delivery.from, type, Profiler::FINISHED, clock);
+    }
+    if (ret != nullptr) {
+      const std::type_info &responseType = typeid(*ret);
+      receiver.messageFinished(to, std::move(ret),
+                               Module::EmptyMessage::shared());
+      if (profiler != nullptr)
+        clock = profiler->lap(to, responseType, Profiler::FINISHED, clock);
+    }
+  }
+  batch.clear();
+  batch.swap(scheduler.batch);
+}
+
+void System::wakeRunnables(Scheduler &scheduler) {
+  while (!scheduler.runnableReady.empty()) {
+    for (auto r = scheduler.runnableReady.begin();
+         r != scheduler.runnableReady.end();) {
+      auto next = (*r)->wake();
+      if (next != Runnable::State::READY) {
+        r = scheduler.runnableReady.erase(r);
+      } else {
+        ++r;
+      }
+    }
+  }
+}
+
 void System::run(Time till) {
-  std::vector<TimerContainer> sameTime;
+  System *previous = running;
+  running = this;
+  const Time startTime = getCurrentTime();
+  const uint64_t startClock = profile != nullptr ? Profiler::now() : 0;
+
+  if (parallelism > 1 && !partitioned)
+    startPartitions();
+
+  if (schedulers.size() > 1)
+    runParallel(till);
+  else
+    runSequential(till);
 
+  if (profile != nullptr) {
+    for (auto &scheduler : schedulers)
+      profile->merge(*scheduler->profiler);
+    profile->addRun(getCurrentTime() - startTime,
+                    Profiler::now() - startClock);
+    std::ofstream file(profilePath);
+    profile->writeJSON(file, [this](ModuleID module) {
+      return getModuleName(module);
+    });
+  }
+
+  running = previous;
+}
+
+void System::runSequential(Time till) {
+  Scheduler &scheduler = *schedulers[0];
   while (true) {
-    while (!runnableReady.empty()) {
-      for (auto r = runnableReady.begin(); r != runnableReady.end();) {
-        auto next = (*r)->wake();
-        if (next != Runnable::State::READY) {
-          r = runnableReady.erase(r);
+    wakeRunnables(scheduler);
+    if (scheduler.queue->empty()) {
+      break;
+    }
+    const EventQueue::Entry next = scheduler.queue->top();
+    if (till != 0 && next.wakeup > till)
+      break;
+    scheduler.queue->pop();
+    if (scheduler.slots[next.slot].receiver->batchDelivery)
+      dispatchBatch(scheduler, next);
+    else
+      dispatch(scheduler, next);
+  }
+}
+
+void System::setParallelism(size_t threads) {
+  assert(!partitioned);
+  assert(threads > 0 && threads <= MAX_SCHEDULERS);
+  this->parallelism = threads;
+}
+
+void System::setOptimism(Time window) { this->optimism = window; }
+
+void System::setRunnableType(RunnableType type) { this->runnableType = type; }
+
+void System::setProfiling(const std::string &path) {
+  profilePath = path;
+  if (path.empty()) {
+    profile = nullptr;
+    for (auto &scheduler : schedulers)
+      scheduler->profiler = nullptr;
+    return;
+  }
+  if (profile == nullptr)
+    profile = std::make_unique<Profiler>();
+  for (auto &scheduler : schedulers)
+    if (scheduler->profiler == nullptr)
+      scheduler->profiler = std::make_unique<Profiler>();
+}
+
+const Profiler *System::getProfiler() { return profile.get(); }
+
+RunnableType System::getRunnableType() { return runnableType; }
+
+void System::setRandomSeed(uint64_t seed) { randomEngine.emplace(seed); }
+
+uint64_t System::nextRandomSeed() {
+  if (!randomEngine)
+    return rand();
+  return (*randomEngine)();
+}
+
+void System::setLogLevel(int level) { Log::setLevel(level); }
+
+System *System::getRunningSystem() { return running; }
+
+const System::ParallelStatistics &System::getParallelStatistics() {
+  return statistics;
+}
+
+System::Partitioning System::partition(size_t partitions) {
+  (void)partitions;
+  return Partitioning();
+}
+
+void System::startPartitions() {
+  partitioned = true;
+  partitioning = partition(parallelism);
+  if (partitioning.count <= 1 || partitioning.lookahead == 0) {
+    partitioning = Partitioning();
+    return;
+  }
+  assert(partitioning.count <= MAX_SCHEDULERS);
+  partitionIndex.assign(registeredModule.size(), 0);
+  for (auto &entry : partitioning.partitionOf) {
+    if (entry.first < partitionIndex.size())
+      partitionIndex[entry.first] = entry.second;
+  }
+  statistics.partitions = partitioning.count;
+  statistics.lookahead = partitioning.lookahead;
+
+  Scheduler &main = *schedulers[0];
+  for (size_t k = 1; k < partitioning.count; k++) {
+    schedulers.push_back(std::make_unique<Scheduler>(*this, k, queueType));
+    schedulers.back()->currentTime = main.currentTime;
+  }
+
+  // Hand the pending events over to their partitions. The old UUIDs are
+  // remembered, so the modules can still cancel them.
+  std::unique_ptr<EventQueue> pending = std::move(main.queue);
+  main.queue = EventQueue::create(queueType);
+  while (!pending->empty()) {
+    const EventQueue::Entry entry = pending->top();
+    pending->pop();
+    EventSlot &slot = main.slots[entry.slot];
+    const size_t target = partitionFor(slot.from, slot.to);
+    if (target == 0) {
+      main.queue->push(entry);
+      continue;
+    }
+    const UUID oldID = ((UUID)slot.generation << 32) | entry.slot;
+    const UUID newID = schedule(*schedulers[target], slot.wakeup, slot.seq,
+                                slot.from, slot.to, std::move(slot.message));
+    releaseSlot(main, entry.slot);
+    movedMessages[oldID] = newID;
+  }
+}
+
+namespace {
+// Reusable barrier for the parallel mode (std::barrier is C++20).
+class Barrier {
+private:
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t count;
+  size_t waiting;
+  size_t generation;
+
+public:
+  Barrier(size_t count) : count(count), waiting(0), generation(0) {}
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t current = generation;
+    if (++waiting == count) {
+      waiting = 0;
+      generation++;
+      cond.notify_all();
+    } else {
+      cond.wait(lock, [&] { return generation != current; });
+    }
+  }
+};
+} // namespace
+
+void System::runParallel(Time till) {
+  Scheduler &main = *schedulers[0];
+  // Runnables woken up outside of run go first, as in the sequential mode.
+  wakeRunnables(main);
+
+  const size_t count = schedulers.size();
+  Barrier start(count);
+  Barrier done(count);
+  bool finished = false;
+  Time safeEnd = 0;
+  Time windowEnd = 0;
+
+  std::vector<std::thread> workers;
+  for (size_t k = 1; k < count; k++) {
+    workers.emplace_back([&, k] {
+      Scheduler &scheduler = *schedulers[k];
+      active = &scheduler;
+      running = this;
+      while (true) {
+        start.wait();
+        if (finished)
+          break;
+        runWindow(scheduler, safeEnd, windowEnd, till);
+        done.wait();
+      }
+      active = nullptr;
+      running = nullptr;
+    });
+  }
+
+  while (true) {
+    std::optional<Time> earliest;
+    for (auto &scheduler : schedulers) {
+      if (!scheduler->queue->empty() &&
+          (!earliest || scheduler->queue->top().wakeup < *earliest))
+        earliest = scheduler->queue->top().wakeup;
+    }
+    if (!earliest || (till != 0 && *earliest > till))
+      break;
+
+    // Every message crossing partitions arrives at or after safeEnd. Events
+    // beyond it, up to windowEnd, are handled speculatively.
+    safeEnd = *earliest + partitioning.lookahead;
+    if (safeEnd < *earliest)
+      safeEnd = std::numeric_limits<Time>::max();
+    windowEnd = *earliest + std::max(partitioning.lookahead, optimism);
+    if (windowEnd < *earliest)
+      windowEnd = std::numeric_limits<Time>::max();
+    statistics.windows++;
+
+    start.wait();
+    active = &main;
+    runWindow(main, safeEnd, windowEnd, till);
+    active = nullptr;
+    done.wait();
+
+    mergeWindow();
+  }
+
+  finished = true;
+  start.wait();
+  for (auto &worker : workers)
+    worker.join();
+
+  Time now = 0;
+  for (auto &scheduler : schedulers)
+    now = std::max(now, scheduler->currentTime);
+  for (auto &scheduler : schedulers)
+    scheduler->currentTime = now;
+}
+
+void System::runWindow(Scheduler &scheduler, Time safeEnd, Time end,
+                       Time till) {
+  while (!scheduler.queue->empty()) {
+    const EventQueue::Entry next = scheduler.queue->top();
+    if (next.wakeup >= end || (till != 0 && next.wakeup > till))
+      break;
+
+    const size_t first = scheduler.spawned.size();
+    if (next.wakeup >= safeEnd) {
+      if (!speculate(scheduler, next))
+        break;
+    } else {
+      scheduler.dispatched.push_back({next.wakeup, next.seq, first, first});
+      scheduler.dispatched.back().speculative = false;
+    }
+    scheduler.queue->pop();
+
+    dispatch(scheduler, next);
+    // Runnables cannot be rolled back
+    assert(!scheduler.speculating || scheduler.runnableReady.empty());
+    wakeRunnables(scheduler);
+    scheduler.speculating = false;
+    scheduler.dispatched.back().lastSpawned = scheduler.spawned.size();
+  }
+}
+
+bool System::speculate(Scheduler &scheduler, const EventQueue::Entry &next) {
+  EventSlot &slot = scheduler.slots[next.slot];
+  Module &receiver = *slot.receiver;
+
+  Module::Message copy = slot.message->cloneMessage();
+  if (copy == nullptr)
+    return false;
+  copy->oneWay = slot.message->oneWay;
+  std::any state = receiver.saveState(slot.from);
+  if (!state.has_value())
+    return false;
+
+  const size_t first = scheduler.spawned.size();
+  scheduler.dispatched.push_back({next.wakeup, next.seq, first, first});
+  Dispatched &dispatched = scheduler.dispatched.back();
+  dispatched.speculative = true;
+  dispatched.previousTime = scheduler.currentTime;
+  dispatched.firstUndo = scheduler.undo.size();
+  dispatched.firstSaved = scheduler.saved.size();
+
+  scheduler.saved.push_back({&receiver, slot.from, std::move(state)});
+
+  // dispatch releases the slot first
+  scheduler.undo.emplace_back();
+  Undo &undo = scheduler.undo.back();
+  undo.released = true;
+  undo.slot = next.slot;
+  undo.copy.wakeup = slot.wakeup;
+  undo.copy.seq = slot.seq;
+  undo.copy.from = slot.from;
+  undo.copy.to = slot.to;
+  undo.copy.sender = slot.sender;
+  undo.copy.receiver = slot.receiver;
+  undo.copy.generation = slot.generation;
+  undo.copy.message = std::move(copy);
+
+  scheduler.speculating = true;
+  return true;
+}
+
+void System::rollback(Scheduler &scheduler, Time to) {
+  while (!scheduler.dispatched.empty() &&
+         scheduler.dispatched.back().wakeup >= to) {
+    Dispatched &dispatched = scheduler.dispatched.back();
+    assert(dispatched.speculative);
+
+    while (scheduler.saved.size() > dispatched.firstSaved) {
+      Saved &saved = scheduler.saved.back();
+      saved.module->restoreState(saved.from, std::move(saved.state));
+      scheduler.saved.pop_back();
+    }
+
+    // undo the slot changes in reverse, so that every slot (and UUID) ends up
+    // exactly as before
+    while (scheduler.undo.size() > dispatched.firstUndo) {
+      Undo &undo = scheduler.undo.back();
+      EventSlot &slot = scheduler.slots[undo.slot];
+      if (undo.released) {
+        assert(!scheduler.freeSlots.empty() &&
+               scheduler.freeSlots.back() == undo.slot);
+        scheduler.freeSlots.pop_back();
+        slot.wakeup = undo.copy.wakeup;
+        slot.seq = undo.copy.seq;
+        slot.from = undo.copy.from;
+        slot.to = undo.copy.to;
+        slot.sender = undo.copy.sender;
+        slot.receiver = undo.copy.receiver;
+        slot.generation = undo.copy.generation;
+        slot.message = std::move(undo.copy.message);
+        scheduler.queue->push({slot.wakeup, slot.seq, undo.slot});
+        if ((slot.seq & PROVISIONAL) &&
+            (slot.seq & ~PROVISIONAL) < dispatched.firstSpawned)
+          scheduler.spawned[slot.seq & ~PROVISIONAL].pending = true;
+      } else {
+        // anti-message: withdraw a message sent by the undone dispatch
+        scheduler.queue->remove({slot.wakeup, slot.seq, undo.slot});
+        slot.message.reset();
+        if (undo.appended) {
+          assert(undo.slot + 1 == scheduler.slots.size());
+          scheduler.slots.pop_back();
         } else {
-          ++r;
+          scheduler.freeSlots.push_back(undo.slot);
         }
       }
+      scheduler.undo.pop_back();
     }
-    if (timerQueue.empty()) {
-      /*
-      if(!runnableSet.empty())
-      {
-              lock.unlock();
-              std::this_thread::yield();
-              lock.lock();
-              continue;
-      }
-      else
-      {
-              lock.unlock();
-              std::this_thread::yield();
-              lock.lock();
-              break;
+
+    // messages for other partitions were never delivered
+    scheduler.spawned.resize(dispatched.firstSpawned);
+    scheduler.currentTime = dispatched.previousTime;
+    scheduler.dispatched.pop_back();
+    statistics.rolledBack++;
+  }
+}
+
+void System::mergeWindow() {
+  // A message from another partition is too late if its receiver already
+  // dispatched events at or after its time. Roll everything back to the
+  // earliest such message; the rest of the window is correct.
+  std::vector<std::optional<Time>> reached(schedulers.size());
+  for (auto &scheduler : schedulers) {
+    if (!scheduler->dispatched.empty())
+      reached[scheduler->index] = scheduler->dispatched.back().wakeup;
+  }
+  std::optional<Time> straggler;
+  for (auto &scheduler : schedulers) {
+    for (Spawned &spawned : scheduler->spawned) {
+      if (spawned.partition != scheduler->index &&
+          reached[spawned.partition] &&
+          spawned.wakeup <= *reached[spawned.partition] &&
+          (!straggler || spawned.wakeup < *straggler))
+        straggler = spawned.wakeup;
+    }
+  }
+  if (straggler) {
+    for (auto &scheduler : schedulers)
+      rollback(*scheduler, *straggler);
+  }
+
+  // Replay the windows in the sequential order of dispatch, numbering the
+  // spawned events in the order the sequential mode would have sent them.
+  // A provisional sequence number always refers to an event spawned by an
+  // earlier dispatch of the same partition, which is already numbered.
+  auto finalSeq = [](Scheduler &scheduler, UUID seq) {
+    if (seq & PROVISIONAL)
+      seq = scheduler.spawned[seq & ~PROVISIONAL].seq;
+    assert(!(seq & PROVISIONAL));
+    return seq;
+  };
+
+  std::vector<size_t> cursor(schedulers.size(), 0);
+  while (true) {
+    Scheduler *earliest = nullptr;
+    Time wakeup = 0;
+    UUID seq = 0;
+    for (auto &scheduler : schedulers) {
+      if (cursor[scheduler->index] == scheduler->dispatched.size())
+        continue;
+      const Dispatched &head = scheduler->dispatched[cursor[scheduler->index]];
+      const UUID headSeq = finalSeq(*scheduler, head.seq);
+      if (earliest == nullptr || head.wakeup < wakeup ||
+          (head.wakeup == wakeup && headSeq < seq)) {
+        earliest = scheduler.get();
+        wakeup = head.wakeup;
+        seq = headSeq;
       }
-      */
-      break;
     }
-    if (till != 0 && timerQueue.top()->wakeup > till)
+    if (earliest == nullptr)
       break;
 
-    TimerContainer current = timerQueue.top();
-    assert(current);
-    timerQueue.pop();
-#if 0
-		TimerContainer* temp;
-		sameTime.clear();
-		while(true)
-		{
-			if(timerQueue.empty())
-				break;
-			temp = timerQueue.top();
-
-			if(temp->wakeup == current->wakeup)
-			{
-				timerQueue.pop();
-				sameTime.push_back(temp);
-			}
-			else
-				break;
-		}
-		assert(sameTime.size() > 0);
-		if(sameTime.size() != 1)
-		{
-			print_log(INFO, "Multiple (%lu) modules wake up on %lu, shuffle.", sameTime.size(), current->wakeup);
-
-			std::random_shuffle(sameTime.begin(), sameTime.end());
-		}
-#endif
-    this->currentTime = current->wakeup;
-    // for(TimerContainer* container : sameTime)
-    {
-      TimerContainer container = std::move(current);
-      if (!container->canceled) {
-        Module::Message ret = registeredModule[container->to]->messageReceived(
-            container->from, *container->message);
-        registeredModule[container->from]->messageFinished(
-            container->to, std::move(container->message),
-            ret != nullptr ? *ret : Module::EmptyMessage::shared());
-        if (ret != nullptr)
-          registeredModule[container->to]->messageFinished(
-              container->to, std::move(ret), Module::EmptyMessage::shared());
-      } else {
-        registeredModule[container->from]->messageCancelled(
-            container->to, std::move(container->message));
-      }
+    const Dispatched &head = earliest->dispatched[cursor[earliest->index]++];
+    for (size_t k = head.firstSpawned; k < head.lastSpawned; k++)
+      earliest->spawned[k].seq = nextSeq++;
+  }
 
-      this->activeTimer.erase(container->uuid);
-      this->activeUUID.erase(container->uuid);
-      assert(container.use_count() == 1);
+  for (auto &scheduler : schedulers) {
+    for (Spawned &spawned : scheduler->spawned) {
+      if (spawned.partition != scheduler->index) {
+        schedule(*schedulers[spawned.partition], spawned.wakeup, spawned.seq,
+                 spawned.from, spawned.to, std::move(spawned.message));
+      } else if (spawned.pending) {
+        EventSlot &slot = scheduler->slots[spawned.slot];
+        scheduler->queue->remove({slot.wakeup, slot.seq, spawned.slot});
+        slot.seq = spawned.seq;
+        scheduler->queue->push({slot.wakeup, slot.seq, spawned.slot});
+      }
     }
+    // fossil collection: everything left is committed
+    statistics.committed += scheduler->dispatched.size();
+    scheduler->spawned.clear();
+    scheduler->dispatched.clear();
+    scheduler->undo.clear();
+    scheduler->saved.clear();
   }
 }
 
-Runnable::Runnable()
-    : state(State::CREATED), threadLock(stateMtx, std::defer_lock),
-      schedLock(stateMtx), thread(&Runnable::run, this) {}
+Runnable::Runnable(RunnableType type)
+    : type(type), state(State::CREATED), threadLock(stateMtx, std::defer_lock),
+      schedLock(stateMtx), scheduler(nullptr), system(nullptr),
+      stack(nullptr) {
+  if (type == RunnableType::THREAD)
+    thread = std::thread(&Runnable::run, this);
+}
 Runnable::~Runnable() {
-  assert(std::this_thread::get_id() != thread.get_id());
   assert(schedLock.owns_lock());
+  if (type == RunnableType::FIBER) {
+    // A fiber that never finished is not unwound: destructors of the objects
+    // still on its stack never run, and whatever they own leaks. The stack
+    // itself goes back to the pool and is reused by the next fiber.
+    if (stack != nullptr)
+      releaseFiberStack(stack);
+    return;
+  }
+  assert(std::this_thread::get_id() != thread.get_id());
   thread.join();
 }
 
+void Runnable::fiberEntry(uint32_t high, uint32_t low) {
+  Runnable *runnable = (Runnable *)(((uintptr_t)high << 32) | low);
+  runnable->run();
+  // returning resumes the caller (uc_link)
+}
+
 void Runnable::run() {
-  assert(std::this_thread::get_id() == thread.get_id());
+  if (type == RunnableType::FIBER) {
+    pre_main();
+    state = State::READY;
+    swapcontext(&context, &caller);
+    main();
+    state = State::TERMINATED;
+    return;
+  }
+
+  // the constructor holds the lock until start(), so thread is set by now
   threadLock.lock();
+  assert(std::this_thread::get_id() == thread.get_id());
   cond.wait(threadLock, [&] { return state == State::STARTING; });
   pre_main();
   state = State::READY;
   cond.notify_all();
   cond.wait(threadLock, [&] { return state == State::RUNNING; });
+  System::active = scheduler;
+  System::running = system;
   main();
   state = State::TERMINATED;
   cond.notify_all();
@@ -190,35 +871,73 @@ void Runnable::run() {
 }
 
 void Runnable::wait() {
+  assert(state == State::RUNNING);
+  if (type == RunnableType::FIBER) {
+    // resumed by the thread of whichever scheduler wakes us, which has
+    // already set System::active
+    state = State::WAITING;
+    swapcontext(&context, &caller);
+    return;
+  }
+
   assert(std::this_thread::get_id() == thread.get_id());
   assert(threadLock.owns_lock());
-  assert(state == State::RUNNING);
   state = State::WAITING;
   cond.notify_all();
   cond.wait(threadLock, [&] { return state == State::RUNNING; });
+  System::active = scheduler;
+  System::running = system;
 }
 
 void Runnable::start() {
-  assert(std::this_thread::get_id() != thread.get_id());
   assert(schedLock.owns_lock());
   assert(state == State::CREATED);
+  if (type == RunnableType::FIBER) {
+    stack = allocateFiberStack();
+    getcontext(&context);
+    context.uc_stack.ss_sp = stack;
+    context.uc_stack.ss_size = FIBER_STACK_SIZE;
+    context.uc_link = &caller;
+    uintptr_t self = (uintptr_t)this;
+    makecontext(&context, (void (*)())&Runnable::fiberEntry, 2,
+                (uint32_t)(self >> 32), (uint32_t)self);
+    state = State::STARTING;
+    swapcontext(&caller, &context);
+    assert(state == State::READY);
+    return;
+  }
+
+  assert(std::this_thread::get_id() != thread.get_id());
   state = State::STARTING;
   cond.notify_all();
   cond.wait(schedLock, [&] { return state == State::READY; });
   assert(schedLock.owns_lock());
 }
 Runnable::State Runnable::wake() {
-  assert(std::this_thread::get_id() != thread.get_id());
   assert(schedLock.owns_lock());
   assert(state == State::READY);
+  // the Runnable acts on behalf of the scheduler (partition) waking it
+  scheduler = System::active;
+  system = System::running;
   state = State::RUNNING;
+  if (type == RunnableType::FIBER) {
+    swapcontext(&caller, &context);
+    if (state == State::TERMINATED) {
+      releaseFiberStack(stack);
+      stack = nullptr;
+    }
+    return state;
+  }
+
+  assert(std::this_thread::get_id() != thread.get_id());
   cond.notify_all();
   cond.wait(schedLock, [&] { return state != State::RUNNING; });
   return state;
 }
 void Runnable::ready() {
   assert(schedLock.owns_lock());
-  assert(std::this_thread::get_id() != thread.get_id());
+  assert(type == RunnableType::FIBER ||
+         std::this_thread::get_id() != thread.get_id());
   assert(state == State::WAITING);
   state = State::READY;
 }
@@ -226,25 +945,193 @@ void Runnable::ready() {
 void System::addRunnable(std::shared_ptr<Runnable> runnable) {
   assert(runnable->state == Runnable::State::READY);
   assert(runnable->schedLock.owns_lock());
-  this->runnableReady.insert(runnable);
+  current().runnableReady.insert(runnable);
 }
 void System::delRunnable(std::shared_ptr<Runnable> runnable) {
-  this->runnableReady.erase(runnable);
+  current().runnableReady.erase(runnable);
 }
 
-std::string System::getModuleName(const ModuleID moduleID) {
+static constexpr char CHECKPOINT_MAGIC[8] = {'K', 'E', 'N', 'S',
+                                             'C', 'K', 'P', '1'};
+
+bool System::checkpoint(const std::string &path) {
+  assert(!partitioned && !inWindow());
+  Scheduler &scheduler = *schedulers[0];
+  assert(scheduler.runnableReady.empty());
+
+  std::ostringstream out;
+  out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  Checkpoint::write(out, scheduler.currentTime);
+  Checkpoint::write(out, nextSeq);
+  std::ostringstream system;
+  writeCheckpoint(system);
+  Checkpoint::write(out, system.str());
+
+  // modules, each in a block of its own
+  Checkpoint::write(out, (uint64_t)registeredModule.size());
+  for (ModuleID id = 1; id < registeredModule.size(); id++) {
+    Module *module = registeredModule[id].get();
+    Checkpoint::write(out, module != nullptr ? module->getModuleName() : "");
+    std::ostringstream state;
+    if (module != nullptr && !module->writeCheckpoint(state))
+      return false;
+    Checkpoint::write(out, state.str());
+  }
+
+  // slots keep their generations, so the UUIDs held by modules stay valid
+  Checkpoint::write(out, (uint64_t)scheduler.slots.size());
+  for (const EventSlot &slot : scheduler.slots)
+    Checkpoint::write(out, slot.generation);
+  Checkpoint::write(out, (uint64_t)scheduler.freeSlots.size());
+  for (uint32_t index : scheduler.freeSlots)
+    Checkpoint::write(out, index);
+
+  Checkpoint::write(out, (uint64_t)scheduler.queue->size());
+  for (uint32_t index = 0; index < scheduler.slots.size(); index++) {
+    const EventSlot &slot = scheduler.slots[index];
+    if (slot.message == nullptr)
+      continue;
+    std::ostringstream message;
+    if (!slot.sender->writeMessage(*slot.message, message))
+      return false;
+    Checkpoint::write(out, index);
+    Checkpoint::write(out, slot.wakeup);
+    Checkpoint::write(out, slot.seq);
+    Checkpoint::write(out, slot.from);
+    Checkpoint::write(out, slot.to);
+    Checkpoint::write(out, slot.message->getTag());
+    Checkpoint::write(out, slot.message->oneWay);
+    Checkpoint::write(out, message.str());
+  }
+
+  std::ofstream file(path, std::ofstream::binary);
+  file << out.str();
+  return (bool)file;
+}
+
+bool System::restore(const std::string &path) {
+  assert(!partitioned && !inWindow());
+  Scheduler &scheduler = *schedulers[0];
+
+  std::ifstream file(path, std::ifstream::binary);
+  char magic[sizeof(CHECKPOINT_MAGIC)];
+  if (!file.read(magic, sizeof(magic)) ||
+      memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0)
+    return false;
+  Time currentTime = Checkpoint::read<Time>(file);
+  UUID seq = Checkpoint::read<UUID>(file);
+  std::string system = Checkpoint::readString(file);
+
+  // read everything before touching anything
+  if (Checkpoint::read<uint64_t>(file) != registeredModule.size())
+    return false;
+  std::vector<std::string> states(registeredModule.size());
+  for (ModuleID id = 1; id < registeredModule.size(); id++) {
+    Module *module = registeredModule[id].get();
+    std::string name = Checkpoint::readString(file);
+    if (!file || name != (module != nullptr ? module->getModuleName() : ""))
+      return false;
+    states[id] = Checkpoint::readString(file);
+  }
+
+  std::vector<uint32_t> generations(Checkpoint::read<uint64_t>(file));
+  for (uint32_t &generation : generations)
+    generation = Checkpoint::read<uint32_t>(file);
+  std::vector<uint32_t> freeSlots(Checkpoint::read<uint64_t>(file));
+  for (uint32_t &index : freeSlots)
+    index = Checkpoint::read<uint32_t>(file);
+
+  class Pending {
+  public:
+    uint32_t index;
+    Time wakeup;
+    UUID seq;
+    ModuleID from;
+    ModuleID to;
+    Module::MessageTag tag;
+    bool oneWay;
+    std::string message;
+  };
+  std::vector<Pending> pending(Checkpoint::read<uint64_t>(file));
+  for (Pending &event : pending) {
+    event.index = Checkpoint::read<uint32_t>(file);
+    event.wakeup = Checkpoint::read<Time>(file);
+    event.seq = Checkpoint::read<UUID>(file);
+    event.from = Checkpoint::read<ModuleID>(file);
+    event.to = Checkpoint::read<ModuleID>(file);
+    event.tag = Checkpoint::read<Module::MessageTag>(file);
+    event.oneWay = Checkpoint::read<bool>(file);
+    event.message = Checkpoint::readString(file);
+    if (!file || event.index >= generations.size() ||
+        !isRegistered(event.from) || !isRegistered(event.to))
+      return false;
+  }
+  if (!file)
+    return false;
+
+  for (EventSlot &slot : scheduler.slots)
+    slot.message.reset();
+  scheduler.queue = EventQueue::create(queueType);
+  scheduler.slots.clear();
+  scheduler.slots.resize(generations.size());
+  for (size_t index = 0; index < generations.size(); index++)
+    scheduler.slots[index].generation = generations[index];
+  scheduler.freeSlots = std::move(freeSlots);
+  scheduler.currentTime = currentTime;
+  nextSeq = seq;
 
-  auto it = registeredModule.find(moduleID);
-  if (it != registeredModule.end()) {
-    return it->second->getModuleName();
+  std::istringstream systemState(system);
+  readCheckpoint(systemState);
+  for (ModuleID id = 1; id < registeredModule.size(); id++) {
+    if (registeredModule[id] == nullptr)
+      continue;
+    std::istringstream state(states[id]);
+    registeredModule[id]->readCheckpoint(state);
+  }
+
+  // the senders rebuild their messages
+  for (Pending &event : pending) {
+    EventSlot &slot = scheduler.slots[event.index];
+    slot.wakeup = event.wakeup;
+    slot.seq = event.seq;
+    slot.from = event.from;
+    slot.to = event.to;
+    slot.sender = registeredModule[event.from].get();
+    slot.receiver = registeredModule[event.to].get();
+    std::istringstream message(event.message);
+    slot.message = slot.sender->readMessage(event.tag, message);
+    assert(slot.message != nullptr);
+    slot.message->oneWay = event.oneWay;
+    scheduler.queue->push({slot.wakeup, slot.seq, event.index});
+  }
+  return true;
+}
+
+void System::writeCheckpoint(std::ostream &out) {
+  Checkpoint::write(out, randomEngine.has_value());
+  if (randomEngine) {
+    std::ostringstream engine;
+    engine << *randomEngine;
+    Checkpoint::write(out, engine.str());
+  }
+}
+
+void System::readCheckpoint(std::istream &in) {
+  randomEngine.reset();
+  if (Checkpoint::read<bool>(in)) {
+    std::istringstream engine(Checkpoint::readString(in));
+    engine >> randomEngine.emplace();
+  }
+}
+
+std::string System::getModuleName(const ModuleID moduleID) {
+  if (isRegistered(moduleID)) {
+    return registeredModule[moduleID]->getModuleName();
   } else {
     return "Nill";
   }
 }
-const ModuleID System::newModuleID() {
-  static ModuleID next = 1;
-  return next++;
-}
+const ModuleID System::newModuleID() { return nextModuleID++; }
 
 ModuleID System::lookupModuleID(Module &module) { return module.id; }
 
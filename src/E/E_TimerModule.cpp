@@ -17,7 +17,19 @@ TimerModule::~TimerModule() {}
 std::string TimerModule::getTimerModuleName() { return name; }
 
 UUID TimerModule::addTimer(std::any payload, Time timeAfter) {
-  return host.addTimer(name, payload, timeAfter);
+  return addTimer(std::move(payload), timeAfter, 0);
+}
+
+UUID TimerModule::addTimer(std::any payload, Time timeAfter, Time slack) {
+  return host.addTimer(name, payload, timeAfter, slack);
+}
+
+UUID TimerModule::addPeriodicTimer(std::any payload, Time period) {
+  return host.addPeriodicTimer(name, payload, period);
+}
+
+void TimerModule::modifyPeriodicTimer(UUID key, Time period) {
+  host.modifyPeriodicTimer(key, period);
 }
 
 void TimerModule::cancelTimer(UUID key) { host.cancelTimer(key); }
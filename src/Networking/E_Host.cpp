@@ -5,16 +5,113 @@
  *      Author: Keunhong Lee
  */
 
+#include <E/E_Checkpoint.hpp>
 #include <E/E_Module.hpp>
 #include <E/E_System.hpp>
 #include <E/E_TimeUtil.hpp>
+#include <E/Networking/E_HeaderView.hpp>
 #include <E/Networking/E_Host.hpp>
 #include <E/Networking/E_Link.hpp>
+#include <E/Networking/E_NetworkUtil.hpp>
 #include <E/Networking/E_Networking.hpp>
 #include <E/Networking/E_Packet.hpp>
 #include <E/Networking/E_Wire.hpp>
 
 namespace E {
+
+// FNV-1a of the addresses, protocol and ports of a flow
+static uint32_t hashFlow(const ipv4_t &src, const ipv4_t &dst,
+                         uint8_t protocol, uint16_t srcPort,
+                         uint16_t dstPort) {
+  uint32_t hash = 2166136261U;
+  auto mix = [&hash](uint8_t byte) { hash = (hash ^ byte) * 16777619U; };
+  for (uint8_t byte : src)
+    mix(byte);
+  for (uint8_t byte : dst)
+    mix(byte);
+  mix(protocol);
+  mix(srcPort >> 8);
+  mix(srcPort);
+  mix(dstPort >> 8);
+  mix(dstPort);
+  return hash;
+}
+
+// Whether the TCP checksum of a frame is valid. A segment split across
+// segments of the packet is left to the stack.
+static bool verifyTCP(const Packet &frame, const ConstIPv4HeaderView &ip,
+                      size_t transportStart) {
+  if (ip.totalLength() < ip.headerLength() + TCPHeaderView::SIZE)
+    return false;
+  const size_t length = ip.totalLength() - ip.headerLength();
+  const uint8_t *segment = frame.accessData(transportStart, length);
+  if (segment == nullptr)
+    return false;
+  uint32_t source, dest; // in network order, as tcp_sum takes them
+  memcpy(&source, ip.source().data(), sizeof(source));
+  memcpy(&dest, ip.destination().data(), sizeof(dest));
+  return NetworkUtil::tcp_sum(source, dest, segment, length) == 0xFFFF;
+}
+
+// Parses the headers of a frame arrived at the given port, once for all the
+// modules of the Host. A port with receive offload trusts partial checksums,
+// and verifies the others; without it, they are computed for the stack.
+static void annotate(Packet &packet, int port,
+                     const Host::ChecksumOffload &offload) {
+  if (!offload.receive)
+    NetworkUtil::checksum_finalize(packet);
+  const Packet &frame = packet;
+  const bool partial = frame.getMetadata().checksumPartial;
+  Packet::Metadata metadata;
+  metadata.port = port;
+  metadata.checksumPartial = partial;
+
+  const uint8_t *ethernet = frame.accessData(0, EthernetHeaderView::SIZE);
+  const size_t ipStart = EthernetHeaderView::SIZE;
+  const uint8_t *network = frame.accessData(ipStart, IPv4HeaderView::SIZE);
+  if (ethernet == nullptr || network == nullptr ||
+      ConstEthernetHeaderView(ethernet).etherType() !=
+          EthernetHeaderView::IPV4) {
+    packet.getMetadata() = metadata;
+    return;
+  }
+  ConstIPv4HeaderView ip(network);
+  metadata.networkOffset = ipStart;
+  metadata.protocol = ip.protocol();
+  metadata.checksumVerified =
+      partial || NetworkUtil::one_sum(network, IPv4HeaderView::SIZE) == 0xFFFF;
+
+  const size_t transportStart = ipStart + ip.headerLength();
+  uint16_t srcPort = 0, dstPort = 0;
+  if (ip.headerLength() < IPv4HeaderView::SIZE) {
+    // malformed; left to IPv4
+  } else if (ip.protocol() == IPv4HeaderView::TCP) {
+    if (const uint8_t *transport =
+            frame.accessData(transportStart, TCPHeaderView::SIZE)) {
+      ConstTCPHeaderView tcp(transport);
+      metadata.transportOffset = transportStart;
+      metadata.payloadOffset = transportStart + tcp.headerLength();
+      srcPort = tcp.sourcePort();
+      dstPort = tcp.destinationPort();
+      if (offload.receive)
+        metadata.transportChecksumVerified =
+            partial || verifyTCP(frame, ip, transportStart);
+    }
+  } else if (ip.protocol() == IPv4HeaderView::UDP) {
+    if (const uint8_t *transport =
+            frame.accessData(transportStart, UDPHeaderView::SIZE)) {
+      ConstUDPHeaderView udp(transport);
+      metadata.transportOffset = transportStart;
+      metadata.payloadOffset = transportStart + UDPHeaderView::SIZE;
+      srcPort = udp.sourcePort();
+      dstPort = udp.destinationPort();
+    }
+  }
+  metadata.flowHash = hashFlow(ip.source(), ip.destination(), ip.protocol(),
+                               srcPort, dstPort);
+  packet.getMetadata() = metadata;
+}
+
 Host::Host(std::string name, NetworkSystem &system)
     : NetworkModule(system), NetworkLog(static_cast<System &>(system)),
       networkSystem(system) {
@@ -22,6 +119,7 @@ Host::Host(std::string name, NetworkSystem &system)
   ports.clear();
   this->pidStart = 0;
   this->syscallIDStart = 0;
+  this->nextTimerID = 1;
   addHostModule<DefaultSystemCall>(std::ref(*this));
 
   this->running = true;
@@ -49,8 +147,9 @@ int Host::cleanUp(void) {
 
 Module::Message Host::messageReceived(const ModuleID from,
                                       Module::MessageBase &message) {
-  if (typeid(message) == typeid(Wire::Message &)) {
-    Wire::Message &portMessage = dynamic_cast<Wire::Message &>(message);
+  switch (message.getTag()) {
+  case Wire::Message::TAG: {
+    Wire::Message &portMessage = static_cast<Wire::Message &>(message);
     assert(portMessage.type == Wire::MessageType::PACKET_FROM_PORT);
     if (this->running == true) {
       print_log(PACKET_FROM_HOST,
@@ -59,20 +158,54 @@ Module::Message Host::messageReceived(const ModuleID from,
                 this->getModuleName(from).c_str());
       // this->freePacket(hostMessage->packet);
 
+      auto port = std::find(ports.begin(), ports.end(), from);
+      assert(port != ports.end());
+      const size_t portIndex = port - ports.begin();
+      annotate(portMessage.packet, portIndex, getChecksumOffload(portIndex));
       this->sendPacketToModule({}, "Ethernet", std::move(portMessage.packet));
     }
-    return nullptr;
+    break;
   }
-
-  if (typeid(message) == typeid(PacketPass &)) {
-    PacketPass &packetPass = dynamic_cast<PacketPass &>(message);
+  case PacketPass::TAG: {
+    PacketPass &packetPass = static_cast<PacketPass &>(message);
     if (this->running == true) {
       std::string fromName = packetPass.from.value_or("Host");
       hostModuleMap[packetPass.to.value()]->packetArrived(
           fromName, std::move(packetPass.packet));
     }
-  } else if (typeid(message) == typeid(Syscall &)) {
-    Syscall &syscall = dynamic_cast<Syscall &>(message);
+    break;
+  }
+  case Wire::BatchMessage::TAG: {
+    auto &batchMessage = static_cast<Wire::BatchMessage &>(message);
+    assert(batchMessage.type == Wire::MessageType::PACKET_FROM_PORT);
+    if (this->running == true) {
+      print_log(PACKET_FROM_HOST,
+                "Host [%s] get a batch [packets:%zu] from module [%s]",
+                this->getModuleName().c_str(), batchMessage.batch.size(),
+                this->getModuleName(from).c_str());
+
+      auto port = std::find(ports.begin(), ports.end(), from);
+      assert(port != ports.end());
+      const size_t portIndex = port - ports.begin();
+      const ChecksumOffload offload = getChecksumOffload(portIndex);
+      for (Packet &packet : batchMessage.batch)
+        annotate(packet, portIndex, offload);
+      this->sendPacketToModule({}, "Ethernet",
+                               std::move(batchMessage.batch));
+    }
+    break;
+  }
+  case PacketBatchPass::TAG: {
+    auto &batchPass = static_cast<PacketBatchPass &>(message);
+    if (this->running == true) {
+      std::string fromName = batchPass.from.value_or("Host");
+      hostModuleMap[batchPass.to.value()]->packetsArrived(
+          fromName, std::move(batchPass.batch));
+    }
+    break;
+  }
+  case Syscall::TAG: {
+    Syscall &syscall = static_cast<Syscall &>(message);
 
     assert(syscall.pid != -1);
     auto appIter = this->processInfoMap.find(syscall.pid);
@@ -138,11 +271,27 @@ Module::Message Host::messageReceived(const ModuleID from,
                 this->getModuleName().c_str());
       iface->systemCallback(curSyscallID, syscall.pid, syscall.param);
     }
-  } else if (typeid(message) == typeid(Timer &)) {
-    Timer &timer = dynamic_cast<Timer &>(message);
+    break;
+  }
+  case Timer::TAG: {
+    Timer &timer = static_cast<Timer &>(message);
     timerModuleMap[timer.from]->timerCallback(timer.payload);
-  } else if (typeid(message) == typeid(Return &)) {
-    Return &ret = dynamic_cast<Return &>(message);
+    break;
+  }
+  case Timers::TAG: {
+    ringTimers();
+    break;
+  }
+  case PeriodicTimer::TAG: {
+    // re-armed by messageFinished, unless cancelled or modified meanwhile
+    Periodic &periodic =
+        periodicTimers.at(static_cast<PeriodicTimer &>(message).timer);
+    periodic.event = 0;
+    timerModuleMap[periodic.from]->timerCallback(periodic.payload);
+    break;
+  }
+  case Return::TAG: {
+    Return &ret = static_cast<Return &>(message);
     auto iter = processInfoMap.find(ret.pid);
     assert(iter != processInfoMap.end());
 
@@ -157,8 +306,9 @@ Module::Message Host::messageReceived(const ModuleID from,
 
     print_log(APPLICATION_RETRUN, "Application [ pid: %d] returend %d", ret.pid,
               ret.returnValue);
-
-  } else {
+    break;
+  }
+  default:
     assert(0);
   }
 
@@ -167,12 +317,181 @@ Module::Message Host::messageReceived(const ModuleID from,
 void Host::messageFinished(const ModuleID to, Module::Message message,
                            Module::MessageBase &response) {
   (void)to;
-  assert(Module::EmptyMessage::shared() ==
-         dynamic_cast<Module::EmptyMessage &>(response));
+  assert(response.getTag() == Module::EmptyMessage::TAG);
+  if (message->getTag() == PeriodicTimer::TAG) {
+    const UUID key = static_cast<PeriodicTimer &>(*message).timer;
+    auto iter = periodicTimers.find(key);
+    if (iter != periodicTimers.end() && iter->second.event == 0)
+      armPeriodicTimer(key, std::move(message));
+    else
+      spareTicks.push_back(std::move(message));
+  }
 }
 
 void Host::messageCancelled(const ModuleID to, Module::Message message) {
   (void)to;
+  if (message->getTag() == PeriodicTimer::TAG)
+    spareTicks.push_back(std::move(message));
+}
+
+bool Host::writeCheckpoint(std::ostream &out) {
+  // Runnables cannot be saved
+  if (!processInfoMap.empty() || !syscallMap.empty())
+    return false;
+  Checkpoint::write(out, running);
+  Checkpoint::write(out, pidStart);
+  Checkpoint::write(out, syscallIDStart);
+
+  std::map<std::string, HostModule *> sorted;
+  for (auto &[name, hostModule] : hostModuleMap)
+    sorted[name] = hostModule.get();
+  Checkpoint::write(out, (uint64_t)sorted.size());
+  for (auto &[name, hostModule] : sorted) {
+    std::ostringstream state;
+    if (!hostModule->writeCheckpoint(state))
+      return false;
+    Checkpoint::write(out, name);
+    Checkpoint::write(out, state.str());
+  }
+
+  Checkpoint::write(out, nextTimerID);
+  Checkpoint::write(out, (uint64_t)timerBuckets.size());
+  for (auto &[wakeup, bucket] : timerBuckets) {
+    Checkpoint::write(out, wakeup);
+    Checkpoint::write(out, bucket.event);
+    Checkpoint::write(out, (uint64_t)bucket.timers.size());
+    for (UUID id : bucket.timers) {
+      const CoalescedTimer &timer = coalescedTimers.at(id);
+      Checkpoint::write(out, id);
+      Checkpoint::write(out, timer.from);
+      Checkpoint::write(out, timer.deadline);
+      if (!timerModuleMap[timer.from]->writeTimerPayload(timer.payload, out))
+        return false;
+    }
+  }
+
+  std::map<UUID, const Periodic *> periodic;
+  for (auto &[id, timer] : periodicTimers)
+    periodic[id] = &timer;
+  Checkpoint::write(out, (uint64_t)periodic.size());
+  for (auto &[id, timer] : periodic) {
+    Checkpoint::write(out, id);
+    Checkpoint::write(out, timer->from);
+    Checkpoint::write(out, timer->period);
+    Checkpoint::write(out, timer->event);
+    if (!timerModuleMap[timer->from]->writeTimerPayload(timer->payload, out))
+      return false;
+  }
+  return true;
+}
+
+void Host::readCheckpoint(std::istream &in) {
+  running = Checkpoint::read<bool>(in);
+  pidStart = Checkpoint::read<int>(in);
+  syscallIDStart = Checkpoint::read<UUID>(in);
+  for (uint64_t k = Checkpoint::read<uint64_t>(in); k > 0; k--) {
+    std::string name = Checkpoint::readString(in);
+    std::istringstream state(Checkpoint::readString(in));
+    hostModuleMap.at(name)->readCheckpoint(state);
+  }
+
+  nextTimerID = Checkpoint::read<UUID>(in);
+  coalescedTimers.clear();
+  timerBuckets.clear();
+  for (uint64_t k = Checkpoint::read<uint64_t>(in); k > 0; k--) {
+    Time wakeup = Checkpoint::read<Time>(in);
+    TimerBucket &bucket = timerBuckets[wakeup];
+    bucket.event = Checkpoint::read<UUID>(in);
+    for (uint64_t n = Checkpoint::read<uint64_t>(in); n > 0; n--) {
+      UUID id = Checkpoint::read<UUID>(in);
+      CoalescedTimer &timer = coalescedTimers[id];
+      timer.from = Checkpoint::readString(in);
+      timer.deadline = Checkpoint::read<Time>(in);
+      timer.payload = timerModuleMap.at(timer.from)->readTimerPayload(in);
+      timer.wakeup = wakeup;
+      bucket.timers.push_back(id);
+    }
+  }
+
+  periodicTimers.clear();
+  for (uint64_t k = Checkpoint::read<uint64_t>(in); k > 0; k--) {
+    Periodic &timer = periodicTimers[Checkpoint::read<UUID>(in)];
+    timer.from = Checkpoint::readString(in);
+    timer.period = Checkpoint::read<Time>(in);
+    timer.event = Checkpoint::read<UUID>(in);
+    timer.payload = timerModuleMap.at(timer.from)->readTimerPayload(in);
+  }
+}
+
+static void writeName(std::ostream &out,
+                      const std::optional<std::string> &name) {
+  Checkpoint::write(out, name.has_value());
+  if (name)
+    Checkpoint::write(out, *name);
+}
+
+static std::optional<std::string> readName(std::istream &in) {
+  if (!Checkpoint::read<bool>(in))
+    return {};
+  return Checkpoint::readString(in);
+}
+
+bool Host::writeMessage(const MessageBase &message, std::ostream &out) {
+  switch (message.getTag()) {
+  case PacketPass::TAG: {
+    auto &packetPass = static_cast<const PacketPass &>(message);
+    writeName(out, packetPass.from);
+    writeName(out, packetPass.to);
+    packetPass.packet.writePacket(out);
+    return true;
+  }
+  case PacketBatchPass::TAG: {
+    auto &batchPass = static_cast<const PacketBatchPass &>(message);
+    writeName(out, batchPass.from);
+    writeName(out, batchPass.to);
+    batchPass.batch.writeBatch(out);
+    return true;
+  }
+  case Timer::TAG: {
+    auto &timer = static_cast<const Timer &>(message);
+    Checkpoint::write(out, timer.from);
+    return timerModuleMap[timer.from]->writeTimerPayload(timer.payload, out);
+  }
+  case Timers::TAG:
+    return true; // the timers are saved with the Host
+  case PeriodicTimer::TAG:
+    Checkpoint::write(out, static_cast<const PeriodicTimer &>(message).timer);
+    return true;
+  default:
+    return NetworkModule::writeMessage(message, out);
+  }
+}
+
+Module::Message Host::readMessage(MessageTag tag, std::istream &in) {
+  switch (tag) {
+  case PacketPass::TAG: {
+    std::optional<std::string> from = readName(in);
+    std::optional<std::string> to = readName(in);
+    return std::make_unique<PacketPass>(from, to, Packet::readPacket(in));
+  }
+  case PacketBatchPass::TAG: {
+    std::optional<std::string> from = readName(in);
+    std::optional<std::string> to = readName(in);
+    return std::make_unique<PacketBatchPass>(from, to,
+                                             PacketBatch::readBatch(in));
+  }
+  case Timer::TAG: {
+    std::string from = Checkpoint::readString(in);
+    return std::make_unique<Timer>(
+        from, timerModuleMap.at(from)->readTimerPayload(in));
+  }
+  case Timers::TAG:
+    return std::make_unique<Timers>();
+  case PeriodicTimer::TAG:
+    return std::make_unique<PeriodicTimer>(Checkpoint::read<UUID>(in));
+  default:
+    return NetworkModule::readMessage(tag, in);
+  }
 }
 
 std::any Host::diagnoseHostModule(const char *moduleName, std::any arg) {
@@ -185,10 +504,28 @@ void Host::sendPacket(size_t portIndex, Packet &&packet) {
     return;
   }
 
+  if (!getChecksumOffload(portIndex).transmit)
+    NetworkUtil::checksum_finalize(packet);
+
   auto portID = ports[portIndex];
   auto portMessage =
       std::make_unique<Wire::Message>(Wire::PACKET_TO_PORT, std::move(packet));
-  sendMessage(portID, std::move(portMessage), 0);
+  postMessage(portID, std::move(portMessage), 0);
+}
+void Host::sendPacket(size_t portIndex, PacketBatch &&batch) {
+  assert(portIndex < ports.size());
+  if (this->running == false) {
+    return;
+  }
+
+  if (!getChecksumOffload(portIndex).transmit)
+    for (Packet &packet : batch)
+      NetworkUtil::checksum_finalize(packet);
+
+  auto portID = ports[portIndex];
+  auto batchMessage = std::make_unique<Wire::BatchMessage>(Wire::PACKET_TO_PORT,
+                                                           std::move(batch));
+  postMessage(portID, std::move(batchMessage), 0);
 }
 
 Host::DefaultSystemCall::DefaultSystemCall(Host &host)
@@ -242,6 +579,13 @@ void HostModule::sendPacket(std::string toModule, Packet &&packet) {
 void HostModule::sendPacket(std::string toModule, const Packet &packet) {
   sendPacket(toModule, Packet(packet));
 }
+void HostModule::sendPacket(std::string toModule, PacketBatch &&batch) {
+  host.sendPacketToModule(name, toModule, std::move(batch));
+}
+void HostModule::packetsArrived(std::string fromModule, PacketBatch &&batch) {
+  for (Packet &packet : batch)
+    packetArrived(fromModule, std::move(packet));
+}
 Time HostModule::getCurrentTime() { return host.getCurrentTime(); }
 
 Size HostModule::getWireSpeed(int port_num) {
@@ -272,23 +616,27 @@ void SystemCallInterface::removeFileDescriptor(int processID, int fd) {
   return host.removeFileDescriptor(processID, fd);
 }
 
+int Host::selectPort(const Packet &packet) {
+  mac_t my_mac;
+  packet.readData(6, my_mac.data(), 6);
+
+  int selected_port = 0;
+  for (size_t k = 0; k < this->ports.size(); k++) {
+    auto port_mac = this->getMACAddr(k);
+    if (my_mac == port_mac.value()) {
+      selected_port = (int)k;
+      break;
+    }
+  }
+  return selected_port;
+}
+
 void Host::sendPacketToModule(std::optional<std::string> fromModule,
                               std::string toModule, Packet &&packet) {
   auto it = hostModuleMap.find(toModule);
 
   if (toModule.compare("Host") == 0) {
-    mac_t my_mac;
-    packet.readData(6, my_mac.data(), 6);
-
-    int selected_port = 0;
-    for (size_t k = 0; k < this->ports.size(); k++) {
-      auto port_mac = this->getMACAddr(k);
-      if (my_mac == port_mac.value()) {
-        selected_port = (int)k;
-        break;
-      }
-    }
-    this->sendPacket(selected_port, std::move(packet));
+    this->sendPacket(selectPort(packet), std::move(packet));
   } else if (it == hostModuleMap.end()) {
     print_log(MODULE_ERROR, "No module named [%s] has found. Drop packet.",
               toModule.c_str());
@@ -296,24 +644,144 @@ void Host::sendPacketToModule(std::optional<std::string> fromModule,
     auto hostMessage = std::make_unique<PacketPass>(
         std::move(fromModule), std::move(toModule), std::move(packet));
 
-    this->sendMessageSelf(std::move(hostMessage),
+    this->postMessageSelf(std::move(hostMessage),
                           0); // DELAY module packet transfer delay
   }
 }
 
-UUID Host::addTimer(std::string fromModule, std::any payload, Time timeAfter) {
-  auto timerMessage = std::make_unique<Timer>(fromModule, payload);
-  return this->sendMessageSelf(std::move(timerMessage), timeAfter);
+void Host::sendPacketToModule(std::optional<std::string> fromModule,
+                              std::string toModule, PacketBatch &&batch) {
+  auto it = hostModuleMap.find(toModule);
+
+  if (toModule.compare("Host") == 0) {
+    // a burst normally leaves by one port, or else by a batch per port
+    std::map<int, PacketBatch> byPort;
+    for (Packet &packet : batch)
+      byPort[selectPort(packet)].add(std::move(packet));
+    for (auto &[port, portBatch] : byPort)
+      this->sendPacket(port, std::move(portBatch));
+  } else if (it == hostModuleMap.end()) {
+    print_log(MODULE_ERROR, "No module named [%s] has found. Drop packets.",
+              toModule.c_str());
+  } else {
+    auto batchPass = std::make_unique<PacketBatchPass>(
+        std::move(fromModule), std::move(toModule), std::move(batch));
+    this->postMessageSelf(std::move(batchPass), 0);
+  }
+}
+
+UUID Host::addTimer(std::string fromModule, std::any payload, Time timeAfter,
+                    Time slack) {
+  if (slack == 0) {
+    auto timerMessage = std::make_unique<Timer>(fromModule, payload);
+    return this->postMessageSelf(std::move(timerMessage), timeAfter);
+  }
+
+  // join the first wakeup within [deadline, deadline + slack], or add one as
+  // late as allowed so that later timers can join it too
+  const Time deadline = getCurrentTime() + timeAfter;
+  auto bucket = timerBuckets.lower_bound(deadline);
+  if (bucket == timerBuckets.end() || bucket->first - deadline > slack) {
+    bucket = timerBuckets.emplace_hint(bucket, deadline + slack, TimerBucket());
+    bucket->second.event =
+        this->postMessageSelf(std::make_unique<Timers>(), timeAfter + slack);
+  }
+
+  // UUIDs of messages are at least 2^32 (see System::sendMessage), so the
+  // IDs of coalesced and periodic timers count from 1
+  const UUID id = nextTimerID++;
+  assert(nextTimerID < ((UUID)1 << 32));
+  coalescedTimers[id] = {fromModule, std::move(payload), deadline,
+                         bucket->first};
+  bucket->second.timers.push_back(id);
+  return id;
 }
 
-void Host::cancelTimer(UUID key) { this->cancelMessage(key); }
+void Host::cancelTimer(UUID key) {
+  auto periodic = periodicTimers.find(key);
+  if (periodic != periodicTimers.end()) {
+    const UUID event = periodic->second.event;
+    periodicTimers.erase(periodic);
+    if (event != 0)
+      this->cancelMessage(event);
+    return;
+  }
+
+  auto iter = coalescedTimers.find(key);
+  if (iter == coalescedTimers.end()) {
+    this->cancelMessage(key);
+    return;
+  }
+
+  // the bucket is gone if it is ringing now
+  auto bucket = timerBuckets.find(iter->second.wakeup);
+  if (bucket != timerBuckets.end()) {
+    std::vector<UUID> &timers = bucket->second.timers;
+    timers.erase(std::find(timers.begin(), timers.end(), key));
+    if (timers.empty()) {
+      this->cancelMessage(bucket->second.event);
+      timerBuckets.erase(bucket);
+    }
+  }
+  coalescedTimers.erase(iter);
+}
+
+UUID Host::addPeriodicTimer(std::string fromModule, std::any payload,
+                            Time period) {
+  const UUID id = nextTimerID++;
+  assert(nextTimerID < ((UUID)1 << 32));
+  periodicTimers[id] = {fromModule, std::move(payload), period, 0};
+  armPeriodicTimer(id, nullptr);
+  return id;
+}
+
+void Host::modifyPeriodicTimer(UUID key, Time period) {
+  Periodic &periodic = periodicTimers.at(key);
+  periodic.period = period;
+  if (periodic.event == 0)
+    return; // ringing now, re-armed with the new period afterwards
+  this->cancelMessage(periodic.event);
+  armPeriodicTimer(key, nullptr);
+}
+
+void Host::armPeriodicTimer(UUID key, Module::Message tick) {
+  if (tick == nullptr && !spareTicks.empty()) {
+    tick = std::move(spareTicks.back());
+    spareTicks.pop_back();
+  }
+  if (tick == nullptr)
+    tick = std::make_unique<PeriodicTimer>(key);
+  static_cast<PeriodicTimer &>(*tick).timer = key;
+  Periodic &periodic = periodicTimers.at(key);
+  periodic.event = this->sendMessageSelf(std::move(tick), periodic.period);
+}
+
+void Host::ringTimers() {
+  auto bucket = timerBuckets.find(getCurrentTime());
+  assert(bucket != timerBuckets.end());
+  std::vector<UUID> timers = std::move(bucket->second.timers);
+  timerBuckets.erase(bucket);
+
+  // in the order they would have rung without slack
+  std::stable_sort(timers.begin(), timers.end(), [this](UUID a, UUID b) {
+    return coalescedTimers.at(a).deadline < coalescedTimers.at(b).deadline;
+  });
+  for (UUID id : timers) {
+    auto iter = coalescedTimers.find(id);
+    if (iter == coalescedTimers.end())
+      continue; // cancelled by an earlier callback
+    CoalescedTimer timer = std::move(iter->second);
+    coalescedTimers.erase(iter);
+    timerModuleMap[timer.from]->timerCallback(std::move(timer.payload));
+  }
+}
 
 UUID Host::issueSystemCall(
     int pid, const SystemCallInterface::SystemCallParameter &param) {
 
   auto hostMessage = std::make_unique<Syscall>(pid, param);
 
-  return this->sendMessageSelf(std::move(hostMessage), 0);
+  return this->postMessageSelf(std::move(hostMessage), 0);
 }
 
 void Host::returnSystemCall(UUID syscallUUID, int val) {
@@ -406,10 +874,27 @@ Size Host::getWireSpeed(int port_num) {
   return networkSystem.getWireSpeed(ports[port_num]);
 }
 
+void Host::setChecksumOffload(size_t portIndex, ChecksumOffload offload) {
+  assert(portIndex < ports.size());
+  if (offloads.size() <= portIndex)
+    offloads.resize(portIndex + 1);
+  offloads[portIndex] = offload;
+}
+
+Host::ChecksumOffload Host::getChecksumOffload(size_t portIndex) {
+  if (portIndex < offloads.size())
+    return offloads[portIndex];
+  return ChecksumOffload();
+}
+
+RunnableType Host::getRunnableType() {
+  return networkSystem.getRunnableType();
+}
+
 void Host::exitProcess(int pid, int returnValue) {
 
   auto retMessage = std::make_unique<Return>(pid, returnValue);
-  sendMessageSelf(std::move(retMessage), 0);
+  postMessageSelf(std::move(retMessage), 0);
 }
 
 void SystemCallApplication::finalizeApplication(int returnValue) {
@@ -423,7 +908,7 @@ void SystemCallApplication::main() {
 }
 
 SystemCallApplication::SystemCallApplication(Host &host)
-    : Runnable(), host(host), pid(-1) {}
+    : Runnable(host.getRunnableType()), host(host), pid(-1) {}
 SystemCallApplication::~SystemCallApplication() {}
 
 void SystemCallApplication::initialize() { start(); }
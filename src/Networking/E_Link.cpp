@@ -5,13 +5,17 @@
  *      Author: Keunhong Lee
  */
 
+#include <E/E_Checkpoint.hpp>
 #include <E/E_Common.hpp>
 #include <E/E_TimeUtil.hpp>
 #include <E/Networking/E_Link.hpp>
+#include <E/Networking/E_NetworkUtil.hpp>
 #include <E/Networking/E_Networking.hpp>
 #include <E/Networking/E_Packet.hpp>
 #include <E/Networking/E_Wire.hpp>
 
+#include <filesystem>
+
 namespace E {
 
 struct pcap_packet_header {
@@ -23,82 +27,178 @@ struct pcap_packet_header {
 
 Module::Message Link::messageReceived(const ModuleID from,
                                       Module::MessageBase &message) {
-  if (typeid(message) == typeid(Wire::Message &)) {
-    Wire::Message &portMessage = dynamic_cast<Wire::Message &>(message);
+  if (auto *portMessage = messageCast<Wire::Message>(message)) {
+    this->packetArrived(from, std::move(portMessage->packet));
+  }
 
-    this->packetArrived(from, std::move(portMessage.packet));
+  if (auto *batchMessage = messageCast<Wire::BatchMessage>(message)) {
+    this->packetsArrived(from, std::move(batchMessage->batch));
   }
 
-  if (typeid(message) == typeid(Link::Message &)) {
-    Link::Message &selfMessage = dynamic_cast<Link::Message &>(message);
-    if (selfMessage.type == CHECK_QUEUE) {
-      const ModuleID wireID = selfMessage.wireID;
-      std::list<Packet> &current_queue = this->outputQueue[wireID];
-      assert(current_queue.size() > 0);
-      Time current_time = this->getCurrentTime();
-      Time &avail_time = this->nextAvailable[wireID];
-
-      if (current_time >= avail_time) {
-        Packet packet = current_queue.front();
-        current_queue.pop_front();
-
-        print_log(NetworkLog::PACKET_QUEUE,
-                  "Output queue length for port[%s] decreased to [%zu]",
-                  this->getModuleName(wireID).c_str(), current_queue.size());
-
-        Time trans_delay = 0;
-        if (this->bps != 0)
-          trans_delay = (((Real)packet.getSize() * 8 * (1000 * 1000 * 1000UL)) /
-                         (Real)this->bps);
-
-        auto portMessage2 = std::make_unique<Wire::Message>(
-            Wire::PACKET_TO_PORT, Packet(packet)); // explicit copy for pcap
-
-        avail_time = current_time + trans_delay;
-
-        if (pcap_enabled) {
-          struct pcap_packet_header pcap_header;
-          memset(&pcap_header, 0, sizeof(pcap_header));
-          pcap_header.ts_sec = TimeUtil::getTime(current_time, TimeUtil::SEC);
-          pcap_header.ts_usec =
-              (TimeUtil::getTime(current_time, TimeUtil::NSEC) % 1000000000);
-          pcap_header.incl_len = std::min(snaplen, packet.getSize());
-          pcap_header.orig_len = packet.getSize();
-          // nanosecond precision
-          pcap_file.write((char *)&pcap_header, sizeof(pcap_header));
-
-          std::vector<char> temp_buffer(pcap_header.incl_len);
-          packet.readData(0, temp_buffer.data(), pcap_header.incl_len);
-          pcap_file.write(temp_buffer.data(), pcap_header.incl_len);
-        }
-
-        this->sendMessage(wireID, std::move(portMessage2), trans_delay);
-
-        if (current_queue.size() > 0) {
-          Time wait_time = 0;
-          if (avail_time > current_time)
-            wait_time += (avail_time - current_time);
-          assert(wait_time == trans_delay);
-          auto selfMessage =
-              std::make_unique<Link::Message>(Link::CHECK_QUEUE, wireID);
-
-          this->sendMessageSelf(std::move(selfMessage), wait_time);
-        }
-      }
-    }
+  if (auto *selfMessage = messageCast<Link::Message>(message)) {
+    if (selfMessage->type == CHECK_QUEUE)
+      checkQueue(selfMessage->wireID);
   }
 
   return nullptr;
 }
+
+void Link::messagesReceivedBatch(std::vector<Delivery> &batch) {
+  // e.g. copies of a frame flooded by a Switch, arriving from every port
+  for (Delivery &delivery : batch) {
+    Module::MessageBase &message = *delivery.message;
+    if (auto *portMessage = messageCast<Wire::Message>(message)) {
+      this->packetArrived(delivery.from, std::move(portMessage->packet));
+    } else if (auto *batchMessage = messageCast<Wire::BatchMessage>(message)) {
+      this->packetsArrived(delivery.from, std::move(batchMessage->batch));
+    } else if (auto *selfMessage = messageCast<Link::Message>(message)) {
+      if (selfMessage->type == CHECK_QUEUE)
+        checkQueue(selfMessage->wireID);
+    }
+  }
+}
+
+void Link::packetsArrived(const ModuleID inWireID, PacketBatch &&batch) {
+  for (Packet &packet : batch)
+    this->packetArrived(inWireID, std::move(packet));
+}
+
+void Link::checkQueue(const ModuleID wireID) {
+  std::list<Packet> &current_queue = this->outputQueue[wireID];
+  assert(current_queue.size() > 0);
+  Time current_time = this->getCurrentTime();
+  Time &avail_time = this->nextAvailable[wireID];
+
+  if (current_time >= avail_time) {
+    Packet packet = std::move(current_queue.front());
+    current_queue.pop_front();
+
+    print_log(NetworkLog::PACKET_QUEUE,
+              "Output queue length for port[%s] decreased to [%zu]",
+              this->getModuleName(wireID).c_str(), current_queue.size());
+
+    Time trans_delay = 0;
+    if (this->bps != 0)
+      trans_delay = (((Real)packet.getSize() * 8 * (1000 * 1000 * 1000UL)) /
+                     (Real)this->bps);
+
+    avail_time = current_time + trans_delay;
+
+    if (pcap_enabled) {
+      struct pcap_packet_header pcap_header;
+      memset(&pcap_header, 0, sizeof(pcap_header));
+      pcap_header.ts_sec = TimeUtil::getTime(current_time, TimeUtil::SEC);
+      pcap_header.ts_usec =
+          (TimeUtil::getTime(current_time, TimeUtil::NSEC) % 1000000000);
+      pcap_header.incl_len = std::min(snaplen, packet.getSize());
+      pcap_header.orig_len = packet.getSize();
+      // nanosecond precision
+      pcap_file.write((char *)&pcap_header, sizeof(pcap_header));
+
+      if (packet.getMetadata().checksumPartial) {
+        // captured as the port would send it; the packet itself stays partial
+        Packet captured = packet;
+        NetworkUtil::checksum_finalize(captured);
+        captured.readData(0, pcap_file, pcap_header.incl_len);
+      } else {
+        packet.readData(0, pcap_file, pcap_header.incl_len);
+      }
+    }
+
+    auto portMessage2 = std::make_unique<Wire::Message>(Wire::PACKET_TO_PORT,
+                                                        std::move(packet));
+    this->postMessage(wireID, std::move(portMessage2), trans_delay);
+
+    if (current_queue.size() > 0) {
+      Time wait_time = 0;
+      if (avail_time > current_time)
+        wait_time += (avail_time - current_time);
+      assert(wait_time == trans_delay);
+      auto selfMessage =
+          std::make_unique<Link::Message>(Link::CHECK_QUEUE, wireID);
+
+      this->postMessageSelf(std::move(selfMessage), wait_time);
+    }
+  }
+}
+
 void Link::messageFinished(const ModuleID to, Module::Message message,
                            Module::MessageBase &response) {
   (void)to;
-  assert(dynamic_cast<Module::EmptyMessage &>(response) ==
-         Module::EmptyMessage::shared());
+  assert(response.getTag() == Module::EmptyMessage::TAG);
 }
 
 void Link::messageCancelled(const ModuleID to, Module::Message message) {}
 
+std::any Link::saveState(const ModuleID from) {
+  (void)from;
+  State state{nextAvailable, outputQueue, rand_dist, 0};
+  if (pcap_enabled)
+    state.pcap_position = pcap_file.tellp();
+  return state;
+}
+
+void Link::restoreState(const ModuleID from, std::any &&state) {
+  (void)from;
+  State &saved = std::any_cast<State &>(state);
+  nextAvailable = std::move(saved.nextAvailable);
+  outputQueue = std::move(saved.outputQueue);
+  rand_dist = saved.rand_dist;
+  // packets logged by the undone events are overwritten later
+  if (pcap_enabled) {
+    pcap_file.seekp(saved.pcap_position);
+    pcap_rewound = true;
+  }
+}
+
+bool Link::writeCheckpoint(std::ostream &out) {
+  Checkpoint::write(out, (uint64_t)nextAvailable.size());
+  for (auto &[wireID, time] : nextAvailable) {
+    Checkpoint::write(out, wireID);
+    Checkpoint::write(out, time);
+  }
+  Checkpoint::write(out, (uint64_t)outputQueue.size());
+  for (auto &[wireID, queue] : outputQueue) {
+    Checkpoint::write(out, wireID);
+    Checkpoint::write(out, (uint64_t)queue.size());
+    for (const Packet &packet : queue)
+      packet.writePacket(out);
+  }
+  rand_dist.writeState(out);
+  return true;
+}
+
+void Link::readCheckpoint(std::istream &in) {
+  nextAvailable.clear();
+  for (uint64_t k = Checkpoint::read<uint64_t>(in); k > 0; k--) {
+    ModuleID wireID = Checkpoint::read<ModuleID>(in);
+    nextAvailable[wireID] = Checkpoint::read<Time>(in);
+  }
+  outputQueue.clear();
+  for (uint64_t k = Checkpoint::read<uint64_t>(in); k > 0; k--) {
+    std::list<Packet> &queue = outputQueue[Checkpoint::read<ModuleID>(in)];
+    for (uint64_t n = Checkpoint::read<uint64_t>(in); n > 0; n--)
+      queue.push_back(Packet::readPacket(in));
+  }
+  rand_dist.readState(in);
+}
+
+bool Link::writeMessage(const MessageBase &message, std::ostream &out) {
+  if (message.getTag() != Link::Message::TAG)
+    return NetworkModule::writeMessage(message, out);
+  auto &selfMessage = static_cast<const Link::Message &>(message);
+  Checkpoint::write(out, selfMessage.type);
+  Checkpoint::write(out, selfMessage.wireID);
+  return true;
+}
+
+Module::Message Link::readMessage(MessageTag tag, std::istream &in) {
+  if (tag != Link::Message::TAG)
+    return NetworkModule::readMessage(tag, in);
+  MessageType type = Checkpoint::read<MessageType>(in);
+  return std::make_unique<Link::Message>(type, Checkpoint::read<ModuleID>(in));
+}
+
 void Link::sendPacket(const ModuleID port, Packet &&packet) {
   std::list<Packet> &current_queue = this->outputQueue[port];
   Time current_time = this->getCurrentTime();
@@ -120,7 +220,7 @@ void Link::sendPacket(const ModuleID port, Packet &&packet) {
         ++iter;
       }
       assert(iter != current_queue.end());
-      Packet toBeRemoved = *iter;
+      Packet toBeRemoved = std::move(*iter);
       current_queue.erase(iter);
 
       print_log(NetworkLog::PACKET_QUEUE,
@@ -132,7 +232,7 @@ void Link::sendPacket(const ModuleID port, Packet &&packet) {
   }
   assert(this->max_queue_length == 0 ||
          current_queue.size() < this->max_queue_length);
-  current_queue.push_back(packet);
+  current_queue.push_back(std::move(packet));
   print_log(NetworkLog::PACKET_QUEUE,
             "Output queue length for port[%s] increased to [%zu]",
             this->getModuleName(port).c_str(), current_queue.size());
@@ -141,10 +241,15 @@ void Link::sendPacket(const ModuleID port, Packet &&packet) {
     if (avail_time > current_time)
       wait_time += (avail_time - current_time);
     auto selfMessage = std::make_unique<Link::Message>(Link::CHECK_QUEUE, port);
-    this->sendMessageSelf(std::move(selfMessage), wait_time);
+    this->postMessageSelf(std::move(selfMessage), wait_time);
   }
 }
 
+void Link::sendPacket(const ModuleID port, PacketBatch &&batch) {
+  for (Packet &packet : batch)
+    this->sendPacket(port, std::move(packet));
+}
+
 void Link::setLinkSpeed(Size bps) { this->bps = bps; }
 
 void Link::setQueueSize(Size max_queue_length) {
@@ -152,17 +257,26 @@ void Link::setQueueSize(Size max_queue_length) {
 }
 
 Link::Link(std::string name, NetworkSystem &system)
-    : NetworkModule(system), NetworkLog(static_cast<System &>(system)) {
+    : NetworkModule(system), NetworkLog(static_cast<System &>(system)),
+      rand_dist(system.nextRandomSeed()) {
   this->bps = 1000000000;
   this->max_queue_length = 0;
   this->pcap_enabled = false;
+  this->pcap_rewound = false;
   this->snaplen = 65535;
+  this->setBatchDelivery(true);
 }
 Link::~Link() {
 
   if (pcap_enabled) {
     pcap_enabled = false;
+    std::streampos end = pcap_file.tellp();
     pcap_file.close();
+    // drop what a rollback may have left after the last packet
+    if (pcap_rewound && end != std::streampos(-1)) {
+      std::error_code error;
+      std::filesystem::resize_file(pcap_filename, end, error);
+    }
   }
 }
 
@@ -179,6 +293,7 @@ struct pcap_file_header {
 void Link::enablePCAPLogging(const std::string &filename, Size snaplen) {
   if (!pcap_enabled) {
     pcap_file.open(filename, std::ofstream::binary);
+    pcap_filename = filename;
     pcap_enabled = true;
     this->snaplen = snaplen;
 
@@ -25,7 +25,8 @@ uint64_t NetworkLog::defaultLevel = (
     0UL);
 
 NetworkLog::NetworkLog(System &system) : system(system) {
-  this->level = defaultLevel;
+  NetworkSystem *network = dynamic_cast<NetworkSystem *>(&system);
+  this->level = network ? network->getNetworkLogLevel() : defaultLevel;
 }
 
 NetworkLog::NetworkLog(System &system, uint64_t level) : system(system) {
@@ -33,6 +34,8 @@ NetworkLog::NetworkLog(System &system, uint64_t level) : system(system) {
 }
 NetworkLog::~NetworkLog() {}
 
+void NetworkLog::setLevel(uint64_t level) { this->level = level; }
+
 void NetworkLog::print_log(uint64_t level, const char *format, ...) {
   va_list args;
   va_start(args, format);
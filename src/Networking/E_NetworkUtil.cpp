@@ -5,31 +5,181 @@
  *      Author: Keunhong Lee
  */
 
+#include <E/Networking/E_HeaderView.hpp>
 #include <E/Networking/E_NetworkUtil.hpp>
+#include <E/Networking/E_Packet.hpp>
 #include <arpa/inet.h>
 
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define E_SUM_X86
+#include <immintrin.h>
+#endif
+
 namespace E {
 
 NetworkUtil::NetworkUtil() {}
 NetworkUtil::~NetworkUtil() {}
 
-uint16_t NetworkUtil::one_sum(const uint8_t *buffer, size_t size) {
-  bool upper = true;
-  uint32_t sum = 0;
-  for (size_t k = 0; k < size; k++) {
-    if (upper) {
-      sum += buffer[k] << 8;
-    } else {
-      sum += buffer[k];
+// Partial sums are 64 bits wide, in host byte order, with the carry out of
+// the top bit added back in. The one's complement sum does not depend on the
+// byte order (RFC 1071), so it is swapped to network order only once, when
+// folded to 16 bits.
+static uint64_t sum_add(uint64_t sum, uint64_t value) {
+  sum += value;
+  return sum + (sum < value);
+}
+
+static uint16_t sum_fold(uint64_t sum) {
+  sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+  sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  return ntohs((uint16_t)sum);
+}
+
+static uint64_t sum_scalar(const uint8_t *buffer, size_t size) {
+  uint64_t sum = 0;
+  for (; size >= 8; buffer += 8, size -= 8) {
+    uint64_t word;
+    memcpy(&word, buffer, sizeof(word));
+    sum = sum_add(sum, word);
+  }
+  if (size >= 4) {
+    uint32_t word;
+    memcpy(&word, buffer, sizeof(word));
+    sum = sum_add(sum, word);
+    buffer += 4;
+    size -= 4;
+  }
+  if (size >= 2) {
+    uint16_t word;
+    memcpy(&word, buffer, sizeof(word));
+    sum = sum_add(sum, word);
+    buffer += 2;
+    size -= 2;
+  }
+  if (size == 1) {
+    // an odd byte is the upper half of a word padded with zero
+    const uint8_t last[2] = {buffer[0], 0};
+    uint16_t word;
+    memcpy(&word, last, sizeof(word));
+    sum = sum_add(sum, word);
+  }
+  return sum;
+}
+
+#ifdef E_SUM_X86
+// Both kernels widen 16-bit words to 32-bit lanes, and every lane gets two
+// words per step. The lanes are added to the partial sum before they could
+// overflow.
+static constexpr size_t SUM_STEPS = 32767;
+
+__attribute__((target("sse2"))) static uint64_t
+sum_sse2(const uint8_t *buffer, size_t size) {
+  const __m128i zero = _mm_setzero_si128();
+  uint64_t sum = 0;
+  while (size >= 16) {
+    const size_t steps = std::min(size / 16, SUM_STEPS);
+    __m128i lanes = zero;
+    for (size_t k = 0; k < steps; k++, buffer += 16) {
+      __m128i words = _mm_loadu_si128((const __m128i *)buffer);
+      lanes = _mm_add_epi32(lanes, _mm_unpacklo_epi16(words, zero));
+      lanes = _mm_add_epi32(lanes, _mm_unpackhi_epi16(words, zero));
     }
+    size -= steps * 16;
+
+    uint32_t partial[4];
+    _mm_storeu_si128((__m128i *)partial, lanes);
+    for (uint32_t lane : partial)
+      sum = sum_add(sum, lane);
+  }
+  return sum_add(sum, sum_scalar(buffer, size));
+}
 
-    upper = !upper;
+__attribute__((target("avx2"))) static uint64_t
+sum_avx2(const uint8_t *buffer, size_t size) {
+  const __m256i zero = _mm256_setzero_si256();
+  uint64_t sum = 0;
+  while (size >= 32) {
+    const size_t steps = std::min(size / 32, SUM_STEPS);
+    __m256i lanes = zero;
+    for (size_t k = 0; k < steps; k++, buffer += 32) {
+      __m256i words = _mm256_loadu_si256((const __m256i *)buffer);
+      lanes = _mm256_add_epi32(lanes, _mm256_unpacklo_epi16(words, zero));
+      lanes = _mm256_add_epi32(lanes, _mm256_unpackhi_epi16(words, zero));
+    }
+    size -= steps * 32;
 
-    sum = (sum & 0xFFFF) + (sum >> 16);
+    uint32_t partial[8];
+    _mm256_storeu_si256((__m256i *)partial, lanes);
+    for (uint32_t lane : partial)
+      sum = sum_add(sum, lane);
   }
-  sum = (sum & 0xFFFF) + (sum >> 16);
-  return (uint16_t)sum;
+  return sum_add(sum, sum_scalar(buffer, size));
+}
+#endif
+
+// Below this many bytes, as in protocol headers, setting up the vector lanes
+// costs more than the scalar loop takes.
+static constexpr size_t SUM_VECTOR_MIN = 128;
+
+static uint64_t sum_partial(const uint8_t *buffer, size_t size,
+                            NetworkUtil::SumKernel kernel) {
+  if (size < SUM_VECTOR_MIN)
+    return sum_scalar(buffer, size);
+  switch (kernel) {
+#ifdef E_SUM_X86
+  case NetworkUtil::SumKernel::SSE2:
+    return sum_sse2(buffer, size);
+  case NetworkUtil::SumKernel::AVX2:
+    return sum_avx2(buffer, size);
+#endif
+  default:
+    return sum_scalar(buffer, size);
+  }
+}
+
+bool NetworkUtil::sum_supported(SumKernel kernel) {
+  switch (kernel) {
+  case SumKernel::SCALAR:
+    return true;
+#ifdef E_SUM_X86
+  case SumKernel::SSE2:
+    return __builtin_cpu_supports("sse2");
+  case SumKernel::AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+static NetworkUtil::SumKernel sum_select() {
+  for (auto kernel : {NetworkUtil::SumKernel::AVX2,
+                      NetworkUtil::SumKernel::SSE2})
+    if (NetworkUtil::sum_supported(kernel))
+      return kernel;
+  return NetworkUtil::SumKernel::SCALAR;
+}
+
+NetworkUtil::SumKernel NetworkUtil::sum_kernel() {
+  static const SumKernel kernel = sum_select();
+  return kernel;
+}
+
+uint16_t NetworkUtil::one_sum(const uint8_t *buffer, size_t size) {
+  return sum_fold(sum_partial(buffer, size, sum_kernel()));
 }
+
+uint16_t NetworkUtil::one_sum(const uint8_t *buffer, size_t size,
+                              SumKernel kernel) {
+  assert(sum_supported(kernel));
+  return sum_fold(sum_partial(buffer, size, kernel));
+}
+
 #ifdef HAVE_PRAGMA_PACK
 #pragma pack(push, 1)
 #endif
@@ -59,10 +209,108 @@ uint16_t NetworkUtil::tcp_sum(uint32_t source, uint32_t dest,
   pheader.protocol = IPPROTO_TCP;
   pheader.length = htons(length);
 
-  uint32_t sum = one_sum((uint8_t *)&pheader, sizeof(pheader));
-  sum += one_sum(tcp_seg, length);
+  const SumKernel kernel = sum_kernel();
+  uint64_t sum = sum_partial((uint8_t *)&pheader, sizeof(pheader), kernel);
+  sum = sum_add(sum, sum_partial(tcp_seg, length, kernel));
+  return sum_fold(sum);
+}
+
+uint16_t NetworkUtil::checksum_adjust(uint16_t old_sum, uint16_t old_field,
+                                      uint16_t new_field) {
+  // HC' = ~(~HC + ~m + m')
+  uint32_t sum = (uint16_t)~old_sum;
+  sum += (uint16_t)~old_field;
+  sum += new_field;
+  sum = (sum & 0xFFFF) + (sum >> 16);
   sum = (sum & 0xFFFF) + (sum >> 16);
-  return (uint16_t)sum;
+  return (uint16_t)~sum;
+}
+
+uint16_t NetworkUtil::checksum_adjust(uint16_t old_sum, uint32_t old_field,
+                                      uint32_t new_field) {
+  old_sum = checksum_adjust(old_sum, (uint16_t)(old_field >> 16),
+                            (uint16_t)(new_field >> 16));
+  return checksum_adjust(old_sum, (uint16_t)old_field, (uint16_t)new_field);
+}
+
+// The packet is written anyway, so reads go through the non-const
+// accessData as well, which copies a field in a segment into the buffer.
+static uint32_t load_field(Packet &packet, size_t offset, size_t size) {
+  const uint8_t *bytes = packet.accessData(offset, size);
+  assert(bytes != nullptr);
+  uint32_t value = 0;
+  for (size_t k = 0; k < size; k++)
+    value = value << 8 | bytes[k];
+  return value;
+}
+
+static void store_field(Packet &packet, size_t offset, size_t size,
+                        uint32_t value) {
+  uint8_t *bytes = packet.accessData(offset, size);
+  assert(bytes != nullptr);
+  for (size_t k = size; k-- > 0; value >>= 8)
+    bytes[k] = (uint8_t)value;
+}
+
+// Each access is separate, as writing may move the bytes of the packet.
+template <typename T>
+static void checksum_write(Packet &packet, size_t sum_offset,
+                           size_t field_offset, T value) {
+  assert(field_offset + sizeof(T) <= sum_offset ||
+         sum_offset + 2 <= field_offset);
+  const bool fits = field_offset + sizeof(T) <= packet.getSize() &&
+                    sum_offset + 2 <= packet.getSize();
+  assert(fits && "field or checksum beyond the packet");
+  if (!fits)
+    return;
+  const T old_field = (T)load_field(packet, field_offset, sizeof(T));
+  const uint16_t old_sum = (uint16_t)load_field(packet, sum_offset, 2);
+  store_field(packet, field_offset, sizeof(T), value);
+  store_field(packet, sum_offset, 2,
+              NetworkUtil::checksum_adjust(old_sum, old_field, value));
+}
+
+void NetworkUtil::checksum_write(Packet &packet, size_t sum_offset,
+                                 size_t field_offset, uint16_t value) {
+  E::checksum_write(packet, sum_offset, field_offset, value);
+}
+
+void NetworkUtil::checksum_write(Packet &packet, size_t sum_offset,
+                                 size_t field_offset, uint32_t value) {
+  E::checksum_write(packet, sum_offset, field_offset, value);
+}
+
+void NetworkUtil::checksum_finalize(Packet &packet) {
+  Packet::Metadata &metadata = packet.getMetadata();
+  if (!metadata.checksumPartial)
+    return;
+  metadata.checksumPartial = false;
+
+  const size_t ipStart = EthernetHeaderView::SIZE;
+  uint8_t *network = packet.accessData(0, ipStart + IPv4HeaderView::SIZE);
+  if (network == nullptr ||
+      EthernetHeaderView(network).etherType() != EthernetHeaderView::IPV4)
+    return;
+  IPv4HeaderView ip(network + ipStart);
+  ip.setChecksum(0);
+  ip.setChecksum(~one_sum(ip.data(), ip.SIZE));
+
+  if (ip.protocol() != IPv4HeaderView::TCP ||
+      ip.totalLength() < ip.headerLength() + TCPHeaderView::SIZE)
+    return;
+  const size_t transportStart = ipStart + ip.headerLength();
+  const size_t length = ip.totalLength() - ip.headerLength();
+  uint32_t source, dest; // in network order, as tcp_sum takes them
+  memcpy(&source, ip.source().data(), sizeof(source));
+  memcpy(&dest, ip.destination().data(), sizeof(dest));
+
+  // may move the bytes of the packet, and so ip
+  uint8_t *segment = packet.accessData(transportStart, length);
+  if (segment == nullptr)
+    return;
+  TCPHeaderView tcp(segment);
+  tcp.setChecksum(0);
+  tcp.setChecksum(~tcp_sum(source, dest, segment, length));
 }
 
 } // namespace E
@@ -5,6 +5,7 @@
  *      Author: Keunhong Lee
  */
 
+#include <E/E_Checkpoint.hpp>
 #include <E/Networking/E_Networking.hpp>
 #include <E/Networking/E_Packet.hpp>
 #include <E/Networking/E_Wire.hpp>
@@ -18,11 +19,31 @@ int NetworkModule::connectWire(const ModuleID moduleID) {
   return portID;
 }
 
-NetworkSystem::NetworkSystem()
-    : System(), NetworkLog(static_cast<System &>(*this)) {
-  this->packetUUIDStart = 0;
+bool NetworkModule::writeMessage(const MessageBase &message,
+                                 std::ostream &out) {
+  if (message.getTag() == Wire::BatchMessage::TAG) {
+    static_cast<const Wire::BatchMessage &>(message).writeMessage(out);
+    return true;
+  }
+  if (message.getTag() != Wire::Message::TAG)
+    return Module::writeMessage(message, out);
+  static_cast<const Wire::Message &>(message).writeMessage(out);
+  return true;
 }
 
+Module::Message NetworkModule::readMessage(MessageTag tag, std::istream &in) {
+  if (tag == Wire::BatchMessage::TAG)
+    return Wire::BatchMessage::readMessage(in);
+  if (tag != Wire::Message::TAG)
+    return Module::readMessage(tag, in);
+  return Wire::Message::readMessage(in);
+}
+
+NetworkSystem::NetworkSystem(EventQueueType queueType)
+    : System(queueType),
+      NetworkLog(static_cast<System &>(*this), NetworkLog::defaultLevel),
+      nextPacketUUID(0), networkLogLevel(NetworkLog::defaultLevel) {}
+
 NetworkSystem::~NetworkSystem() {}
 
 std::pair<std::shared_ptr<Wire>, std::pair<int, int>>
@@ -38,13 +59,114 @@ NetworkSystem::addWire(NetworkModule &left, NetworkModule &right,
                               limit_speed);
   int left_port_id = left.connectWire(lookupModuleID(*wire));
   int right_port_id = right.connectWire(lookupModuleID(*wire));
+  wires.push_back(
+      {lookupModuleID(*wire), lookupModuleID(left), lookupModuleID(right)});
   return {wire, {left_port_id, right_port_id}};
 }
 
+UUID NetworkSystem::allocatePacketUUID() {
+  return nextPacketUUID.fetch_add(1, std::memory_order_relaxed);
+}
+
+void NetworkSystem::setNetworkLogLevel(uint64_t level) {
+  networkLogLevel = level;
+  NetworkLog::setLevel(level);
+}
+
+uint64_t NetworkSystem::getNetworkLogLevel() { return networkLogLevel; }
+
+void NetworkSystem::writeCheckpoint(std::ostream &out) {
+  System::writeCheckpoint(out);
+  Checkpoint::write(out, nextPacketUUID.load());
+}
+
+void NetworkSystem::readCheckpoint(std::istream &in) {
+  System::readCheckpoint(in);
+  nextPacketUUID = Checkpoint::read<UUID>(in);
+}
+
 Size NetworkSystem::getWireSpeed(const ModuleID moduleID) {
   auto &module = registeredModule[moduleID];
   auto &wire = dynamic_cast<Wire &>(*module);
   return wire.getWireSpeed();
 }
 
+System::Partitioning NetworkSystem::partition(size_t partitions) {
+  Partitioning result;
+
+  // Modules joined by a wire without propagation delay must stay together.
+  std::map<ModuleID, ModuleID> group;
+  std::function<ModuleID(ModuleID)> find = [&](ModuleID module) {
+    ModuleID &parent = group[module];
+    if (parent == 0 || parent == module)
+      return parent = module;
+    return parent = find(parent);
+  };
+  std::map<ModuleID, std::vector<ModuleID>> neighbors;
+  for (ModuleID module = 1; module < registeredModule.size(); module++)
+    find(module);
+  for (auto &wire : wires) {
+    result.partitionOf[wire[0]] = Partitioning::SENDER;
+    group.erase(wire[0]);
+    neighbors[wire[1]].push_back(wire[2]);
+    neighbors[wire[2]].push_back(wire[1]);
+  }
+  for (auto &wire : wires) {
+    auto &module = dynamic_cast<Wire &>(*registeredModule[wire[0]]);
+    if (module.getPropagationDelay() == 0)
+      group[find(wire[1])] = find(wire[2]);
+  }
+
+  // Visit the modules in breadth-first order, so that neighbors end up in the
+  // same partition, and fill the partitions one after another.
+  std::vector<ModuleID> order;
+  std::set<ModuleID> visited;
+  for (auto &start : group) {
+    if (visited.count(start.first))
+      continue;
+    std::queue<ModuleID> queue;
+    queue.push(start.first);
+    visited.insert(start.first);
+    while (!queue.empty()) {
+      ModuleID module = queue.front();
+      queue.pop();
+      order.push_back(module);
+      for (ModuleID next : neighbors[module]) {
+        if (!visited.count(next)) {
+          visited.insert(next);
+          queue.push(next);
+        }
+      }
+    }
+  }
+
+  partitions = std::min(partitions, order.size());
+  if (partitions <= 1)
+    return result;
+
+  std::map<ModuleID, size_t> groupPartition;
+  size_t filled = 0;
+  for (ModuleID module : order) {
+    ModuleID root = find(module);
+    auto iter = groupPartition.find(root);
+    if (iter == groupPartition.end())
+      iter = groupPartition
+                 .insert({root, std::min(filled * partitions / order.size(),
+                                         partitions - 1)})
+                 .first;
+    result.partitionOf[module] = iter->second;
+    filled++;
+  }
+  result.count = partitions;
+
+  result.lookahead = std::numeric_limits<Time>::max();
+  for (auto &wire : wires) {
+    if (result.partitionOf[wire[1]] == result.partitionOf[wire[2]])
+      continue;
+    auto &module = dynamic_cast<Wire &>(*registeredModule[wire[0]]);
+    result.lookahead = std::min(result.lookahead, module.getPropagationDelay());
+  }
+  return result;
+}
+
 } // namespace E
@@ -5,100 +5,456 @@
  *      Author: Keunhong Lee
  */
 
+#include <E/E_Checkpoint.hpp>
 #include <E/E_Common.hpp>
+#include <E/Networking/E_Networking.hpp>
 #include <E/Networking/E_Packet.hpp>
 
 namespace E {
 
-std::unordered_set<UUID> Packet::packetUUIDSet;
-UUID Packet::packetUUIDStart = 0;
+// UUIDs are unique within the NetworkSystem running on this thread. Packets
+// made outside of a run are numbered separately, with the top bit set.
+static constexpr UUID ORPHAN_PACKET = 1ULL << 63;
+static std::atomic<UUID> nextOrphanPacket(0);
+
 UUID Packet::allocatePacketUUID() {
-  UUID candidate = packetUUIDStart;
-  do {
-    if (packetUUIDSet.find(candidate) == packetUUIDSet.end()) {
-      packetUUIDStart = candidate + 1;
-      packetUUIDSet.insert(candidate);
-      return candidate;
+  NetworkSystem *system =
+      dynamic_cast<NetworkSystem *>(System::getRunningSystem());
+  if (system)
+    return system->allocatePacketUUID();
+  return ORPHAN_PACKET | nextOrphanPacket++;
+}
+
+namespace {
+// Free packet buffers, by size class. Like the messages, a packet may be
+// freed by another thread than the one which allocated it, so each list is
+// capped and the rest goes back to the heap. Larger buffers are not recycled.
+class PacketSlab {
+public:
+  static constexpr size_t CLASSES = 3;
+  static constexpr size_t CLASS_SIZE[CLASSES] = {128, 2048, 9216};
+  static constexpr size_t MAX_FREE[CLASSES] = {4096, 1024, 256};
+
+  class Block {
+  public:
+    Block *next;
+  };
+
+  std::array<Block *, CLASSES> free = {};
+  std::array<size_t, CLASSES> count = {};
+
+  static size_t classOf(size_t capacity) {
+    size_t index = 0;
+    while (index < CLASSES && capacity > CLASS_SIZE[index])
+      index++;
+    return index;
+  }
+
+  ~PacketSlab();
+};
+
+thread_local PacketSlab slab;
+thread_local bool slabDestroyed = false; // packets freed at thread exit
+
+PacketSlab::~PacketSlab() {
+  for (Block *block : free) {
+    while (block != nullptr) {
+      Block *next = block->next;
+      ::operator delete(block);
+      block = next;
     }
-    candidate++;
-  } while (candidate != packetUUIDStart);
-  assert(0);
-  return 0;
+  }
+  slabDestroyed = true;
 }
-void Packet::freePacketUUID(UUID uuid) { packetUUIDSet.erase(uuid); }
+} // namespace
 
-Packet::Packet(UUID uuid, size_t maxSize)
-    : buffer(maxSize), bufferSize(maxSize), dataSize(maxSize), packetID(uuid) {
+// Code built against the 3.3.0 headers, such as the KENS solution, reserves
+// room for a Packet of the size it had then.
+static_assert(sizeof(void *) != 8 || sizeof(Packet) == 56,
+              "Packet must keep its 3.3.0 size");
 
-  std::fill(this->buffer.begin(), this->buffer.end(), 0);
+Packet::Buffer *Packet::Buffer::allocate(size_t capacity) {
+  // head and dataSize are 32-bit
+  assert(capacity <= UINT32_MAX);
+  const size_t index = PacketSlab::classOf(capacity);
+  void *memory;
+  if (index == PacketSlab::CLASSES)
+    memory = ::operator new(sizeof(Buffer) + capacity);
+  else if (slabDestroyed || slab.free[index] == nullptr)
+    // always the whole class, as release may file it in a live slab
+    memory = ::operator new(sizeof(Buffer) + PacketSlab::CLASS_SIZE[index]);
+  else {
+    PacketSlab::Block *block = slab.free[index];
+    slab.free[index] = block->next;
+    slab.count[index]--;
+    memory = block;
+  }
+  Buffer *buffer = static_cast<Buffer *>(memory);
+  new (&buffer->references) std::atomic<uint32_t>(1);
+  new (&buffer->segments) std::vector<Segment>();
+  buffer->capacity = capacity;
+  return buffer;
+}
+
+void Packet::Buffer::release(Buffer *buffer) {
+  if (buffer == nullptr ||
+      buffer->references.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+  std::destroy_at(&buffer->segments);
+  const size_t index = PacketSlab::classOf(buffer->capacity);
+  if (index == PacketSlab::CLASSES || slabDestroyed ||
+      slab.count[index] == PacketSlab::MAX_FREE[index]) {
+    ::operator delete(buffer);
+    return;
+  }
+  PacketSlab::Block *block = reinterpret_cast<PacketSlab::Block *>(buffer);
+  block->next = slab.free[index];
+  slab.free[index] = block;
+  slab.count[index]++;
+}
+
+Packet::Packet(UUID uuid, size_t maxSize, size_t headroom, bool zero)
+    : buffer(headroom + maxSize > 0 ? Buffer::allocate(headroom + maxSize)
+                                    : nullptr),
+      packetID(uuid), head(headroom), dataSize(maxSize) {
+  if (buffer != nullptr && zero)
+    memset(buffer->data(), 0, headroom + maxSize);
 }
 
 Packet::Packet(const Packet &other)
-    : buffer(other.buffer), bufferSize(other.bufferSize),
-      dataSize(other.dataSize), packetID(other.packetID) {}
+    : buffer(other.buffer), packetID(other.packetID), head(other.head),
+      dataSize(other.dataSize), metadata(other.metadata) {
+  if (buffer != nullptr)
+    buffer->references.fetch_add(1, std::memory_order_relaxed);
+}
 
 Packet::Packet(Packet &&other) noexcept
-    : buffer(std::move(other.buffer)), bufferSize(other.bufferSize),
-      dataSize(other.dataSize), packetID(other.packetID) {
+    : buffer(other.buffer), packetID(other.packetID), head(other.head),
+      dataSize(other.dataSize), metadata(other.metadata) {
+  other.buffer = nullptr;
+  other.head = 0;
   other.dataSize = 0;
 }
 
 Packet &Packet::operator=(const Packet &other) {
+  if (other.buffer != nullptr)
+    other.buffer->references.fetch_add(1, std::memory_order_relaxed);
+  Buffer::release(buffer);
   buffer = other.buffer;
-  bufferSize = other.bufferSize;
-  dataSize = other.dataSize;
   packetID = other.packetID;
+  head = other.head;
+  dataSize = other.dataSize;
+  metadata = other.metadata;
   return *this;
 }
 
 Packet &Packet::operator=(Packet &&other) noexcept {
-  buffer = std::move(other.buffer);
-  bufferSize = std::move(other.bufferSize);
-  dataSize = std::move(other.dataSize);
-  packetID = std::move(other.packetID);
+  if (this == &other)
+    return *this;
+  Buffer::release(buffer);
+  buffer = other.buffer;
+  packetID = other.packetID;
+  head = other.head;
+  dataSize = other.dataSize;
+  metadata = other.metadata;
+  other.buffer = nullptr;
+  other.head = 0;
+  other.dataSize = 0;
   return *this;
 }
 
-Packet::Packet(size_t maxSize) : Packet(allocatePacketUUID(), maxSize) {}
+Packet::Packet(size_t maxSize)
+    : Packet(allocatePacketUUID(), maxSize, 0, true) {}
 
-Packet::~Packet() { freePacketUUID(this->packetID); }
+Packet::Packet(size_t maxSize, size_t headroom)
+    : Packet(allocatePacketUUID(), maxSize, headroom, true) {}
 
-Packet Packet::clone() const {
+Packet Packet::uninitialized(size_t maxSize, size_t headroom) {
+  return Packet(allocatePacketUUID(), maxSize, headroom, false);
+}
+
+Packet::~Packet() { Buffer::release(buffer); }
 
-  Packet pkt(this->bufferSize);
-  pkt.setSize(this->dataSize);
-  pkt.buffer = this->buffer;
+Packet Packet::clone() const {
+  Packet pkt(*this);
+  pkt.packetID = allocatePacketUUID();
   return pkt;
 }
 
+void Packet::unshare() {
+  // the only reference cannot be shared meanwhile by another thread
+  if (buffer == nullptr ||
+      buffer->references.load(std::memory_order_acquire) == 1)
+    return;
+  Buffer *copy = Buffer::allocate(buffer->capacity);
+  memcpy(copy->data(), buffer->data(), buffer->capacity);
+  copy->segments = buffer->segments;
+  Buffer::release(buffer);
+  buffer = copy;
+}
+
+void Packet::reallocate(size_t headroom, size_t bufferSize) {
+  assert(dataSize <= bufferSize);
+  Buffer *copy = Buffer::allocate(headroom + bufferSize);
+  memset(copy->data(), 0, headroom);
+  if (dataSize > 0)
+    memcpy(copy->data() + headroom, data(), dataSize);
+  memset(copy->data() + headroom + dataSize, 0, bufferSize - dataSize);
+  if (buffer != nullptr)
+    copy->segments = buffer->segments;
+  Buffer::release(buffer);
+  buffer = copy;
+  this->head = headroom;
+}
+
+void Packet::linearize() {
+  if (!hasSegments())
+    return;
+  const size_t size = getSize();
+  Buffer *copy = Buffer::allocate(head + size);
+  memset(copy->data(), 0, head);
+  char *end = copy->data() + head;
+  if (dataSize > 0)
+    memcpy(end, data(), dataSize);
+  end += dataSize;
+  for (const Segment &segment : buffer->segments) {
+    memcpy(end, segment.data, segment.length);
+    end += segment.length;
+  }
+  Buffer::release(buffer);
+  buffer = copy;
+  dataSize = size;
+}
+
+template <typename Copy>
+size_t Packet::gather(size_t offset, size_t length, Copy &&copy) const {
+  size_t done = 0;
+  if (offset < dataSize) {
+    done = std::min(length, dataSize - offset);
+    copy(data() + offset, done);
+    offset = 0;
+  } else
+    offset -= dataSize;
+  if (!hasSegments())
+    return done;
+  for (const Segment &segment : buffer->segments) {
+    if (done == length)
+      break;
+    if (offset >= segment.length) {
+      offset -= segment.length;
+      continue;
+    }
+    const size_t piece = std::min(length - done, segment.length - offset);
+    copy(segment.data + offset, piece);
+    done += piece;
+    offset = 0;
+  }
+  return done;
+}
+
 size_t Packet::writeData(size_t offset, const void *data, size_t length) {
-  size_t actual_offset = std::min(offset, dataSize);
-  size_t actual_write = std::min(length, dataSize - actual_offset);
+  if (hasSegments() && offset + length > dataSize)
+    linearize();
+  size_t actual_offset = std::min<size_t>(offset, dataSize);
+  size_t actual_write = std::min<size_t>(length, dataSize - actual_offset);
 
   if (actual_write == 0)
     return 0;
 
   assert(data);
-  memcpy(this->buffer.data() + actual_offset, data, length);
+  unshare();
+  memcpy(this->data() + actual_offset, data, actual_write);
   return actual_write;
 }
 size_t Packet::readData(size_t offset, void *data, size_t length) const {
-  size_t actual_offset = std::min(offset, dataSize);
-  size_t actual_read = std::min(length, dataSize - actual_offset);
+  char *dst = static_cast<char *>(data);
+  return gather(offset, length, [&dst](const char *src, size_t piece) {
+    assert(dst);
+    memcpy(dst, src, piece);
+    dst += piece;
+  });
+}
+size_t Packet::readData(size_t offset, std::ostream &out,
+                        size_t length) const {
+  return gather(offset, length, [&out](const char *src, size_t piece) {
+    out.write(src, piece);
+  });
+}
+size_t Packet::setSize(size_t size) {
+  if (!hasSegments() || size <= this->dataSize) {
+    if (hasSegments()) {
+      unshare();
+      buffer->segments.clear();
+    }
+    this->dataSize = std::min(size, this->bufferSize());
+    return this->dataSize;
+  }
+  size_t remaining = size - this->dataSize;
+  for (size_t k = 0; k < buffer->segments.size(); k++) {
+    if (remaining <= buffer->segments[k].length) {
+      unshare();
+      buffer->segments[k].length = remaining;
+      buffer->segments.resize(k + 1);
+      return size;
+    }
+    remaining -= buffer->segments[k].length;
+  }
+  return getSize();
+}
+size_t Packet::getSize() const {
+  size_t size = this->dataSize;
+  if (hasSegments()) {
+    for (const Segment &segment : buffer->segments)
+      size += segment.length;
+  }
+  return size;
+}
 
-  if (actual_read == 0)
-    return 0;
+uint8_t *Packet::accessData(size_t offset, size_t length) {
+  if (offset + length > getSize())
+    return nullptr;
+  if (offset + length > dataSize)
+    linearize();
+  if (buffer == nullptr)
+    return nullptr;
+  unshare();
+  return reinterpret_cast<uint8_t *>(data() + offset);
+}
+
+const uint8_t *Packet::accessData(size_t offset, size_t length) const {
+  if (offset + length <= dataSize) {
+    if (buffer == nullptr)
+      return nullptr;
+    return reinterpret_cast<const uint8_t *>(data() + offset);
+  }
+  if (offset < dataSize || !hasSegments())
+    return nullptr;
+  offset -= dataSize;
+  for (const Segment &segment : buffer->segments) {
+    if (offset + length <= segment.length)
+      return reinterpret_cast<const uint8_t *>(segment.data + offset);
+    if (offset < segment.length)
+      return nullptr;
+    offset -= segment.length;
+  }
+  return nullptr;
+}
 
+void Packet::appendSegment(std::shared_ptr<const void> owner,
+                           const void *data, size_t length) {
+  if (length == 0)
+    return;
   assert(data);
-  memcpy(data, buffer.data() + actual_offset, length);
-  return actual_read;
+  if (buffer == nullptr)
+    buffer = Buffer::allocate(0);
+  else
+    unshare();
+  buffer->segments.push_back(
+      {std::move(owner), static_cast<const char *>(data), length});
 }
-size_t Packet::setSize(size_t size) {
-  this->dataSize = std::min(size, this->bufferSize);
-  return this->dataSize;
+
+size_t Packet::getSegmentCount() const {
+  return hasSegments() ? buffer->segments.size() : 0;
+}
+
+Packet::Metadata &Packet::getMetadata() { return metadata; }
+
+const Packet::Metadata &Packet::getMetadata() const { return metadata; }
+
+void Packet::clearOffsets() {
+  metadata.networkOffset = Metadata::UNPARSED;
+  metadata.transportOffset = Metadata::UNPARSED;
+  metadata.payloadOffset = Metadata::UNPARSED;
+}
+
+void Packet::push(size_t length) {
+  if (length > head)
+    reallocate(length, bufferSize());
+  head -= length;
+  dataSize += length;
+  clearOffsets();
+}
+
+size_t Packet::pull(size_t length) {
+  if (length > dataSize)
+    linearize();
+  size_t actual_pull = std::min<size_t>(length, dataSize);
+  head += actual_pull;
+  dataSize -= actual_pull;
+  clearOffsets();
+  return actual_pull;
+}
+
+void Packet::put(size_t length) {
+  linearize();
+  if (length > bufferSize() - dataSize)
+    reallocate(head, dataSize + length);
+  dataSize += length;
+}
+
+size_t Packet::trim(size_t length) {
+  const size_t size = getSize();
+  size_t actual_trim = std::min(length, size);
+  setSize(size - actual_trim);
+  return actual_trim;
+}
+
+size_t Packet::getHeadroom() const { return head; }
+
+size_t Packet::getTailroom() const {
+  return hasSegments() ? 0 : bufferSize() - dataSize;
 }
-size_t Packet::getSize() const { return this->dataSize; }
 
 void Packet::clearContext() {}
 
+void Packet::writePacket(std::ostream &out) const {
+  if (hasSegments()) {
+    Packet linear(*this);
+    linear.linearize();
+    linear.writePacket(out);
+    return;
+  }
+  Checkpoint::write(out, packetID);
+  Checkpoint::write(out, (uint64_t)head);
+  Checkpoint::write(out, (uint64_t)bufferSize());
+  Checkpoint::write(out, (uint64_t)dataSize);
+  Checkpoint::write(out, metadata.networkOffset);
+  Checkpoint::write(out, metadata.transportOffset);
+  Checkpoint::write(out, metadata.payloadOffset);
+  Checkpoint::write(out, metadata.protocol);
+  Checkpoint::write(out, metadata.checksumVerified);
+  Checkpoint::write(out, metadata.transportChecksumVerified);
+  Checkpoint::write(out, metadata.checksumPartial);
+  Checkpoint::write(out, metadata.port);
+  Checkpoint::write(out, metadata.flowHash);
+  Checkpoint::write(out, buffer != nullptr
+                            ? std::string(buffer->data(), buffer->capacity)
+                            : std::string());
+}
+
+Packet Packet::readPacket(std::istream &in) {
+  UUID uuid = Checkpoint::read<UUID>(in);
+  Packet packet(uuid, 0, 0, false);
+  packet.head = Checkpoint::read<uint64_t>(in);
+  const size_t bufferSize = Checkpoint::read<uint64_t>(in);
+  packet.dataSize = Checkpoint::read<uint64_t>(in);
+  Metadata &metadata = packet.metadata;
+  metadata.networkOffset = Checkpoint::read<uint16_t>(in);
+  metadata.transportOffset = Checkpoint::read<uint16_t>(in);
+  metadata.payloadOffset = Checkpoint::read<uint16_t>(in);
+  metadata.protocol = Checkpoint::read<uint8_t>(in);
+  metadata.checksumVerified = Checkpoint::read<bool>(in);
+  metadata.transportChecksumVerified = Checkpoint::read<bool>(in);
+  metadata.checksumPartial = Checkpoint::read<bool>(in);
+  metadata.port = Checkpoint::read<int16_t>(in);
+  metadata.flowHash = Checkpoint::read<uint32_t>(in);
+  std::string buffer = Checkpoint::readString(in);
+  assert(buffer.size() == packet.head + bufferSize);
+  if (!buffer.empty()) {
+    packet.buffer = Buffer::allocate(buffer.size());
+    memcpy(packet.buffer->data(), buffer.data(), buffer.size());
+  }
+  return packet;
+}
+
 } // namespace E
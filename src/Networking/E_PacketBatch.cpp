@@ -0,0 +1,23 @@
+/*
+ * E_PacketBatch.cpp
+ */
+
+#include <E/E_Checkpoint.hpp>
+#include <E/Networking/E_PacketBatch.hpp>
+
+namespace E {
+
+void PacketBatch::writeBatch(std::ostream &out) const {
+  Checkpoint::write(out, (uint64_t)packets.size());
+  for (const Packet &packet : packets)
+    packet.writePacket(out);
+}
+
+PacketBatch PacketBatch::readBatch(std::istream &in) {
+  PacketBatch batch;
+  for (uint64_t k = Checkpoint::read<uint64_t>(in); k > 0; k--)
+    batch.add(Packet::readPacket(in));
+  return batch;
+}
+
+} // namespace E
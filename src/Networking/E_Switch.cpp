@@ -5,6 +5,7 @@
  *      Author: leeopop
  */
 
+#include <E/E_Checkpoint.hpp>
 #include <E/Networking/E_NetworkUtil.hpp>
 #include <E/Networking/E_Packet.hpp>
 #include <E/Networking/E_Switch.hpp>
@@ -13,7 +14,7 @@
 namespace E {
 
 Switch::Switch(std::string name, NetworkSystem &system, bool unreliable)
-    : Link(name, system) {
+    : Link(name, system), dist(system.nextRandomSeed()) {
   this->unreliable = unreliable;
   this->drop_base = 1.0;
   this->drop_base_diff = 0.1;
@@ -29,6 +30,32 @@ void Switch::addMACEntry(int port, const mac_t &mac) {
   this->mac_table[wireID].insert(mac_int);
 }
 
+std::any Switch::saveState(const ModuleID from) {
+  return std::make_tuple(Link::saveState(from), dist, drop_base);
+}
+
+void Switch::restoreState(const ModuleID from, std::any &&state) {
+  auto &saved =
+      std::any_cast<std::tuple<std::any, UniformDistribution, Real> &>(state);
+  Link::restoreState(from, std::move(std::get<0>(saved)));
+  dist = std::get<1>(saved);
+  drop_base = std::get<2>(saved);
+}
+
+bool Switch::writeCheckpoint(std::ostream &out) {
+  if (!Link::writeCheckpoint(out))
+    return false;
+  dist.writeState(out);
+  Checkpoint::write(out, drop_base);
+  return true;
+}
+
+void Switch::readCheckpoint(std::istream &in) {
+  Link::readCheckpoint(in);
+  dist.readState(in);
+  drop_base = Checkpoint::read<Real>(in);
+}
+
 void Switch::packetArrived(const ModuleID inWireID, Packet &&packet) {
   mac_t mac;
   mac_t broadcast = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
@@ -56,6 +83,8 @@ void Switch::packetArrived(const ModuleID inWireID, Packet &&packet) {
         }
         Packet newPacket = packet.clone();
         if (drop) {
+          // the checksums were computed before the frame got corrupted
+          NetworkUtil::checksum_finalize(newPacket);
           if (newPacket.getSize() >= (14 + 20 + 20 + 4)) {
             uint32_t data;
             newPacket.readData(14 + 20 + 20, &data, sizeof(data));
@@ -5,6 +5,7 @@
  *      Author: Keunhong Lee
  */
 
+#include <E/E_Checkpoint.hpp>
 #include <E/E_Module.hpp>
 #include <E/E_System.hpp>
 #include <E/Networking/E_Host.hpp>
@@ -35,34 +36,14 @@ void Wire::setWireSpeed(Size bps) { this->bps = bps; }
 Size Wire::getWireSpeed() { return this->bps; }
 
 void Wire::setPropagationDelay(Time delay) { propagationDelay = delay; }
+Time Wire::getPropagationDelay() { return propagationDelay; }
 
-Module::Message Wire::messageReceived(const ModuleID from,
-                                      Module::MessageBase &message) {
-
-  Message &portMessage = dynamic_cast<Message &>(message);
-  assert(portMessage.type == Wire::PACKET_TO_PORT);
-
-  NetworkLog::print_log(
-      NetworkLog::PACKET_FROM_MODULE,
-      "Wire [%s] received a packet [size:%zu] from module [%s]",
-      this->getModuleName().c_str(), portMessage.packet.getSize(),
-      this->getModuleName(from).c_str());
-
-  int destination = -1;
-  if (this->connected[0] == from)
-    destination = 1;
-  else if (this->connected[1] == from)
-    destination = 0;
-  if (destination == -1 || this->connected[destination] == 0) {
-    return nullptr;
-  }
-
+Time Wire::transmit(int destination, Size size) {
   Time current_time = this->getCurrentTime();
   Time trans_delay = 0;
   if (this->bps != 0)
     trans_delay =
-        (((Real)portMessage.packet.getSize() * 8 * (1000 * 1000 * 1000UL)) /
-         (Real)this->bps);
+        (((Real)size * 8 * (1000 * 1000 * 1000UL)) / (Real)this->bps);
   Time available_time = this->nextAvailable[destination];
   if (current_time > available_time) {
     available_time = current_time;
@@ -74,19 +55,76 @@ Module::Message Wire::messageReceived(const ModuleID from,
       NetworkLog::PACKET_TO_MODULE,
       "Wire [%s] send a packet [size:%zu] to module [%s] with transmission "
       "delay [%" PRIu64 "], propagation delay [%" PRIu64 "]",
-      this->getModuleName().c_str(), portMessage.packet.getSize(),
+      this->getModuleName().c_str(), size,
       this->getModuleName(connected[destination]).c_str(), trans_delay,
       propagationDelay);
 
+  if (this->limit_speed)
+    return available_time + propagationDelay - current_time;
+  return propagationDelay;
+}
+
+Module::Message Wire::messageReceived(const ModuleID from,
+                                      Module::MessageBase &message) {
+  int destination = -1;
+  if (this->connected[0] == from)
+    destination = 1;
+  else if (this->connected[1] == from)
+    destination = 0;
+
+  if (auto *batchMessage = messageCast<BatchMessage>(message)) {
+    assert(batchMessage->type == Wire::PACKET_TO_PORT);
+    NetworkLog::print_log(
+        NetworkLog::PACKET_FROM_MODULE,
+        "Wire [%s] received a batch [packets:%zu] from module [%s]",
+        this->getModuleName().c_str(), batchMessage->batch.size(),
+        this->getModuleName(from).c_str());
+    if (destination == -1 || this->connected[destination] == 0 ||
+        batchMessage->batch.empty())
+      return nullptr;
+
+    // serialized one after another; the packets arriving at the same time
+    // are delivered together, at the time each would have arrived alone
+    PacketBatch arriving;
+    Time arrival = 0;
+    for (Packet &packet : batchMessage->batch) {
+      Time delay = transmit(destination, packet.getSize());
+      if (!arriving.empty() && delay != arrival) {
+        postMessage(this->connected[destination],
+                    std::make_unique<BatchMessage>(
+                        MessageType::PACKET_FROM_PORT, std::move(arriving)),
+                    arrival);
+        arriving = PacketBatch();
+      }
+      arrival = delay;
+      arriving.add(std::move(packet));
+    }
+    postMessage(this->connected[destination],
+                std::make_unique<BatchMessage>(MessageType::PACKET_FROM_PORT,
+                                               std::move(arriving)),
+                arrival);
+    return nullptr;
+  }
+
+  assert(message.getTag() == Message::TAG);
+  Message &portMessage = static_cast<Message &>(message);
+  assert(portMessage.type == Wire::PACKET_TO_PORT);
+
+  NetworkLog::print_log(
+      NetworkLog::PACKET_FROM_MODULE,
+      "Wire [%s] received a packet [size:%zu] from module [%s]",
+      this->getModuleName().c_str(), portMessage.packet.getSize(),
+      this->getModuleName(from).c_str());
+
+  if (destination == -1 || this->connected[destination] == 0) {
+    return nullptr;
+  }
+
+  Time delay = transmit(destination, portMessage.packet.getSize());
   auto fromWireMessage = std::make_unique<Message>(
       MessageType::PACKET_FROM_PORT, std::move(portMessage.packet));
-
-  if (this->limit_speed)
-    sendMessage(this->connected[destination], std::move(fromWireMessage),
-                available_time + propagationDelay - current_time);
-  else
-    sendMessage(this->connected[destination], std::move(fromWireMessage),
-                propagationDelay);
+  postMessage(this->connected[destination], std::move(fromWireMessage),
+              delay);
 
   return nullptr;
 }
@@ -131,12 +169,75 @@ Time Wire::nextSendAvailable(const ModuleID me) {
 void Wire::messageFinished(const ModuleID to, Module::Message message,
                            Module::MessageBase &response) {
   (void)to;
-  assert(dynamic_cast<Module::EmptyMessage &>(response) ==
-         Module::EmptyMessage::shared());
+  assert(response.getTag() == Module::EmptyMessage::TAG);
 }
 
 void Wire::messageCancelled(const ModuleID to, Module::Message message) {
   (void)to;
 }
 
+std::any Wire::saveState(const ModuleID from) {
+  for (int k = 0; k < 2; k++) {
+    if (this->connected[k] == from)
+      return this->nextAvailable[1 - k];
+  }
+  return Time(0); // packets from elsewhere are dropped
+}
+
+void Wire::restoreState(const ModuleID from, std::any &&state) {
+  for (int k = 0; k < 2; k++) {
+    if (this->connected[k] == from)
+      this->nextAvailable[1 - k] = std::any_cast<Time>(state);
+  }
+}
+
+bool Wire::writeCheckpoint(std::ostream &out) {
+  Checkpoint::write(out, this->nextAvailable);
+  return true;
+}
+
+void Wire::readCheckpoint(std::istream &in) {
+  this->nextAvailable = Checkpoint::read<std::array<Time, 2>>(in);
+}
+
+bool Wire::writeMessage(const MessageBase &message, std::ostream &out) {
+  if (message.getTag() == Wire::BatchMessage::TAG) {
+    static_cast<const Wire::BatchMessage &>(message).writeMessage(out);
+    return true;
+  }
+  if (message.getTag() != Wire::Message::TAG)
+    return Module::writeMessage(message, out);
+  static_cast<const Wire::Message &>(message).writeMessage(out);
+  return true;
+}
+
+Module::Message Wire::readMessage(MessageTag tag, std::istream &in) {
+  if (tag == Wire::BatchMessage::TAG)
+    return Wire::BatchMessage::readMessage(in);
+  if (tag != Wire::Message::TAG)
+    return Module::readMessage(tag, in);
+  return Wire::Message::readMessage(in);
+}
+
+void Wire::Message::writeMessage(std::ostream &out) const {
+  Checkpoint::write(out, type);
+  packet.writePacket(out);
+}
+
+std::unique_ptr<Wire::Message> Wire::Message::readMessage(std::istream &in) {
+  MessageType type = Checkpoint::read<MessageType>(in);
+  return std::make_unique<Message>(type, Packet::readPacket(in));
+}
+
+void Wire::BatchMessage::writeMessage(std::ostream &out) const {
+  Checkpoint::write(out, type);
+  batch.writeBatch(out);
+}
+
+std::unique_ptr<Wire::BatchMessage>
+Wire::BatchMessage::readMessage(std::istream &in) {
+  MessageType type = Checkpoint::read<MessageType>(in);
+  return std::make_unique<BatchMessage>(type, PacketBatch::readBatch(in));
+}
+
 } // namespace E
@@ -5,6 +5,7 @@
  *      Author: Keunhong Lee
  */
 
+#include <E/Networking/E_HeaderView.hpp>
 #include <E/Networking/E_Host.hpp>
 #include <E/Networking/E_Networking.hpp>
 #include <E/Networking/E_Packet.hpp>
@@ -16,52 +17,63 @@ Ethernet::Ethernet(Host &host)
     : HostModule("Ethernet", host), RoutingInfoInterface(host) {}
 Ethernet::~Ethernet() {}
 void Ethernet::packetArrived(std::string fromModule, Packet &&packet) {
+  if (auto toModule = forward(fromModule, packet))
+    this->sendPacket(*toModule, std::move(packet));
+}
+
+void Ethernet::packetsArrived(std::string fromModule, PacketBatch &&batch) {
+  std::map<std::string, PacketBatch> forwarded;
+  for (Packet &packet : batch)
+    if (auto toModule = forward(fromModule, packet))
+      forwarded[*toModule].add(std::move(packet));
+  for (auto &[toModule, toBatch] : forwarded)
+    this->sendPacket(toModule, std::move(toBatch));
+}
+
+std::optional<std::string> Ethernet::forward(std::string fromModule,
+                                             Packet &packet) {
   if (fromModule.compare("Host") == 0) {
-    uint8_t first_byte, second_byte;
-    packet.readData(12, &first_byte, 1);
-    packet.readData(13, &second_byte, 1);
+    // the Host has parsed the frame if it is IPv4
+    const Packet &received = packet;
+    if (received.getMetadata().networkOffset != Packet::Metadata::UNPARSED)
+      return "IPv4";
+    uint16_t type = ConstEthernetHeaderView(received, 0).etherType();
 
-    if (first_byte == 0x08 && second_byte == 0x00) {
-      this->sendPacket("IPv4", std::move(packet));
-    } else if (first_byte == 0x86 && second_byte == 0xDD) {
-      this->sendPacket("IPv6", std::move(packet));
+    if (type == EthernetHeaderView::IPV4) {
+      return "IPv4";
+    } else if (type == EthernetHeaderView::IPV6) {
+      return "IPv6";
     } else {
       this->print_log(NetworkLog::MODULE_ERROR, "Unsupported ethertype.");
       assert(0);
     }
   } else if (fromModule.compare("IPv4") == 0) {
-    uint8_t first_byte = 0x08;
-    uint8_t second_byte = 0x00;
-    packet.writeData(12, &first_byte, 1);
-    packet.writeData(13, &second_byte, 1);
+    EthernetHeaderView ethernet(packet, 0);
+    ethernet.setEtherType(EthernetHeaderView::IPV4);
 
-    ipv4_t dst_ip;
-    packet.readData(30, dst_ip.data(), 4);
+    ConstIPv4HeaderView ip(std::as_const(packet), EthernetHeaderView::SIZE);
+    ipv4_t dst_ip = ip.destination();
     constexpr ipv4_t ip_broadcast = {255, 255, 255, 255};
     constexpr mac_t mac_broadcast = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
     if (dst_ip == ip_broadcast) {
       // TODO: general IP broadcast
-      ipv4_t src_ip;
-      packet.readData(26, src_ip.data(), 4);
-      int port = this->getRoutingTable(src_ip);
+      int port = this->getRoutingTable(ip.source());
       auto src = this->getMACAddr(port);
-      packet.writeData(0, mac_broadcast.data(), 6);
-      packet.writeData(6, src.value().data(), 6);
+      ethernet.setDestination(mac_broadcast);
+      ethernet.setSource(src.value());
     } else {
       int port = this->getRoutingTable(dst_ip);
       auto src = this->getMACAddr(port);
       auto dst = this->getARPTable(dst_ip);
-      packet.writeData(0, dst.value().data(), 6);
-      packet.writeData(6, src.value().data(), 6);
+      ethernet.setDestination(dst.value());
+      ethernet.setSource(src.value());
     }
-    this->sendPacket("Host", std::move(packet));
+    return "Host";
   } else if (fromModule.compare("IPv6") == 0) {
-    uint8_t first_byte = 0x86;
-    uint8_t second_byte = 0xDD;
-    packet.writeData(12, &first_byte, 1);
-    packet.writeData(13, &second_byte, 1);
-    this->sendPacket("Host", std::move(packet));
+    EthernetHeaderView(packet, 0).setEtherType(EthernetHeaderView::IPV6);
+    return "Host";
   }
+  return {};
 }
 
 } // namespace E
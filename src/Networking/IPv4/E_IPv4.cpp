@@ -5,6 +5,8 @@
  *      Author: Keunhong Lee
  */
 
+#include <E/E_Checkpoint.hpp>
+#include <E/Networking/E_HeaderView.hpp>
 #include <E/Networking/E_Host.hpp>
 #include <E/Networking/E_NetworkUtil.hpp>
 #include <E/Networking/E_Networking.hpp>
@@ -19,113 +21,88 @@ IPv4::IPv4(Host &host) : HostModule("IPv4", host) { this->identification = 0; }
 IPv4::~IPv4() {}
 
 void IPv4::packetArrived(std::string fromModule, Packet &&packet) {
-  if (fromModule.compare("Ethernet") == 0) {
-    {
-      char first_byte, second_byte;
-      packet.readData(12, &first_byte, 1);
-      packet.readData(13, &second_byte, 1);
+  if (auto toModule = forward(fromModule, packet))
+    this->sendPacket(*toModule, std::move(packet));
+}
 
-      assert(first_byte == 0x08 && second_byte == 0x00);
-    }
+void IPv4::packetsArrived(std::string fromModule, PacketBatch &&batch) {
+  std::map<std::string, PacketBatch> forwarded;
+  for (Packet &packet : batch)
+    if (auto toModule = forward(fromModule, packet))
+      forwarded[*toModule].add(std::move(packet));
+  for (auto &[toModule, toBatch] : forwarded)
+    this->sendPacket(toModule, std::move(toBatch));
+}
+
+std::optional<std::string> IPv4::forward(std::string fromModule,
+                                         Packet &packet) {
+  const size_t ip_start = EthernetHeaderView::SIZE;
+  if (fromModule.compare("Ethernet") == 0) {
+    const Packet &received = packet;
+    const Packet::Metadata &metadata = received.getMetadata();
+    assert(metadata.networkOffset != Packet::Metadata::UNPARSED ||
+           ConstEthernetHeaderView(received, 0).etherType() ==
+               EthernetHeaderView::IPV4);
 
-    size_t ip_start = 14;
-    uint8_t ip_header_buffer[20];
-    packet.readData(ip_start, ip_header_buffer, 20);
-    uint16_t checksum = NetworkUtil::one_sum(ip_header_buffer, 20);
+    ConstIPv4HeaderView ip(received, ip_start);
+    uint16_t checksum = metadata.checksumVerified
+                            ? 0xFFFF
+                            : NetworkUtil::one_sum(ip.data(), ip.SIZE);
     if (checksum != 0xFFFF) {
       if (checksum != 0) {
         print_log(NetworkLog::PROTOCOL_ERROR, "Wrong checksum. Non-zero %u",
                   checksum);
-        return;
+        return {};
       }
       print_log(NetworkLog::PROTOCOL_WARNING,
                 "Checksum should be negative zero %u", checksum);
     }
 
-    uint8_t protocol;
-    packet.readData(ip_start + 9, &protocol, 1);
-    if (protocol == 0x06) // TCP
-    {
-      this->sendPacket("TCP", std::move(packet));
-    } else if (protocol == 0x11) // UDP
-    {
-      this->sendPacket("UDP", std::move(packet));
+    if (ip.protocol() == IPv4HeaderView::TCP) {
+      return "TCP";
+    } else if (ip.protocol() == IPv4HeaderView::UDP) {
+      return "UDP";
     } else {
       // Not TCP/UDP
     }
   } else if (fromModule.compare("TCP") == 0 || fromModule.compare("UDP") == 0) {
     uint8_t proto = 0;
-    size_t ip_start = 14;
     if (fromModule.compare("TCP") == 0) {
-      proto = 0x06;
+      proto = IPv4HeaderView::TCP;
     }
     if (fromModule.compare("UDP") == 0) {
-      proto = 0x11;
-    }
-    uint8_t buf;
-
-    {
-      buf = 0;
-      buf += 4 << 4; // IPv4
-      buf += 5;      // hlen = 5
-      packet.writeData(ip_start + 0, &buf, 1);
-    }
-    {
-      buf = 0; // DSCP, ECN
-      packet.writeData(ip_start + 1, &buf, 1);
-    }
-    {
-      buf = 0;
-      assert(packet.getSize() >= ip_start + 20);
-      uint16_t size = packet.getSize() - ip_start;
-      buf = size >> 8;
-      packet.writeData(ip_start + 2, &buf, 1);
-
-      buf = (uint8_t)(size & 0xFF);
-      packet.writeData(ip_start + 3, &buf, 1);
+      proto = IPv4HeaderView::UDP;
     }
-    {
-      uint16_t cur_id = identification++;
-      buf = 0;
-      buf = cur_id >> 8;
-      packet.writeData(ip_start + 4, &buf, 1);
 
-      buf = (uint8_t)(cur_id & 0xFF);
-      packet.writeData(ip_start + 5, &buf, 1);
-    }
-    {
-      buf = 1 << 6; // Do not frag
-      packet.writeData(ip_start + 6, &buf, 1);
-
-      buf = 0; // offset = 0;
-      packet.writeData(ip_start + 7, &buf, 1);
-    }
-    {
-      buf = 64; // TTL
-      packet.writeData(ip_start + 8, &buf, 1);
+    assert(packet.getSize() >= ip_start + IPv4HeaderView::SIZE);
+    IPv4HeaderView ip(packet, ip_start);
+    ip.setVersion(4);
+    ip.setHeaderLength(IPv4HeaderView::SIZE);
+    ip.setTypeOfService(0); // DSCP, ECN
+    ip.setTotalLength(packet.getSize() - ip_start);
+    ip.setIdentification(identification++);
+    ip.setFragment(IPv4HeaderView::DONT_FRAGMENT); // offset = 0
+    ip.setTimeToLive(64);
+    ip.setProtocol(proto);
+    ip.setChecksum(0);
+    // assume ip address is written; a partial packet is summed by the port
+    if (!packet.getMetadata().checksumPartial)
+      ip.setChecksum(~NetworkUtil::one_sum(ip.data(), ip.SIZE));
 
-      buf = proto; // PROTOCOL
-      packet.writeData(ip_start + 9, &buf, 1);
-    }
-    {
-      buf = 0; // checksum
-      packet.writeData(ip_start + 10, &buf, 1);
-      packet.writeData(ip_start + 11, &buf, 1);
-    }
-    {
-      // assume ip address is written
-    }
-    uint8_t ip_header_buffer[20];
-    packet.readData(ip_start, ip_header_buffer, 20);
-    uint16_t checksum = NetworkUtil::one_sum(ip_header_buffer, 20);
-    checksum = ~checksum;
-    checksum = htons(checksum);
-    packet.writeData(ip_start + 10, (uint8_t *)&checksum, 2);
-
-    this->sendPacket("Ethernet", std::move(packet));
+    return "Ethernet";
   } else {
     assert(0);
   }
+  return {};
+}
+
+bool IPv4::writeCheckpoint(std::ostream &out) {
+  Checkpoint::write(out, identification);
+  return true;
+}
+
+void IPv4::readCheckpoint(std::istream &in) {
+  identification = Checkpoint::read<uint16_t>(in);
 }
 
 } // namespace E